@@ -1,22 +1,670 @@
 #include <iostream>
 #include <string>
 #include <vector>
+#include <unordered_map>
+#include <utility>
+#include <chrono>
+#include <random>
+#include <span>
+#include <algorithm>
+#include <mutex>
+#include <thread>
+#include <memory>
+#include <atomic>
+#include <bit>
+#include <new>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <filesystem>
+#include <functional>
+#include <cmath>
+#include <stdexcept>
+#include <charconv>
+#include <iomanip>
+#include <cstdlib>
+#if defined(__x86_64__) || defined(_M_X64)
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#endif
+#include <condition_variable>
+#include <future>
+#include <optional>
+#include <deque>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <io.h>
+#else
+#include <pthread.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <cerrno>
+#endif
 
 using namespace std;
 
 class Customer; // Forward declaration
 
+enum class OpStatus : unsigned char {
+    Success,
+    AccountNotFound,
+    CustomerNotFound,
+    InvalidAmount,
+    InsufficientBalance,
+    HeldByEngine // a ConcurrentTransferEngine owns the balances; change them through it
+};
+
+// An amount of money held as a whole number of cents, so sums and comparisons are exact.
+// Arithmetic is checked: a result that does not fit in 64 bits throws overflow_error, so account
+// operations test canAdd first and refuse the change instead.
+class Money {
+private:
+    int64_t cents;
+    constexpr explicit Money(int64_t cents) : cents(cents) {}
+
+public:
+    constexpr Money() : cents(0) {}
+    static constexpr Money fromCents(int64_t cents) { return Money(cents); }
+    static Money fromMajor(int64_t units) { return Money(units) * 100; }
+    static Money fromDouble(double value); // rounds to the nearest cent
+    int64_t minorUnits() const { return cents; }
+    double toDouble() const { return cents / 100.0; }
+
+    Money operator+(Money other) const;
+    Money operator-(Money other) const;
+    Money operator*(int64_t factor) const;
+    bool canAdd(Money other) const;
+    Money& operator+=(Money other) { return *this = *this + other; }
+    Money& operator-=(Money other) { return *this = *this - other; }
+    Money percent(int64_t rate) const; // rate% of this amount, rounded half away from zero
+    auto operator<=>(const Money&) const = default;
+};
+
+ostream& operator<<(ostream& out, Money money);
+istream& operator>>(istream& in, Money& money);
+
+enum class EventType : unsigned char {
+    AccountAdded,
+    Deposit,
+    Withdrawal,
+    Transfer
+};
+
+// One structured record per engine operation; sinks decide how (or whether) to report it
+struct Event {
+    EventType type;
+    OpStatus status;
+    int accountNumber;  // customer ID for AccountAdded
+    int counterparty;   // destination account for Transfer
+    Money amount;
+    Money balance;      // balance after the operation
+};
+
+class EventSink {
+public:
+    virtual ~EventSink() {}
+    virtual void onEvent(const Event& event) = 0;
+};
+
+// Prints events as the interactive menu messages
+class ConsoleSink : public EventSink {
+private:
+    ostream& out;
+
+public:
+    ConsoleSink(ostream& out = cout) : out(out) {}
+    void onEvent(const Event& event) override;
+};
+
+// Drops every event; for batch and server use
+class NullSink : public EventSink {
+public:
+    void onEvent(const Event&) override {}
+};
+
+// Collects raw Event records and writes them to a binary stream in blocks
+class BufferedBinarySink : public EventSink {
+private:
+    ostream& out;
+    vector<Event> buffer;
+
+public:
+    BufferedBinarySink(ostream& out, size_t capacity = 4096) : out(out) { buffer.reserve(capacity); }
+    ~BufferedBinarySink() { flush(); }
+    void onEvent(const Event& event) override;
+    void flush();
+};
+
+// Append-only log that many threads can append to without a lock.
+// Storage is a fixed directory of segments; segment k holds FirstSegment << k elements, so the
+// directory never grows and an element never moves once written. A slot index is claimed with
+// one atomic increment, and a per-slot flag publishes the element once it is constructed.
+template <typename T, size_t FirstSegment = 4096, int MaxSegments = 32>
+class Journal {
+private:
+    struct Cell {
+        alignas(T) unsigned char storage[sizeof(T)];
+        atomic<bool> ready;
+    };
+    atomic<Cell*> segments[MaxSegments];
+    atomic<size_t> tail;
+
+    static int segmentOf(size_t index) { return bit_width(index / FirstSegment + 1) - 1; }
+    static size_t segmentStart(int segment) { return FirstSegment * ((size_t(1) << segment) - 1); }
+
+    Cell* segmentFor(int segment) {
+        Cell* cells = segments[segment].load(memory_order_acquire);
+        if (cells == nullptr) {
+            // Several appenders may race to allocate the same segment; one wins, the rest back off
+            Cell* fresh = new Cell[FirstSegment << segment]();
+            if (segments[segment].compare_exchange_strong(cells, fresh, memory_order_acq_rel)) {
+                cells = fresh;
+            } else {
+                delete[] fresh;
+            }
+        }
+        return cells;
+    }
+
+    Cell* cellAt(size_t index) const {
+        int segment = segmentOf(index);
+        Cell* cells = segments[segment].load(memory_order_acquire);
+        return cells ? &cells[index - segmentStart(segment)] : nullptr;
+    }
+
+public:
+    Journal() : tail(0) {
+        for (auto& segment : segments) {
+            segment.store(nullptr, memory_order_relaxed);
+        }
+    }
+    Journal(const Journal&) = delete;
+    Journal& operator=(const Journal&) = delete;
+    ~Journal() {
+        size_t count = tail.load(memory_order_acquire);
+        for (size_t i = 0; i < count; ++i) {
+            Cell* cell = cellAt(i);
+            if (cell && cell->ready.load(memory_order_acquire)) {
+                reinterpret_cast<T*>(cell->storage)->~T();
+            }
+        }
+        for (auto& segment : segments) {
+            delete[] segment.load(memory_order_relaxed);
+        }
+    }
+
+    template <typename... Args>
+    T& append(Args&&... args) {
+        return emplace(claim(), std::forward<Args>(args)...);
+    }
+
+    // append in two steps: claim() takes the next slot, whose index orders it against every
+    // other append and every size() call, and emplace() then writes the element into it
+    size_t claim() { return tail.fetch_add(1); }
+
+    template <typename... Args>
+    T& emplace(size_t index, Args&&... args) {
+        int segment = segmentOf(index);
+        Cell& cell = segmentFor(segment)[index - segmentStart(segment)];
+        T* value = new (cell.storage) T(std::forward<Args>(args)...);
+        cell.ready.store(true, memory_order_release);
+        return *value;
+    }
+
+    // Allocates segments up front so the first count appends never allocate
+    void reserve(size_t count) {
+        for (int segment = 0; segment < MaxSegments && segmentStart(segment) < count; ++segment) {
+            segmentFor(segment);
+        }
+    }
+
+    // Number of slots claimed so far, including appends still in flight
+    size_t size() const { return tail.load(); }
+
+    // Visits the longest prefix of fully written entries, so a reader never sees a gap or a
+    // half-built element even while appends continue. Returns the number of entries visited.
+    template <typename Visitor>
+    size_t forEach(Visitor visit) const {
+        size_t count = tail.load(memory_order_acquire);
+        size_t visited = 0;
+        for (; visited < count; ++visited) {
+            Cell* cell = cellAt(visited);
+            if (cell == nullptr || !cell->ready.load(memory_order_acquire)) {
+                break;
+            }
+            visit(*reinterpret_cast<const T*>(cell->storage));
+        }
+        return visited;
+    }
+
+    // Visits the first count entries, waiting for any of them still being written
+    template <typename Visitor>
+    void forEachBefore(size_t count, Visitor visit) const {
+        for (size_t i = 0; i < count; ++i) {
+            Cell* cell = cellAt(i);
+            while (cell == nullptr || !cell->ready.load(memory_order_acquire)) {
+                this_thread::yield();
+                cell = cellAt(i);
+            }
+            visit(*reinterpret_cast<const T*>(cell->storage));
+        }
+    }
+};
+
+// Epoch-based reclamation. A reader pins the global epoch while it reads shared versions, and the
+// epoch only advances once every pinned thread has caught up with it. So an object that was
+// replaced during epoch e can no longer be reached by any reader once the epoch is e + 2, and
+// whoever owns it may then free it without further synchronization.
+class EpochManager {
+private:
+    static constexpr uint64_t Idle = UINT64_MAX;
+    struct Participant {
+        alignas(64) atomic<uint64_t> epoch{Idle};
+        unsigned pins = 0;
+        bool owned = true;
+    };
+    // Hands the thread's participant back for reuse when the thread exits
+    struct Registration {
+        Participant* participant = nullptr;
+        ~Registration();
+    };
+    atomic<uint64_t> globalEpoch;
+    mutex lock;
+    vector<unique_ptr<Participant>> participants;
+    static thread_local Registration local;
+    EpochManager() : globalEpoch(1) {}
+    Participant& registerThread();
+
+public:
+    static EpochManager& global();
+    uint64_t current() const { return globalEpoch.load(); }
+    void pin();   // nests
+    void unpin();
+    bool tryAdvance();
+};
+
+// Pins the epoch for the enclosing scope
+class EpochGuard {
+public:
+    EpochGuard() { EpochManager::global().pin(); }
+    ~EpochGuard() { EpochManager::global().unpin(); }
+    EpochGuard(const EpochGuard&) = delete;
+    EpochGuard& operator=(const EpochGuard&) = delete;
+};
+
+// Built-in latency metrics for the hot operations. On by default; build with -DBANK_METRICS=0
+// to compile every probe out. Set BANK_METRICS_REPORT to a file path (or "-" for stdout) to
+// get a report on exit, as JSON if the path ends in .json and as a text table otherwise.
+#ifndef BANK_METRICS
+#define BANK_METRICS 1
+#endif
+
+enum class Metric : uint8_t {
+    Lookup,
+    Deposit,
+    Withdraw,
+    Transfer
+};
+const int metricCount = 4;
+const char* metricNames[metricCount] = {"lookup", "deposit", "withdraw", "transfer"};
+
+// Log-linear histogram in the style of HdrHistogram: 16 linear sub-buckets per power of two,
+// so each bucket is within 1/16 of the values it holds. Written by one thread only, with
+// relaxed loads and stores instead of locked increments; any thread may read it meanwhile.
+class LatencyHistogram {
+public:
+    static constexpr int SubBuckets = 16;
+    static constexpr int BucketCount = SubBuckets * 61;
+
+private:
+    atomic<uint64_t> buckets[BucketCount] = {};
+    atomic<uint64_t> sum{0};
+
+public:
+    static int bucketOf(uint64_t value) {
+        int shift = max((int)bit_width(value) - 5, 0);
+        return shift * SubBuckets + (int)(value >> shift);
+    }
+    static uint64_t bucketStart(int bucket) {
+        int shift = max(bucket / SubBuckets - 1, 0);
+        return (uint64_t)(bucket - shift * SubBuckets) << shift;
+    }
+    void record(uint64_t value) {
+        atomic<uint64_t>& bucket = buckets[bucketOf(value)];
+        bucket.store(bucket.load(memory_order_relaxed) + 1, memory_order_relaxed);
+        sum.store(sum.load(memory_order_relaxed) + value, memory_order_relaxed);
+    }
+    uint64_t countAt(int bucket) const { return buckets[bucket].load(memory_order_relaxed); }
+    uint64_t total() const { return sum.load(memory_order_relaxed); }
+};
+
+// Count of every operation; the times come from the sampled ones
+struct LatencySummary {
+    uint64_t count = 0;
+    double meanNs = 0;
+    double p50Ns = 0;
+    double p99Ns = 0;
+    double p999Ns = 0;
+    double maxNs = 0;
+};
+
+// Every thread records into its own shard, registered on its first operation; summaries merge
+// the shards. Every operation is counted, and one in SamplePeriod is timed, which keeps the
+// average probe to a few nanoseconds even where reading the clock is slow. Times come from
+// the CPU timestamp counter where there is one, converted to nanoseconds only when reported.
+class Metrics {
+public:
+    static constexpr uint32_t SamplePeriod = 16;
+
+private:
+    struct Shard {
+        atomic<uint64_t> counts[metricCount] = {};
+        uint32_t untilSample[metricCount] = {};
+        LatencyHistogram histograms[metricCount];
+    };
+    mutex lock;
+    vector<unique_ptr<Shard>> shards;
+    uint64_t startTicks;
+    chrono::steady_clock::time_point startTime;
+    static thread_local Shard* localShard;
+    Metrics();
+    ~Metrics();
+    Shard* registerThread();
+    double nanosecondsPerTick();
+
+public:
+    static Metrics& global();
+    static uint64_t ticks() {
+#if defined(__x86_64__) || defined(_M_X64)
+        return __rdtsc();
+#else
+        return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+    // Counts one operation; returns its start time if it is to be timed, otherwise 0
+    static uint64_t begin(Metric metric) {
+        Shard* shard = localShard ? localShard : global().registerThread();
+        atomic<uint64_t>& count = shard->counts[(int)metric];
+        count.store(count.load(memory_order_relaxed) + 1, memory_order_relaxed);
+        if (shard->untilSample[(int)metric]-- != 0) {
+            return 0;
+        }
+        shard->untilSample[(int)metric] = SamplePeriod - 1;
+        return ticks();
+    }
+    static void end(Metric metric, uint64_t start) {
+        localShard->histograms[(int)metric].record(ticks() - start);
+    }
+    LatencySummary summary(Metric metric);
+    void report(ostream& out, bool json);
+};
+
+// Times the enclosing block as one operation of the given kind
+class MetricScope {
+private:
+    Metric metric;
+    uint64_t start;
+
+public:
+    explicit MetricScope(Metric metric) : metric(metric), start(Metrics::begin(metric)) {}
+    ~MetricScope() {
+        if (start != 0) {
+            Metrics::end(metric, start);
+        }
+    }
+};
+
+#if BANK_METRICS
+#define BANK_METRIC_SCOPE(metric) MetricScope metricScope(metric)
+#else
+#define BANK_METRIC_SCOPE(metric)
+#endif
+
+// Durable storage: a write-ahead log of mutations plus periodic snapshots of the whole bank.
+// Log record layout: payload size (u32), checksum (u32), LSN (u64), payload.
+uint32_t checksum(const char* data, size_t size);
+void syncFile(FILE* file);
+void syncDirectory(const string& path);
+string& recordBuffer();
+
+template <typename T>
+void putField(string& out, const T& value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+T getField(const char*& in) {
+    T value;
+    memcpy(&value, in, sizeof(T));
+    in += sizeof(T);
+    return value;
+}
+
+// Buffers records and writes each group with a single fwrite + fsync (group commit)
+class WriteAheadLog {
+private:
+    string path;
+    FILE* file;
+    string pending;
+    size_t pendingRecords;
+    size_t groupSize;
+    uint64_t nextLsn;
+    mutex lock;
+    void writePending();
+
+public:
+    WriteAheadLog(const string& path, uint64_t nextLsn, size_t groupSize);
+    ~WriteAheadLog();
+    bool isOpen() const { return file != nullptr; }
+    uint64_t append(string_view payload);
+    void commit();
+    void reset();
+    uint64_t lastLsn();
+    static uint64_t replay(const string& path, uint64_t afterLsn, const function<void(const char*, size_t)>& apply);
+};
+
+// Read-only view of a whole file, memory-mapped where the platform supports it
+class MappedFile {
+private:
+    const char* mappedData;
+    size_t mappedSize;
+    vector<char> fallback;
+
+public:
+    MappedFile(const string& path);
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    const char* data() const { return mappedData; }
+    size_t size() const { return mappedSize; }
+};
+
+enum class LogRecordType : uint8_t {
+    AddCustomer = 1,
+    AddAccount,
+    Transfer,
+    Deposit,
+    Withdrawal
+};
+
+struct SnapshotHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t lsn;
+    int32_t nextCustomerId;
+    int32_t nextAccountNumber;
+    int32_t nextTransactionId;
+    uint32_t customerCount;
+    uint64_t accountCount;
+    uint64_t transactionCount;
+    uint32_t headerChecksum; // of the whole header with this field zeroed
+    uint32_t reserved;
+};
+
+// Fixed-size snapshot rows; customers follow as (id, name length, name bytes)
+struct AccountRecord {
+    int32_t accountNumber;
+    int32_t customerId;
+    int64_t balanceCents;
+};
+
+struct TransactionRecord {
+    int32_t transactionId;
+    int32_t reserved;
+    int64_t amountCents;
+};
+
+const uint32_t snapshotMagic = 0x504e5342; // "BSNP"
+
+// Columnar dataset files, for loading and exporting a whole bank in bulk.
+// Layout: DatasetHeader, then row groups. A group header gives the table, the row count and the
+// byte size of each column; the columns follow back to back, each padded to a multiple of 8
+// bytes so a mapped file can be read in place. A string column is stored as two: u32 end
+// offsets, then the concatenated bytes.
+//   Customers:    id i32, name
+//   Accounts:     account number i32, owner id i32, balance cents i64
+//   Transactions: transaction id i32, amount cents i64
+enum class DatasetTable : uint32_t {
+    Customers = 1,
+    Accounts,
+    Transactions
+};
+
+struct DatasetHeader {
+    uint32_t magic;
+    uint32_t version;
+};
+
+struct DatasetGroupHeader {
+    DatasetTable table;
+    uint32_t rowCount;
+    uint32_t columnCount;
+    uint32_t reserved; // then columnCount u64 column sizes
+};
+
+const uint32_t datasetMagic = 0x4c4f4342; // "BCOL"
+
+span<const uint8_t> datasetSchema(DatasetTable table);
+
+// Streams rows into a dataset file. Rows are buffered per table and written as a row group
+// whenever GroupRows of them have built up, so memory use does not grow with the file.
+class DatasetWriter {
+private:
+    FILE* file;
+    bool failed;
+    uint64_t rows;
+    vector<int32_t> customerIds;
+    vector<uint32_t> nameEnds;
+    string names;
+    vector<int32_t> accountNumbers;
+    vector<int32_t> ownerIds;
+    vector<int64_t> balances;
+    vector<int32_t> transactionIds;
+    vector<int64_t> amounts;
+    void writeGroup(DatasetTable table, size_t rowCount, initializer_list<string_view> columns);
+    void flushCustomers();
+    void flushAccounts();
+    void flushTransactions();
+
+public:
+    static constexpr size_t GroupRows = 65536;
+    explicit DatasetWriter(const string& path);
+    ~DatasetWriter() { close(); }
+    DatasetWriter(const DatasetWriter&) = delete;
+    DatasetWriter& operator=(const DatasetWriter&) = delete;
+    bool isOpen() const { return file != nullptr; }
+    void addCustomer(int customerId, const string& name);
+    void addAccount(int accountNumber, int ownerId, Money balance);
+    void addTransaction(int transactionId, Money amount);
+    uint64_t rowCount() const { return rows; }
+    bool close();
+};
+
+// One row group, pointing straight into the mapped file
+struct DatasetGroup {
+    DatasetTable table;
+    uint32_t rowCount;
+    vector<string_view> columns;
+
+    template <typename T>
+    span<const T> column(size_t index) const { return {reinterpret_cast<const T*>(columns[index].data()), rowCount}; }
+    string_view text(size_t endsColumn, uint32_t row) const;
+};
+
+// Maps a dataset file and checks every group header and string column up front, so readers
+// can index the columns without further bounds checks
+class DatasetReader {
+private:
+    MappedFile file;
+    vector<DatasetGroup> groups;
+    uint64_t rows;
+    bool valid;
+
+public:
+    explicit DatasetReader(const string& path);
+    bool isValid() const { return valid; }
+    const vector<DatasetGroup>& getGroups() const { return groups; }
+    uint64_t rowCount() const { return rows; }
+};
+
+// Hands out unique ids from one atomic counter a block at a time. Each thread reserves
+// BlockSize ids with a single fetch_add and issues them from a thread-local block, so threads
+// meet on the shared counter once per block. Ids are unique and roughly increasing; ids left
+// in a thread's block when it exits are never used. advancePast() is for restoring saved
+// state and must not run while other threads are allocating.
+class IdService {
+public:
+    static constexpr int BlockSize = 64;
+
+private:
+    static constexpr int MaxServices = 8;
+    struct Block {
+        int next = 0;
+        int end = 0;
+        uint32_t epoch = 0; // the service's epoch when the block was taken
+    };
+    static atomic<int> serviceCount;
+    static thread_local Block blocks[MaxServices];
+    int slot; // this service's entry in every thread's blocks
+    atomic<int> next;
+    atomic<uint32_t> epoch; // bumped by advancePast, so blocks taken before it are dropped
+
+public:
+    explicit IdService(int first = 1);
+    int allocate();
+    void advancePast(int id);
+    int upperBound() const { return next.load(memory_order_relaxed); } // above every id issued so far
+};
+
 class BankAccount {
 private:
     int accountNumber;
-    double balance;
-    static int nextAccountNumber;
+    Money balance;
+    static IdService accountNumbers;
+    BankAccount(int accountNumber, Money balance); // restore an existing account
 
 public:
-    BankAccount(double initialBalance = 0.0);
-    void deposit(double amount);
-    void withdraw(double amount);
-    double getBalance() ;
+    BankAccount(Money initialBalance = Money());
+    OpStatus deposit(Money amount);
+    OpStatus withdraw(Money amount);
+    Money getBalance() ;
     int getAccountNumber() ;
     friend class BankSystem;
     friend class Transaction;
@@ -25,14 +673,16 @@ public:
 class Transaction {
 private:
     int transactionId;
-    double amount;
-    static int nextTransactionId;
+    Money amount;
+    static IdService transactionIds;
 
 public:
-    Transaction(double amount);
-    int getTransactionId() ;
-    double getAmount() ;
+    Transaction(Money amount);
+    Transaction(int transactionId, Money amount); // restore an existing entry
+    int getTransactionId() const;
+    Money getAmount() const;
     friend class BankSystem;
+    friend class ShardedBank;
 };
 
 class Customer {
@@ -42,177 +692,3909 @@ private:
     vector<BankAccount> accounts;
 
 public:
-    Customer(string& name, int customerId);
-    void addAccount(BankAccount account);
+    Customer(string name, int customerId);
+    BankAccount& addAccount(BankAccount&& account);
     void listAccounts() ;
     friend class BankSystem;
 };
 
+struct TransferRequest {
+    int fromAccountId;
+    int toAccountId;
+    Money amount;
+};
+
+// A column-per-field copy of every account (account number, owner, balance), built for
+// reporting passes. Each query streams one contiguous array with a branch-free loop that the
+// compiler vectorizes, instead of walking customers and their nested account vectors.
+class AccountColumns {
+private:
+    vector<int32_t> accountNumbers;
+    vector<int32_t> ownerIds;
+    vector<int64_t> balances; // cents
+
+public:
+    void reserve(size_t rows);
+    void append(int accountNumber, int ownerId, Money balance);
+    size_t size() const { return balances.size(); }
+    int accountNumberAt(size_t row) const { return accountNumbers[row]; }
+    int ownerIdAt(size_t row) const { return ownerIds[row]; }
+    Money totalBalance() const;
+    Money totalBalanceOf(int ownerId) const;
+    size_t countBelow(Money threshold) const;
+    size_t selectBelow(Money threshold, vector<uint32_t>& rows) const;
+};
+
 class BankSystem {
 private:
     vector<Customer> customers;
-    vector<Transaction> transactions;
+    Journal<Transaction> transactions;
+    unordered_map<int, pair<int, int>> accountIndex; // account number -> (customer index, account slot)
     int nextCustomerId;
+    EventSink* sink;
+    static NullSink nullSink;
+    unique_ptr<WriteAheadLog> wal;
+    string storagePath;
+    uint64_t checkpointLsn;
+    uint64_t checkpointInterval;
+    bool heldByEngine; // a ConcurrentTransferEngine exists, so the calls here refuse to change balances
     int findCustomerIndex(int customerId);
+    BankAccount* findAccount(int accountNumber);
+    void logTransfer(int transactionId, int fromAccountId, int toAccountId, Money amount);
+    void applyLogRecord(const char* data, size_t size);
+    void restoreAccount(int customerId, int accountNumber, Money balance);
+    uint64_t loadSnapshot(const string& path);
+    void writeSnapshot(const string& path, uint64_t lsn);
 
 public:
-    BankSystem(){nextCustomerId=1;}
-    void addCustomer(string& name);
-    void addAccount(int customerId, double initialBalance = 0.0);
+    BankSystem(){nextCustomerId=1; sink=&nullSink; checkpointLsn=0; checkpointInterval=1000000; heldByEngine=false;}
+    ~BankSystem() { sync(); }
+    void setEventSink(EventSink* eventSink) { sink = eventSink ? eventSink : &nullSink; }
+    int addCustomer(string_view name);
+    int addAccount(int customerId, Money initialBalance = Money());
+    OpStatus deposit(int accountNumber, Money amount);
+    OpStatus withdraw(int accountNumber, Money amount);
+    OpStatus getBalance(int accountNumber, Money& balance);
     void listCustomers() ;
     void listCustomerAccounts(int customerId) ;
-    void performTransaction(int fromAccountId, int toAccountId, double amount);
+    OpStatus performTransaction(int fromAccountId, int toAccountId, Money amount);
+    vector<OpStatus> performTransactions(span<const TransferRequest> requests);
     void listTransactions() ;
+    bool openStorage(const string& basePath, size_t groupSize = 64);
+    void setCheckpointInterval(uint64_t records) { checkpointInterval = records; }
+    void reserveLedger(size_t entries) { transactions.reserve(transactions.size() + entries); } // room for that many more
+    void sync();
+    void checkpoint();
+    size_t customerCount() const { return customers.size(); }
+    size_t accountCount() const { return accountIndex.size(); }
+    AccountColumns exportColumns() const;
+    uint64_t exportDataset(const string& path);
+    uint64_t importDataset(const DatasetReader& dataset);
+    friend class ConcurrentTransferEngine;
+    friend class ShardedBank;
 };
 
-int BankAccount::nextAccountNumber = 1;
-int Transaction::nextTransactionId = 1;
+// Thread-safe transfers over a BankSystem whose account set is fixed while the engine is in use.
+// Each account has its own mutex; a transfer locks both accounts in account-number order.
+// Ledger entries go straight into the lock-free transaction journal.
+// Reports read snapshots instead of live state (MVCC). Every account keeps a newest-first chain
+// of its committed balances, each stamped with the ledger position of the transfer that wrote
+// it, so a snapshot taken at ledger size n sees exactly the first n ledger entries and the
+// balances they left, while transfers keep committing. A replaced balance is freed by a later
+// transfer on the same account once the epoch is two past its replacement. The chains start from
+// the balances at construction and only the engine adds to them, so while the engine exists the
+// bank's own deposits, withdrawals and transfers, and a TransferScheduler or ShardedBank over
+// it, refuse with HeldByEngine.
+class ConcurrentTransferEngine {
+private:
+    struct BalanceVersion {
+        static constexpr uint64_t Pending = UINT64_MAX;
+        Money balance;
+        atomic<uint64_t> commitStamp; // ledger size including the transfer that wrote it
+        uint64_t replacedEpoch;       // set under the account's lock when a newer version goes up
+        atomic<BalanceVersion*> older;
+    };
+    struct Slot {
+        BankAccount* account;
+        mutex* lock;
+        atomic<BalanceVersion*>* versions;
+    };
+    BankSystem& bankSystem;
+    unique_ptr<mutex[]> accountLocks;
+    unique_ptr<atomic<BalanceVersion*>[]> versionChains;
+    unordered_map<int, Slot> slots;
+    vector<int> lockOrder; // every account number, ascending
+    Money expectedTotal;
+    BalanceVersion* pushVersion(const Slot& slot, uint64_t epoch);
+    BalanceVersion* reclaimVersions(const Slot& slot, uint64_t epoch);
 
-// BankAccount class member functions
-BankAccount::BankAccount(double initialBalance){
-    balance=initialBalance;
-    accountNumber = nextAccountNumber++;
-}
+public:
+    // Balances and ledger as of one point in the ledger. Taking one never blocks transfers.
+    // It pins the calling thread's epoch until destroyed, which holds back reclamation, so keep
+    // it on one thread and only for the length of a report.
+    class Snapshot {
+    private:
+        const ConcurrentTransferEngine& engine;
+        EpochGuard pinned;
+        uint64_t ledgerEnd;
+        explicit Snapshot(const ConcurrentTransferEngine& engine);
+        friend class ConcurrentTransferEngine;
 
-void BankAccount::deposit(double amount) {
-    if (amount > 0) {
-        balance += amount;
-        cout << "Deposit of $" << amount << " successful. New balance: $" << balance << endl;
-    } else {
-        cout << "Invalid deposit amount." << endl;
+    public:
+        size_t ledgerSize() const { return ledgerEnd; }
+        OpStatus getBalance(int accountNumber, Money& balance) const;
+        Money totalBalance() const;
+        void listAccounts(ostream& out) const;
+        void listTransactions(ostream& out) const;
+    };
+
+    ConcurrentTransferEngine(BankSystem& bankSystem);
+    ~ConcurrentTransferEngine();
+    OpStatus transfer(int fromAccountId, int toAccountId, Money amount);
+    Snapshot snapshot() const { return Snapshot(*this); }
+    Money totalBalance();
+    bool checkConservation();
+};
+
+// Accounts partitioned into shards by account number, each shard owned by one worker thread
+// pinned to its own core. A worker is the only thread that touches its accounts, so it applies
+// same-shard transfers without locks. Cross-shard transfers use two phases over the shards'
+// message queues. The source shard reserves the amount and sends Prepare to the destination
+// shard, which credits the account and replies Commit, or replies Abort if the account is not
+// there or cannot hold the amount. Each shard keeps its own ledger; the two legs of a cross-shard transfer share one
+// transaction id. Every committed transfer also goes into the BankSystem's journal and, when its
+// storage is open, its write-ahead log, once: for a cross-shard transfer, by the destination shard
+// just before it credits the account. Nothing the destination does with the money can then reach
+// the log ahead of the transfer, and the source's reservation already keeps its own later
+// transfers within the balance the log replays. Built over a BankSystem whose accounts must not be used any other way while the
+// sharded bank exists.
+class ShardedBank {
+private:
+    enum class MessageKind : uint8_t {
+        Transfer,
+        Prepare,
+        Commit,
+        Abort
+    };
+    // Requests of one performTransactions call still in flight
+    struct Batch {
+        vector<OpStatus> results;
+        atomic<size_t> remaining;
+        mutex lock;
+        condition_variable done;
+        bool finished = false;
+    };
+    struct Message {
+        MessageKind kind;
+        int transactionId;
+        int fromAccountId;
+        int toAccountId;
+        Money amount;
+        Batch* batch;
+        size_t slot; // index of the request in its batch
+        OpStatus status = OpStatus::Success; // with Abort, why the destination refused
+    };
+    struct LedgerEntry {
+        int transactionId;
+        int fromAccountId;
+        int toAccountId;
+        Money amount;
+    };
+    struct alignas(64) Shard {
+        unordered_map<int, BankAccount*> accounts;
+        vector<LedgerEntry> ledger;
+        Money reserved; // held by outgoing transfers awaiting Commit or Abort
+        mutex lock;
+        condition_variable wake;
+        vector<Message> inbox;
+        bool stopping = false;
+        thread worker;
+    };
+    BankSystem& bankSystem;
+    vector<unique_ptr<Shard>> shards;
+    Money expectedTotal;
+    int shardOf(int accountNumber) const { return (unsigned)accountNumber % shards.size(); }
+    void post(int shard, span<const Message> messages);
+    void run(int shard);
+    bool handle(int shard, const Message& message, vector<vector<Message>>& outgoing);
+
+public:
+    ShardedBank(BankSystem& bankSystem, unsigned shardCount);
+    ~ShardedBank();
+    OpStatus performTransaction(int fromAccountId, int toAccountId, Money amount);
+    vector<OpStatus> performTransactions(span<const TransferRequest> requests);
+    size_t shardCount() const { return shards.size(); }
+    size_t ledgerSize();
+    Money totalBalance();
+    bool checkConservation();
+};
+
+// Group commit for transfers submitted from many threads. submit() queues a transfer and returns
+// a future. A scheduler thread closes a batch once it holds maxBatch transfers or its first
+// transfer has waited for the window, applies the batch through performTransactions, syncs the
+// write-ahead log once for all of it, and only then completes the batch's futures. The scheduler
+// applies a batch on its own thread in submission order, a serial order, so transfers touching
+// the same account never conflict and each one sees the balances an unbatched run would have.
+// Opened with a log group size of at least maxBatch, the storage writes each batch as one group.
+// The bank must not be used any other way while the scheduler exists.
+class TransferScheduler {
+private:
+    struct Pending {
+        TransferRequest request;
+        promise<OpStatus> result;
+        chrono::steady_clock::time_point submittedAt;
+    };
+    BankSystem& bankSystem;
+    chrono::microseconds window;
+    size_t maxBatch;
+    mutex lock;
+    condition_variable arrived;
+    deque<Pending> queue;
+    bool stopping;
+    atomic<uint64_t> batches;
+    thread worker;
+    void run();
+
+public:
+    TransferScheduler(BankSystem& bankSystem, chrono::microseconds window, size_t maxBatch);
+    ~TransferScheduler(); // applies everything still queued
+    future<OpStatus> submit(int fromAccountId, int toAccountId, Money amount);
+    uint64_t batchCount() const { return batches.load(); }
+};
+
+atomic<int> IdService::serviceCount(0);
+thread_local IdService::Block IdService::blocks[IdService::MaxServices];
+IdService BankAccount::accountNumbers(1);
+IdService Transaction::transactionIds(1);
+NullSink BankSystem::nullSink;
+
+// EventSink member functions
+void ConsoleSink::onEvent(const Event& event) {
+    switch (event.type) {
+        case EventType::AccountAdded:
+            if (event.status == OpStatus::Success) {
+                out << "Account added for customer with ID: " << event.accountNumber << '\n';
+            } else {
+                out << "Customer with ID " << event.accountNumber << " not found." << '\n';
+            }
+            break;
+        case EventType::Deposit:
+            if (event.status == OpStatus::Success) {
+                out << "Deposit of $" << event.amount << " successful. New balance: $" << event.balance << '\n';
+            } else if (event.status == OpStatus::AccountNotFound) {
+                out << "Account not found." << '\n';
+            } else {
+                out << "Invalid deposit amount." << '\n';
+            }
+            break;
+        case EventType::Withdrawal:
+            if (event.status == OpStatus::Success) {
+                out << "Withdrawal of $" << event.amount << " successful. New balance: $" << event.balance << '\n';
+            } else if (event.status == OpStatus::AccountNotFound) {
+                out << "Account not found." << '\n';
+            } else {
+                out << "Insufficient balance or invalid withdrawal amount." << '\n';
+            }
+            break;
+        case EventType::Transfer:
+            if (event.status == OpStatus::Success) {
+                out << "Transaction successful." << '\n';
+            } else if (event.status == OpStatus::AccountNotFound) {
+                out << "Account(s) not found." << '\n';
+            } else {
+                out << "Invalid transaction or insufficient balance." << '\n';
+            }
+            break;
     }
 }
 
-void BankAccount::withdraw(double amount) {
-    if (amount > 0 && balance >= amount) {
-        balance -= amount;
-        cout << "Withdrawal of $" << amount << " successful. New balance: $" << balance << endl;
-    } else {
-        cout << "Insufficient balance or invalid withdrawal amount." << endl;
+void BufferedBinarySink::onEvent(const Event& event) {
+    if (buffer.size() == buffer.capacity()) {
+        flush();
     }
+    buffer.push_back(event);
 }
 
-double BankAccount::getBalance()  {
-    return balance;
+void BufferedBinarySink::flush() {
+    out.write(reinterpret_cast<const char*>(buffer.data()), buffer.size() * sizeof(Event));
+    buffer.clear();
 }
 
-int BankAccount::getAccountNumber()  {
-    return accountNumber;
+// Durable storage functions
+uint32_t checksum(const char* data, size_t size) {
+    uint32_t hash = 2166136261u; // FNV-1a
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ (unsigned char)data[i]) * 16777619u;
+    }
+    return hash;
 }
 
-// Transaction class member functions
-Transaction::Transaction(double amount) {
-    this ->amount=amount;
-    transactionId = nextTransactionId++;
+// Scratch string for building one log record. Each thread reuses its own, so logging a hot-path
+// operation does not allocate.
+string& recordBuffer() {
+    static thread_local string record;
+    record.clear();
+    return record;
 }
 
-int Transaction::getTransactionId()  {
-    return transactionId;
+void syncFile(FILE* file) {
+    fflush(file);
+#ifdef _WIN32
+    _commit(_fileno(file));
+#else
+    fsync(fileno(file));
+#endif
 }
 
-double Transaction::getAmount()  {
-    return amount;
+// Makes a rename or a new file in the directory holding path durable; Windows has no equivalent
+void syncDirectory(const string& path) {
+#ifndef _WIN32
+    string directory = filesystem::path(path).parent_path().string();
+    int fd = open(directory.empty() ? "." : directory.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+#endif
 }
 
-// Customer class member functions
-Customer::Customer( string& name, int customerId) : name(name), customerId(customerId) {}
-
-void Customer::addAccount(BankAccount account) {
-    accounts.push_back(account);
+WriteAheadLog::WriteAheadLog(const string& path, uint64_t nextLsn, size_t groupSize)
+    : path(path), pendingRecords(0), groupSize(max<size_t>(groupSize, 1)), nextLsn(nextLsn) {
+    file = fopen(path.c_str(), "ab");
 }
 
-void Customer::listAccounts()  {
-    cout << "Accounts for customer " << name << " (ID: " << customerId << "):" << endl;
-    for ( BankAccount& account : accounts) {
-        cout << "Account " << account.getAccountNumber() << ", Balance: $" << account.getBalance() << endl;
+WriteAheadLog::~WriteAheadLog() {
+    if (file) {
+        commit();
+        fclose(file);
     }
 }
 
-// BankSystem class member functions
-int BankSystem::findCustomerIndex(int customerId)  {
-    for (int i = 0; i < customers.size(); ++i) {
-        if (customers[i].customerId == customerId) {
-            return i;
-        }
+// Caller holds lock
+void WriteAheadLog::writePending() {
+    if (file && !pending.empty()) {
+        fwrite(pending.data(), 1, pending.size(), file);
+        syncFile(file);
     }
-    return -1; // Customer not found
-}
-
-void BankSystem::addCustomer(string& name) {
-    customers.emplace_back(name, nextCustomerId++);
+    pending.clear();
+    pendingRecords = 0;
 }
 
-void BankSystem::addAccount(int customerId, double initialBalance) {
-    int customerIndex = findCustomerIndex(customerId);
-    if (customerIndex != -1) {
-        customers[customerIndex].addAccount(BankAccount(initialBalance));
-        cout << "Account added for customer with ID: " << customerId << endl;
-    } else {
-        cout << "Customer with ID " << customerId << " not found." << endl;
+// Queues one record; the group is made durable once groupSize records are waiting
+uint64_t WriteAheadLog::append(string_view payload) {
+    lock_guard<mutex> guard(lock);
+    uint64_t lsn = nextLsn++;
+    // Built in place in the pending buffer, which keeps its capacity between groups
+    putField(pending, (uint32_t)payload.size());
+    size_t checksumAt = pending.size();
+    putField(pending, (uint32_t)0);
+    putField(pending, lsn);
+    pending += payload;
+    uint32_t sum = checksum(pending.data() + checksumAt + 4, pending.size() - checksumAt - 4);
+    memcpy(&pending[checksumAt], &sum, sizeof(sum));
+    if (++pendingRecords >= groupSize) {
+        writePending();
     }
+    return lsn;
 }
 
-void BankSystem::listCustomers()  {
-    cout << "Customers list:" << endl;
-    for ( Customer& customer : customers) {
-        cout << "Customer ID: " << customer.customerId << ", Name: " << customer.name << endl;
-    }
+void WriteAheadLog::commit() {
+    lock_guard<mutex> guard(lock);
+    writePending();
 }
 
-void BankSystem::listCustomerAccounts(int customerId)  {
-    int customerIndex = findCustomerIndex(customerId);
-    if (customerIndex != -1) {
-        customers[customerIndex].listAccounts();
-    } else {
-        cout << "Customer with ID " << customerId << " not found." << endl;
+// Empties the log once a snapshot covers everything in it; LSNs keep counting up
+void WriteAheadLog::reset() {
+    lock_guard<mutex> guard(lock);
+    writePending();
+    if (file) {
+        fclose(file);
+    }
+    file = fopen(path.c_str(), "wb");
+    if (file) {
+        syncFile(file); // the truncation must be durable before records land after it
     }
 }
 
-void BankSystem::performTransaction(int fromAccountId, int toAccountId, double amount) {
-    int fromCustomerIndex = -1;
-    int toCustomerIndex = -1;
-    int fromAccountIndex = -1;
-    int toAccountIndex = -1;
+uint64_t WriteAheadLog::lastLsn() {
+    lock_guard<mutex> guard(lock);
+    return nextLsn - 1;
+}
 
-    // Find the indexes of the accounts and customers
-    for (int i = 0; i < customers.size(); ++i) {
-        for (int j = 0; j < customers[i].accounts.size(); ++j) {
-            if (customers[i].accounts[j].getAccountNumber() == fromAccountId) {
-                fromCustomerIndex = i;
-                fromAccountIndex = j;
+// Feeds every intact record with an LSN above afterLsn to apply, and cuts off a torn tail left by
+// a crash so new records are appended after the last good one. Returns the highest LSN seen.
+uint64_t WriteAheadLog::replay(const string& path, uint64_t afterLsn, const function<void(const char*, size_t)>& apply) {
+    uint64_t lastLsn = afterLsn;
+    size_t goodBytes = 0;
+    {
+        MappedFile log(path);
+        const char* cursor = log.data();
+        const char* end = log.data() + log.size();
+        while (end - cursor >= 16) {
+            const char* record = cursor;
+            uint32_t size = getField<uint32_t>(cursor);
+            uint32_t sum = getField<uint32_t>(cursor);
+            if ((size_t)(end - cursor) < 8 + (size_t)size || checksum(cursor, 8 + size) != sum) {
+                cursor = record;
+                break;
             }
-            if (customers[i].accounts[j].getAccountNumber() == toAccountId) {
-                toCustomerIndex = i;
-                toAccountIndex = j;
+            uint64_t lsn = getField<uint64_t>(cursor);
+            if (lsn > afterLsn) {
+                apply(cursor, size);
+                lastLsn = lsn;
             }
+            cursor += size;
+        }
+        goodBytes = cursor - log.data();
+        if (goodBytes == log.size()) {
+            return lastLsn;
         }
     }
+    filesystem::resize_file(path, goodBytes);
+    return lastLsn;
+}
 
-    if (fromCustomerIndex == -1 || toCustomerIndex == -1 || fromAccountIndex == -1 || toAccountIndex == -1) {
-        cout << "Account(s) not found." << endl;
+MappedFile::MappedFile(const string& path) : mappedData(nullptr), mappedSize(0) {
+#ifdef _WIN32
+    ifstream in(path, ios::binary);
+    if (in) {
+        fallback.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+        mappedData = fallback.data();
+        mappedSize = fallback.size();
+    }
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
         return;
     }
+    struct stat info;
+    if (fstat(fd, &info) == 0 && info.st_size > 0) {
+        void* address = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (address != MAP_FAILED) {
+            mappedData = static_cast<const char*>(address);
+            mappedSize = info.st_size;
+        }
+    }
+    close(fd);
+#endif
+}
+
+MappedFile::~MappedFile() {
+#ifndef _WIN32
+    if (mappedData) {
+        munmap(const_cast<char*>(mappedData), mappedSize);
+    }
+#endif
+}
+
+// Metrics functions
+thread_local Metrics::Shard* Metrics::localShard = nullptr;
 
-    // Perform the transaction
-    if (amount > 0 && customers[fromCustomerIndex].accounts[fromAccountIndex].getBalance() >= amount) {
-        customers[fromCustomerIndex].accounts[fromAccountIndex].withdraw(amount);
-        customers[toCustomerIndex].accounts[toAccountIndex].deposit(amount);
-        transactions.emplace_back(amount);
-        cout << "Transaction successful." << endl;
+Metrics::Metrics() : startTicks(ticks()), startTime(chrono::steady_clock::now()) {}
+
+Metrics::~Metrics() {
+    const char* path = getenv("BANK_METRICS_REPORT");
+    if (path == nullptr || *path == '\0') {
+        return;
+    }
+    string target = path;
+    bool json = target.size() >= 5 && target.compare(target.size() - 5, 5, ".json") == 0;
+    if (target == "-") {
+        report(cout, json);
     } else {
-        cout << "Invalid transaction or insufficient balance." << endl;
+        ofstream out(target);
+        report(out, json);
     }
 }
 
-void BankSystem::listTransactions()  {
-    cout << "Transactions list:" << endl;
-    for ( Transaction& transaction : transactions) {
-        cout << "Transaction ID: " << transaction.getTransactionId() << ", Amount: $" << transaction.getAmount() << endl;
+Metrics& Metrics::global() {
+    static Metrics metrics;
+    return metrics;
+}
+
+Metrics::Shard* Metrics::registerThread() {
+    lock_guard<mutex> guard(lock);
+    shards.push_back(make_unique<Shard>());
+    localShard = shards.back().get();
+    return localShard;
+}
+
+// Timestamp-counter rate, measured against the steady clock over the life of the process
+double Metrics::nanosecondsPerTick() {
+#if defined(__x86_64__) || defined(_M_X64)
+    chrono::duration<double, nano> elapsed = chrono::steady_clock::now() - startTime;
+    if (elapsed.count() < 1e7) {
+        this_thread::sleep_for(chrono::milliseconds(10));
+        elapsed = chrono::steady_clock::now() - startTime;
     }
+    return elapsed.count() / (double)max<uint64_t>(ticks() - startTicks, 1);
+#else
+    return 1;
+#endif
 }
 
-int main() {
-    BankSystem bankSystem;
+LatencySummary Metrics::summary(Metric metric) {
+    vector<uint64_t> counts(LatencyHistogram::BucketCount);
+    uint64_t total = 0;
+    LatencySummary result;
+    {
+        lock_guard<mutex> guard(lock);
+        for (const unique_ptr<Shard>& shard : shards) {
+            const LatencyHistogram& histogram = shard->histograms[(int)metric];
+            for (int bucket = 0; bucket < LatencyHistogram::BucketCount; ++bucket) {
+                counts[bucket] += histogram.countAt(bucket);
+            }
+            total += histogram.total();
+            result.count += shard->counts[(int)metric].load(memory_order_relaxed);
+        }
+    }
+    uint64_t sampled = 0;
+    for (uint64_t count : counts) {
+        sampled += count;
+    }
+    if (sampled == 0) {
+        return result;
+    }
+    double scale = nanosecondsPerTick();
+    result.meanNs = total * scale / sampled;
+    // Each percentile is reported as the start of the bucket holding that rank
+    double* targets[] = {&result.p50Ns, &result.p99Ns, &result.p999Ns};
+    double fractions[] = {0.5, 0.99, 0.999};
+    uint64_t seen = 0;
+    int next = 0;
+    for (int bucket = 0; bucket < LatencyHistogram::BucketCount; ++bucket) {
+        if (counts[bucket] == 0) {
+            continue;
+        }
+        seen += counts[bucket];
+        while (next < 3 && seen >= (uint64_t)ceil(fractions[next] * sampled)) {
+            *targets[next++] = LatencyHistogram::bucketStart(bucket) * scale;
+        }
+        result.maxNs = LatencyHistogram::bucketStart(bucket) * scale;
+    }
+    return result;
+}
+
+void Metrics::report(ostream& out, bool json) {
+    if (json) {
+        out << "{\"operations\": [";
+    } else {
+        out << left << setw(10) << "Operation" << right << setw(12) << "Count" << setw(10) << "Mean ns" << setw(10)
+            << "p50 ns" << setw(10) << "p99 ns" << setw(10) << "p999 ns" << setw(10) << "Max ns" << endl;
+    }
+    for (int metric = 0; metric < metricCount; ++metric) {
+        LatencySummary summary = this->summary((Metric)metric);
+        if (json) {
+            out << (metric ? ", " : "") << "{\"name\": \"" << metricNames[metric] << "\", \"count\": " << summary.count
+                << ", \"mean_ns\": " << (uint64_t)summary.meanNs << ", \"p50_ns\": " << (uint64_t)summary.p50Ns
+                << ", \"p99_ns\": " << (uint64_t)summary.p99Ns << ", \"p999_ns\": " << (uint64_t)summary.p999Ns
+                << ", \"max_ns\": " << (uint64_t)summary.maxNs << "}";
+        } else {
+            out << left << setw(10) << metricNames[metric] << right << setw(12) << summary.count << setw(10)
+                << (uint64_t)summary.meanNs << setw(10) << (uint64_t)summary.p50Ns << setw(10) << (uint64_t)summary.p99Ns
+                << setw(10) << (uint64_t)summary.p999Ns << setw(10) << (uint64_t)summary.maxNs << endl;
+        }
+    }
+    if (json) {
+        out << "]}" << endl;
+    }
+}
+
+// EpochManager functions
+thread_local EpochManager::Registration EpochManager::local;
+
+EpochManager::Registration::~Registration() {
+    if (participant) {
+        lock_guard<mutex> guard(EpochManager::global().lock);
+        participant->epoch.store(Idle);
+        participant->pins = 0;
+        participant->owned = false;
+    }
+}
+
+EpochManager& EpochManager::global() {
+    static EpochManager manager;
+    return manager;
+}
+
+EpochManager::Participant& EpochManager::registerThread() {
+    lock_guard<mutex> guard(lock);
+    for (unique_ptr<Participant>& participant : participants) {
+        if (!participant->owned) {
+            participant->owned = true;
+            local.participant = participant.get();
+            return *participant;
+        }
+    }
+    participants.push_back(make_unique<Participant>());
+    local.participant = participants.back().get();
+    return *local.participant;
+}
+
+// Publishes the epoch, then checks it is still current, so an advance cannot slip in between
+void EpochManager::pin() {
+    Participant& self = local.participant ? *local.participant : registerThread();
+    if (self.pins++ > 0) {
+        return;
+    }
+    uint64_t epoch = globalEpoch.load();
+    while (true) {
+        self.epoch.store(epoch);
+        uint64_t current = globalEpoch.load();
+        if (current == epoch) {
+            return;
+        }
+        epoch = current;
+    }
+}
+
+void EpochManager::unpin() {
+    Participant& self = *local.participant;
+    if (--self.pins == 0) {
+        self.epoch.store(Idle, memory_order_release);
+    }
+}
+
+// Moves to the next epoch if every pinned thread is in the current one
+bool EpochManager::tryAdvance() {
+    lock_guard<mutex> guard(lock);
+    uint64_t epoch = globalEpoch.load();
+    for (unique_ptr<Participant>& participant : participants) {
+        uint64_t pinned = participant->epoch.load();
+        if (pinned != Idle && pinned != epoch) {
+            return false;
+        }
+    }
+    return globalEpoch.compare_exchange_strong(epoch, epoch + 1);
+}
+
+// Dataset functions
+span<const uint8_t> datasetSchema(DatasetTable table) {
+    // Element width of each column; 0 marks string bytes, whose end offsets are the column before
+    static const uint8_t customers[] = {4, 4, 0};
+    static const uint8_t accounts[] = {4, 4, 8};
+    static const uint8_t transactions[] = {4, 8};
+    switch (table) {
+        case DatasetTable::Customers:
+            return customers;
+        case DatasetTable::Accounts:
+            return accounts;
+        case DatasetTable::Transactions:
+            return transactions;
+    }
+    return {};
+}
+
+template <typename T>
+string_view columnBytes(const vector<T>& values) {
+    return string_view(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+}
+
+DatasetWriter::DatasetWriter(const string& path) : file(fopen(path.c_str(), "wb")), failed(false), rows(0) {
+    if (file) {
+        DatasetHeader header = {datasetMagic, 1};
+        failed = fwrite(&header, sizeof(header), 1, file) != 1;
+    }
+}
+
+void DatasetWriter::writeGroup(DatasetTable table, size_t rowCount, initializer_list<string_view> columns) {
+    static const char padding[8] = {};
+    DatasetGroupHeader header = {table, (uint32_t)rowCount, (uint32_t)columns.size(), 0};
+    string sizes;
+    for (string_view column : columns) {
+        putField(sizes, (uint64_t)column.size());
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(sizes.data(), 1, sizes.size(), file) == sizes.size();
+    for (string_view column : columns) {
+        size_t paddingSize = (8 - column.size() % 8) % 8;
+        ok = ok && fwrite(column.data(), 1, column.size(), file) == column.size() &&
+             fwrite(padding, 1, paddingSize, file) == paddingSize;
+    }
+    failed = failed || !ok;
+}
+
+void DatasetWriter::flushCustomers() {
+    if (!customerIds.empty()) {
+        writeGroup(DatasetTable::Customers, customerIds.size(),
+                   {columnBytes(customerIds), columnBytes(nameEnds), string_view(names)});
+        customerIds.clear();
+        nameEnds.clear();
+        names.clear();
+    }
+}
+
+void DatasetWriter::flushAccounts() {
+    if (!accountNumbers.empty()) {
+        writeGroup(DatasetTable::Accounts, accountNumbers.size(),
+                   {columnBytes(accountNumbers), columnBytes(ownerIds), columnBytes(balances)});
+        accountNumbers.clear();
+        ownerIds.clear();
+        balances.clear();
+    }
+}
+
+void DatasetWriter::flushTransactions() {
+    if (!transactionIds.empty()) {
+        writeGroup(DatasetTable::Transactions, transactionIds.size(), {columnBytes(transactionIds), columnBytes(amounts)});
+        transactionIds.clear();
+        amounts.clear();
+    }
+}
+
+void DatasetWriter::addCustomer(int customerId, const string& name) {
+    customerIds.push_back(customerId);
+    names += name;
+    nameEnds.push_back((uint32_t)names.size());
+    ++rows;
+    // Name offsets are 32-bit, so a group also ends once its names grow large
+    if (customerIds.size() == GroupRows || names.size() >= (1u << 30)) {
+        flushCustomers();
+    }
+}
+
+void DatasetWriter::addAccount(int accountNumber, int ownerId, Money balance) {
+    accountNumbers.push_back(accountNumber);
+    ownerIds.push_back(ownerId);
+    balances.push_back(balance.minorUnits());
+    ++rows;
+    if (accountNumbers.size() == GroupRows) {
+        flushAccounts();
+    }
+}
+
+void DatasetWriter::addTransaction(int transactionId, Money amount) {
+    transactionIds.push_back(transactionId);
+    amounts.push_back(amount.minorUnits());
+    ++rows;
+    if (transactionIds.size() == GroupRows) {
+        flushTransactions();
+    }
+}
+
+// Writes the remaining rows and closes the file; false if any write failed
+bool DatasetWriter::close() {
+    if (file == nullptr) {
+        return false;
+    }
+    flushCustomers();
+    flushAccounts();
+    flushTransactions();
+    failed = fclose(file) != 0 || failed;
+    file = nullptr;
+    return !failed;
+}
+
+string_view DatasetGroup::text(size_t endsColumn, uint32_t row) const {
+    span<const uint32_t> ends = column<uint32_t>(endsColumn);
+    uint32_t begin = row == 0 ? 0 : ends[row - 1];
+    return string_view(columns[endsColumn + 1].data() + begin, ends[row] - begin);
+}
+
+DatasetReader::DatasetReader(const string& path) : file(path), rows(0), valid(false) {
+    const char* cursor = file.data();
+    const char* end = cursor + file.size();
+    if (file.size() < sizeof(DatasetHeader)) {
+        return;
+    }
+    DatasetHeader header = getField<DatasetHeader>(cursor);
+    if (header.magic != datasetMagic || header.version != 1) {
+        return;
+    }
+    while (cursor != end) {
+        if ((size_t)(end - cursor) < sizeof(DatasetGroupHeader)) {
+            return;
+        }
+        DatasetGroupHeader groupHeader = getField<DatasetGroupHeader>(cursor);
+        span<const uint8_t> schema = datasetSchema(groupHeader.table);
+        if (schema.empty() || groupHeader.columnCount != schema.size() ||
+            (size_t)(end - cursor) < schema.size() * sizeof(uint64_t)) {
+            return;
+        }
+        const char* sizes = cursor;
+        cursor += schema.size() * sizeof(uint64_t);
+        DatasetGroup group = {groupHeader.table, groupHeader.rowCount, {}};
+        for (uint8_t width : schema) {
+            uint64_t size = getField<uint64_t>(sizes);
+            uint64_t paddedSize = (size + 7) & ~(uint64_t)7;
+            if (paddedSize < size || paddedSize > (uint64_t)(end - cursor)) {
+                return;
+            }
+            if (width != 0 && size != (uint64_t)group.rowCount * width) {
+                return;
+            }
+            group.columns.emplace_back(cursor, size);
+            cursor += paddedSize;
+            if (width == 0) {
+                // String ends must be ascending and stay inside the bytes column
+                uint32_t previous = 0;
+                for (uint32_t stringEnd : group.column<uint32_t>(group.columns.size() - 2)) {
+                    if (stringEnd < previous || stringEnd > size) {
+                        return;
+                    }
+                    previous = stringEnd;
+                }
+            }
+        }
+        rows += group.rowCount;
+        groups.push_back(move(group));
+    }
+    valid = true;
+}
+
+// Money member functions
+Money Money::fromDouble(double value) {
+    double scaled = value * 100.0;
+    if (!(scaled > -9.2e18 && scaled < 9.2e18)) {
+        throw overflow_error("money amount out of range");
+    }
+    return Money(llround(scaled));
+}
+
+Money Money::operator+(Money other) const {
+    int64_t result;
+    if (__builtin_add_overflow(cents, other.cents, &result)) {
+        throw overflow_error("money overflow");
+    }
+    return Money(result);
+}
+
+Money Money::operator-(Money other) const {
+    int64_t result;
+    if (__builtin_sub_overflow(cents, other.cents, &result)) {
+        throw overflow_error("money overflow");
+    }
+    return Money(result);
+}
+
+bool Money::canAdd(Money other) const {
+    int64_t result;
+    return !__builtin_add_overflow(cents, other.cents, &result);
+}
+
+Money Money::operator*(int64_t factor) const {
+    int64_t result;
+    if (__builtin_mul_overflow(cents, factor, &result)) {
+        throw overflow_error("money overflow");
+    }
+    return Money(result);
+}
+
+Money Money::percent(int64_t rate) const {
+    int64_t scaled = (*this * rate).cents;
+    return Money(scaled / 100 + (scaled % 100 >= 50) - (scaled % 100 <= -50));
+}
+
+ostream& operator<<(ostream& out, Money money) {
+    int64_t cents = money.minorUnits();
+    uint64_t magnitude = cents < 0 ? 0 - (uint64_t)cents : cents;
+    if (cents < 0) {
+        out << '-';
+    }
+    out << magnitude / 100 << '.' << (char)('0' + magnitude % 100 / 10) << (char)('0' + magnitude % 10);
+    return out;
+}
+
+// Reads a decimal amount such as 12.5; fails the stream if it is out of range
+istream& operator>>(istream& in, Money& money) {
+    double value;
+    if (in >> value) {
+        if (value > -9.2e16 && value < 9.2e16) {
+            money = Money::fromDouble(value);
+        } else {
+            in.setstate(ios::failbit);
+        }
+    }
+    return in;
+}
+
+// IdService member functions
+IdService::IdService(int first) : slot(serviceCount++), next(first), epoch(1) {
+    if (slot >= MaxServices) {
+        throw logic_error("too many IdService instances");
+    }
+}
+
+int IdService::allocate() {
+    Block& block = blocks[slot];
+    uint32_t current = epoch.load(memory_order_acquire);
+    if (block.next == block.end || block.epoch != current) {
+        block.next = next.fetch_add(BlockSize, memory_order_relaxed);
+        block.end = block.next + BlockSize;
+        block.epoch = current;
+    }
+    return block.next++;
+}
+
+// Makes every later id greater than id
+void IdService::advancePast(int id) {
+    int current = next.load(memory_order_relaxed);
+    while (current <= id) {
+        if (next.compare_exchange_weak(current, id + 1, memory_order_relaxed)) {
+            epoch.fetch_add(1, memory_order_release);
+            return;
+        }
+    }
+}
+
+// BankAccount class member functions
+BankAccount::BankAccount(Money initialBalance){
+    balance=initialBalance;
+    accountNumber = accountNumbers.allocate();
+}
+
+BankAccount::BankAccount(int accountNumber, Money balance) : accountNumber(accountNumber), balance(balance) {
+    accountNumbers.advancePast(accountNumber);
+}
+
+OpStatus BankAccount::deposit(Money amount) {
+    if (amount <= Money() || !balance.canAdd(amount)) {
+        return OpStatus::InvalidAmount;
+    }
+    balance += amount;
+    return OpStatus::Success;
+}
+
+OpStatus BankAccount::withdraw(Money amount) {
+    if (amount <= Money()) {
+        return OpStatus::InvalidAmount;
+    }
+    if (balance < amount) {
+        return OpStatus::InsufficientBalance;
+    }
+    balance -= amount;
+    return OpStatus::Success;
+}
+
+Money BankAccount::getBalance()  {
+    return balance;
+}
+
+int BankAccount::getAccountNumber()  {
+    return accountNumber;
+}
+
+// Transaction class member functions
+Transaction::Transaction(Money amount) {
+    this ->amount=amount;
+    transactionId = transactionIds.allocate();
+}
+
+Transaction::Transaction(int transactionId, Money amount) : transactionId(transactionId), amount(amount) {
+    transactionIds.advancePast(transactionId);
+}
+
+int Transaction::getTransactionId() const {
+    return transactionId;
+}
+
+Money Transaction::getAmount() const {
+    return amount;
+}
+
+// Customer class member functions
+Customer::Customer(string name, int customerId) : name(move(name)), customerId(customerId) {}
+
+BankAccount& Customer::addAccount(BankAccount&& account) {
+    return accounts.emplace_back(move(account));
+}
+
+void Customer::listAccounts()  {
+    cout << "Accounts for customer " << name << " (ID: " << customerId << "):" << endl;
+    for ( BankAccount& account : accounts) {
+        cout << "Account " << account.getAccountNumber() << ", Balance: $" << account.getBalance() << endl;
+    }
+}
+
+// BankSystem class member functions
+int BankSystem::findCustomerIndex(int customerId)  {
+    // Customer IDs are handed out sequentially, so the ID is normally its own index
+    if (customerId >= 1 && customerId <= (int)customers.size() && customers[customerId - 1].customerId == customerId) {
+        return customerId - 1;
+    }
+    for (int i = 0; i < customers.size(); ++i) {
+        if (customers[i].customerId == customerId) {
+            return i;
+        }
+    }
+    return -1; // Customer not found
+}
+
+int BankSystem::addCustomer(string_view name) {
+    customers.emplace_back(string(name), nextCustomerId++);
+    if (wal) {
+        string record;
+        putField(record, LogRecordType::AddCustomer);
+        putField(record, (int32_t)customers.back().customerId);
+        record += name;
+        wal->append(record);
+    }
+    return customers.back().customerId;
+}
+
+BankAccount* BankSystem::findAccount(int accountNumber) {
+    BANK_METRIC_SCOPE(Metric::Lookup);
+    auto it = accountIndex.find(accountNumber);
+    if (it == accountIndex.end()) {
+        return nullptr; // Account not found
+    }
+    return &customers[it->second.first].accounts[it->second.second];
+}
+
+// Returns the new account number, or -1 if the customer does not exist
+int BankSystem::addAccount(int customerId, Money initialBalance) {
+    int customerIndex = findCustomerIndex(customerId);
+    if (customerIndex != -1) {
+        int slot = customers[customerIndex].accounts.size();
+        int accountNumber = customers[customerIndex].addAccount(BankAccount(initialBalance)).getAccountNumber();
+        accountIndex[accountNumber] = make_pair(customerIndex, slot);
+        if (wal) {
+            string record;
+            putField(record, LogRecordType::AddAccount);
+            putField(record, (int32_t)customerId);
+            putField(record, (int32_t)accountNumber);
+            putField(record, initialBalance.minorUnits());
+            wal->append(record);
+        }
+        sink->onEvent({EventType::AccountAdded, OpStatus::Success, customerId, accountNumber, initialBalance, initialBalance});
+        return accountNumber;
+    } else {
+        sink->onEvent({EventType::AccountAdded, OpStatus::CustomerNotFound, customerId, -1, initialBalance, Money()});
+        return -1;
+    }
+}
+
+void BankSystem::listCustomers()  {
+    cout << "Customers list:" << endl;
+    for ( Customer& customer : customers) {
+        cout << "Customer ID: " << customer.customerId << ", Name: " << customer.name << endl;
+    }
+}
+
+void BankSystem::listCustomerAccounts(int customerId)  {
+    int customerIndex = findCustomerIndex(customerId);
+    if (customerIndex != -1) {
+        customers[customerIndex].listAccounts();
+    } else {
+        cout << "Customer with ID " << customerId << " not found." << endl;
+    }
+}
+
+OpStatus BankSystem::deposit(int accountNumber, Money amount) {
+    BANK_METRIC_SCOPE(Metric::Deposit);
+    BankAccount* account = findAccount(accountNumber);
+    OpStatus status = !account ? OpStatus::AccountNotFound : heldByEngine ? OpStatus::HeldByEngine : account->deposit(amount);
+    if (status == OpStatus::Success && wal) {
+        string& record = recordBuffer();
+        putField(record, LogRecordType::Deposit);
+        putField(record, (int32_t)accountNumber);
+        putField(record, amount.minorUnits());
+        wal->append(record);
+    }
+    sink->onEvent({EventType::Deposit, status, accountNumber, 0, amount, account ? account->balance : Money()});
+    return status;
+}
+
+OpStatus BankSystem::withdraw(int accountNumber, Money amount) {
+    BANK_METRIC_SCOPE(Metric::Withdraw);
+    BankAccount* account = findAccount(accountNumber);
+    OpStatus status = !account ? OpStatus::AccountNotFound : heldByEngine ? OpStatus::HeldByEngine : account->withdraw(amount);
+    if (status == OpStatus::Success && wal) {
+        string& record = recordBuffer();
+        putField(record, LogRecordType::Withdrawal);
+        putField(record, (int32_t)accountNumber);
+        putField(record, amount.minorUnits());
+        wal->append(record);
+    }
+    sink->onEvent({EventType::Withdrawal, status, accountNumber, 0, amount, account ? account->balance : Money()});
+    return status;
+}
+
+// A read: looks the account up without changing anything or sending an event
+OpStatus BankSystem::getBalance(int accountNumber, Money& balance) {
+    BankAccount* account = findAccount(accountNumber);
+    if (account == nullptr) {
+        return OpStatus::AccountNotFound;
+    }
+    balance = account->balance;
+    return OpStatus::Success;
+}
+
+OpStatus BankSystem::performTransaction(int fromAccountId, int toAccountId, Money amount) {
+    BANK_METRIC_SCOPE(Metric::Transfer);
+    // Resolve both accounts through the account index
+    BankAccount* fromAccount = findAccount(fromAccountId);
+    BankAccount* toAccount = findAccount(toAccountId);
+
+    if (fromAccount == nullptr || toAccount == nullptr) {
+        sink->onEvent({EventType::Transfer, OpStatus::AccountNotFound, fromAccountId, toAccountId, amount, Money()});
+        return OpStatus::AccountNotFound;
+    }
+    if (heldByEngine) {
+        sink->onEvent({EventType::Transfer, OpStatus::HeldByEngine, fromAccountId, toAccountId, amount, Money()});
+        return OpStatus::HeldByEngine;
+    }
+
+    // Perform the transaction; the destination is checked first, so a refused deposit never
+    // follows a withdrawal
+    OpStatus status = toAccount->balance.canAdd(amount) ? fromAccount->withdraw(amount) : OpStatus::InvalidAmount;
+    if (status == OpStatus::Success) {
+        sink->onEvent({EventType::Withdrawal, status, fromAccountId, toAccountId, amount, fromAccount->balance});
+        toAccount->deposit(amount);
+        sink->onEvent({EventType::Deposit, status, toAccountId, fromAccountId, amount, toAccount->balance});
+        logTransfer(transactions.append(amount).getTransactionId(), fromAccountId, toAccountId, amount);
+    }
+    sink->onEvent({EventType::Transfer, status, fromAccountId, toAccountId, amount, fromAccount->balance});
+    return status;
+}
+
+// Applies a batch of transfers in order without printing; returns one status per request
+vector<OpStatus> BankSystem::performTransactions(span<const TransferRequest> requests) {
+    vector<OpStatus> results(requests.size());
+    if (heldByEngine) {
+        fill(results.begin(), results.end(), OpStatus::HeldByEngine);
+        return results;
+    }
+    vector<pair<BankAccount*, BankAccount*>> resolved(requests.size());
+    transactions.reserve(transactions.size() + requests.size());
+
+    // Resolve every account once, before any balance changes
+    for (size_t i = 0; i < requests.size(); ++i) {
+        resolved[i] = make_pair(findAccount(requests[i].fromAccountId), findAccount(requests[i].toAccountId));
+    }
+
+    for (size_t i = 0; i < requests.size(); ++i) {
+        BankAccount* fromAccount = resolved[i].first;
+        BankAccount* toAccount = resolved[i].second;
+        Money amount = requests[i].amount;
+
+        if (fromAccount == nullptr || toAccount == nullptr) {
+            results[i] = OpStatus::AccountNotFound;
+        } else if (amount <= Money() || !toAccount->balance.canAdd(amount)) {
+            results[i] = OpStatus::InvalidAmount;
+        } else if (fromAccount->balance < amount) {
+            results[i] = OpStatus::InsufficientBalance;
+        } else {
+            fromAccount->balance -= amount;
+            toAccount->balance += amount;
+            logTransfer(transactions.append(amount).getTransactionId(), requests[i].fromAccountId, requests[i].toAccountId, amount);
+            results[i] = OpStatus::Success;
+        }
+    }
+    return results;
+}
+
+void BankSystem::listTransactions()  {
+    cout << "Transactions list:" << endl;
+    transactions.forEach([](const Transaction& transaction) {
+        cout << "Transaction ID: " << transaction.getTransactionId() << ", Amount: $" << transaction.getAmount() << endl;
+    });
+}
+
+void BankSystem::logTransfer(int transactionId, int fromAccountId, int toAccountId, Money amount) {
+    if (wal) {
+        string& record = recordBuffer();
+        putField(record, LogRecordType::Transfer);
+        putField(record, (int32_t)transactionId);
+        putField(record, (int32_t)fromAccountId);
+        putField(record, (int32_t)toAccountId);
+        putField(record, amount.minorUnits());
+        wal->append(record);
+    }
+}
+
+void BankSystem::restoreAccount(int customerId, int accountNumber, Money balance) {
+    int customerIndex = findCustomerIndex(customerId);
+    if (customerIndex == -1) {
+        return;
+    }
+    accountIndex[accountNumber] = make_pair(customerIndex, (int)customers[customerIndex].accounts.size());
+    customers[customerIndex].addAccount(BankAccount(accountNumber, balance));
+}
+
+// Re-applies one logged mutation during recovery
+void BankSystem::applyLogRecord(const char* data, size_t size) {
+    const char* end = data + size;
+    LogRecordType type = getField<LogRecordType>(data);
+    if (type == LogRecordType::AddCustomer) {
+        int customerId = getField<int32_t>(data);
+        customers.emplace_back(string(data, end), customerId);
+        nextCustomerId = max(nextCustomerId, customerId + 1);
+    } else if (type == LogRecordType::AddAccount) {
+        int customerId = getField<int32_t>(data);
+        int accountNumber = getField<int32_t>(data);
+        restoreAccount(customerId, accountNumber, Money::fromCents(getField<int64_t>(data)));
+    } else if (type == LogRecordType::Transfer) {
+        int transactionId = getField<int32_t>(data);
+        BankAccount* fromAccount = findAccount(getField<int32_t>(data));
+        BankAccount* toAccount = findAccount(getField<int32_t>(data));
+        Money amount = Money::fromCents(getField<int64_t>(data));
+        if (fromAccount && toAccount) {
+            fromAccount->balance -= amount;
+            toAccount->balance += amount;
+            transactions.append(transactionId, amount);
+        }
+    } else if (type == LogRecordType::Deposit || type == LogRecordType::Withdrawal) {
+        BankAccount* account = findAccount(getField<int32_t>(data));
+        Money amount = Money::fromCents(getField<int64_t>(data));
+        if (account) {
+            account->balance = type == LogRecordType::Deposit ? account->balance + amount : account->balance - amount;
+        }
+    }
+}
+
+// Loads a snapshot into this (empty) bank and returns the LSN it covers, or 0 if there is none
+uint64_t BankSystem::loadSnapshot(const string& path) {
+    MappedFile snapshot(path);
+    if (snapshot.size() < sizeof(SnapshotHeader)) {
+        return 0;
+    }
+    const char* cursor = snapshot.data();
+    const char* end = cursor + snapshot.size();
+    SnapshotHeader header = getField<SnapshotHeader>(cursor);
+    uint32_t storedChecksum = header.headerChecksum;
+    header.headerChecksum = 0;
+    if (header.magic != snapshotMagic || header.version != 3 ||
+        storedChecksum != checksum(reinterpret_cast<const char*>(&header), sizeof(header))) {
+        return 0;
+    }
+
+    // Every count and name length is checked against the bytes left before anything is restored,
+    // so a truncated or corrupt file is rejected as a whole
+    size_t remaining = end - cursor;
+    if (header.accountCount > remaining / sizeof(AccountRecord)) {
+        return 0;
+    }
+    remaining -= header.accountCount * sizeof(AccountRecord);
+    if (header.transactionCount > remaining / sizeof(TransactionRecord)) {
+        return 0;
+    }
+    const char* accountRows = cursor;
+    const char* transactionRows = accountRows + header.accountCount * sizeof(AccountRecord);
+    const char* customerRows = transactionRows + header.transactionCount * sizeof(TransactionRecord);
+    cursor = customerRows;
+    for (uint32_t i = 0; i < header.customerCount; ++i) {
+        if ((size_t)(end - cursor) < sizeof(int32_t) + sizeof(uint32_t)) {
+            return 0;
+        }
+        cursor += sizeof(int32_t);
+        uint32_t nameLength = getField<uint32_t>(cursor);
+        if (nameLength > (size_t)(end - cursor)) {
+            return 0;
+        }
+        cursor += nameLength;
+    }
+    cursor = customerRows;
+
+    customers.reserve(header.customerCount);
+    for (uint32_t i = 0; i < header.customerCount; ++i) {
+        int customerId = getField<int32_t>(cursor);
+        uint32_t nameLength = getField<uint32_t>(cursor);
+        customers.emplace_back(string(cursor, nameLength), customerId);
+        cursor += nameLength;
+    }
+    accountIndex.reserve(header.accountCount);
+    for (uint64_t i = 0; i < header.accountCount; ++i) {
+        AccountRecord row = getField<AccountRecord>(accountRows);
+        restoreAccount(row.customerId, row.accountNumber, Money::fromCents(row.balanceCents));
+    }
+    transactions.reserve(header.transactionCount);
+    for (uint64_t i = 0; i < header.transactionCount; ++i) {
+        TransactionRecord row = getField<TransactionRecord>(transactionRows);
+        transactions.append(row.transactionId, Money::fromCents(row.amountCents));
+    }
+    nextCustomerId = header.nextCustomerId;
+    BankAccount::accountNumbers.advancePast(header.nextAccountNumber - 1);
+    Transaction::transactionIds.advancePast(header.nextTransactionId - 1);
+    return header.lsn;
+}
+
+// Writes the whole bank to a temporary file and renames it into place, so a crash mid-write
+// leaves the previous snapshot intact
+void BankSystem::writeSnapshot(const string& path, uint64_t lsn) {
+    string temporaryPath = path + ".tmp";
+    FILE* file = fopen(temporaryPath.c_str(), "wb");
+    if (file == nullptr) {
+        return;
+    }
+    SnapshotHeader header = {snapshotMagic, 3, lsn, nextCustomerId, BankAccount::accountNumbers.upperBound(),
+                             Transaction::transactionIds.upperBound(), (uint32_t)customers.size(), accountIndex.size(), 0, 0, 0};
+    header.transactionCount = transactions.forEach([](const Transaction&) {});
+    header.headerChecksum = checksum(reinterpret_cast<const char*>(&header), sizeof(header));
+    fwrite(&header, sizeof(header), 1, file);
+
+    vector<AccountRecord> accountRows;
+    accountRows.reserve(accountIndex.size());
+    for (Customer& customer : customers) {
+        for (BankAccount& account : customer.accounts) {
+            accountRows.push_back({account.accountNumber, customer.customerId, account.balance.minorUnits()});
+        }
+    }
+    fwrite(accountRows.data(), sizeof(AccountRecord), accountRows.size(), file);
+
+    vector<TransactionRecord> transactionRows;
+    transactionRows.reserve(header.transactionCount);
+    transactions.forEach([&](const Transaction& transaction) {
+        if (transactionRows.size() < header.transactionCount) {
+            transactionRows.push_back({transaction.getTransactionId(), 0, transaction.getAmount().minorUnits()});
+        }
+    });
+    fwrite(transactionRows.data(), sizeof(TransactionRecord), transactionRows.size(), file);
+
+    string customerRows;
+    for (Customer& customer : customers) {
+        putField(customerRows, (int32_t)customer.customerId);
+        putField(customerRows, (uint32_t)customer.name.size());
+        customerRows += customer.name;
+    }
+    fwrite(customerRows.data(), 1, customerRows.size(), file);
+    syncFile(file);
+    fclose(file);
+    filesystem::rename(temporaryPath, path);
+    syncDirectory(path);
+}
+
+// Restores state from <basePath>.snap plus the tail of <basePath>.wal, then logs every change
+// from here on. Call once, on an empty BankSystem.
+bool BankSystem::openStorage(const string& basePath, size_t groupSize) {
+    storagePath = basePath;
+    checkpointLsn = loadSnapshot(basePath + ".snap");
+    uint64_t lastLsn = WriteAheadLog::replay(basePath + ".wal", checkpointLsn, [this](const char* data, size_t size) {
+        applyLogRecord(data, size);
+    });
+    wal.reset(new WriteAheadLog(basePath + ".wal", lastLsn + 1, groupSize));
+    return wal->isOpen();
+}
+
+// Makes every logged change durable, and checkpoints once the log has grown long enough.
+// Must not run while a ConcurrentTransferEngine is transferring.
+void BankSystem::sync() {
+    if (wal) {
+        wal->commit();
+        if (wal->lastLsn() - checkpointLsn >= checkpointInterval) {
+            checkpoint();
+        }
+    }
+}
+
+void BankSystem::checkpoint() {
+    if (wal) {
+        wal->commit();
+        uint64_t lsn = wal->lastLsn();
+        writeSnapshot(storagePath + ".snap", lsn);
+        wal->reset();
+        checkpointLsn = lsn;
+    }
+}
+
+AccountColumns BankSystem::exportColumns() const {
+    AccountColumns columns;
+    columns.reserve(accountIndex.size());
+    for (const Customer& customer : customers) {
+        for (const BankAccount& account : customer.accounts) {
+            columns.append(account.accountNumber, customer.customerId, account.balance);
+        }
+    }
+    return columns;
+}
+
+// Writes every customer, account and ledger entry to a dataset file. Returns the number of
+// rows written, or 0 if writing failed.
+uint64_t BankSystem::exportDataset(const string& path) {
+    DatasetWriter writer(path);
+    if (!writer.isOpen()) {
+        return 0;
+    }
+    for (Customer& customer : customers) {
+        writer.addCustomer(customer.customerId, customer.name);
+    }
+    for (Customer& customer : customers) {
+        for (BankAccount& account : customer.accounts) {
+            writer.addAccount(account.accountNumber, customer.customerId, account.balance);
+        }
+    }
+    transactions.forEach([&](const Transaction& transaction) {
+        writer.addTransaction(transaction.getTransactionId(), transaction.getAmount());
+    });
+    uint64_t rows = writer.rowCount();
+    return writer.close() ? rows : 0;
+}
+
+// Loads a dataset into this empty bank, bypassing the log; a checkpoint follows so the
+// loaded state is durable. Returns the number of rows loaded, or 0 if the bank is not empty.
+// Accounts whose owner is not in the dataset are skipped.
+uint64_t BankSystem::importDataset(const DatasetReader& dataset) {
+    if (!dataset.isValid() || !customers.empty()) {
+        return 0;
+    }
+    size_t tableRows[4] = {};
+    for (const DatasetGroup& group : dataset.getGroups()) {
+        tableRows[(int)group.table] += group.rowCount;
+    }
+    customers.reserve(tableRows[(int)DatasetTable::Customers]);
+    accountIndex.reserve(tableRows[(int)DatasetTable::Accounts]);
+    transactions.reserve(tableRows[(int)DatasetTable::Transactions]);
+
+    // Customers first, so every account finds its owner whatever the group order in the file
+    uint64_t loaded = 0;
+    for (const DatasetGroup& group : dataset.getGroups()) {
+        if (group.table == DatasetTable::Customers) {
+            span<const int32_t> ids = group.column<int32_t>(0);
+            for (uint32_t row = 0; row < group.rowCount; ++row) {
+                customers.emplace_back(string(group.text(1, row)), ids[row]);
+                nextCustomerId = max(nextCustomerId, ids[row] + 1);
+            }
+            loaded += group.rowCount;
+        }
+    }
+    for (const DatasetGroup& group : dataset.getGroups()) {
+        if (group.table == DatasetTable::Accounts) {
+            span<const int32_t> numbers = group.column<int32_t>(0);
+            span<const int32_t> owners = group.column<int32_t>(1);
+            span<const int64_t> balances = group.column<int64_t>(2);
+            for (uint32_t row = 0; row < group.rowCount; ++row) {
+                // A repeated account number would leave an account no lookup can reach; the first row keeps it
+                if (accountIndex.count(numbers[row])) {
+                    continue;
+                }
+                size_t before = accountIndex.size();
+                restoreAccount(owners[row], numbers[row], Money::fromCents(balances[row]));
+                loaded += accountIndex.size() - before;
+            }
+        } else if (group.table == DatasetTable::Transactions) {
+            span<const int32_t> ids = group.column<int32_t>(0);
+            span<const int64_t> amounts = group.column<int64_t>(1);
+            for (uint32_t row = 0; row < group.rowCount; ++row) {
+                transactions.append(ids[row], Money::fromCents(amounts[row]));
+            }
+            loaded += group.rowCount;
+        }
+    }
+    checkpoint();
+    return loaded;
+}
+
+// AccountColumns class member functions
+void AccountColumns::reserve(size_t rows) {
+    accountNumbers.reserve(rows);
+    ownerIds.reserve(rows);
+    balances.reserve(rows);
+}
+
+void AccountColumns::append(int accountNumber, int ownerId, Money balance) {
+    accountNumbers.push_back(accountNumber);
+    ownerIds.push_back(ownerId);
+    balances.push_back(balance.minorUnits());
+}
+
+// Summed as raw cents: every balance is a valid Money, and 2^63 cents is far beyond any real bank
+Money AccountColumns::totalBalance() const {
+    const int64_t* balance = balances.data();
+    size_t rows = balances.size();
+    int64_t total = 0;
+    for (size_t i = 0; i < rows; ++i) {
+        total += balance[i];
+    }
+    return Money::fromCents(total);
+}
+
+Money AccountColumns::totalBalanceOf(int ownerId) const {
+    const int64_t* balance = balances.data();
+    const int32_t* owner = ownerIds.data();
+    size_t rows = balances.size();
+    int64_t total = 0;
+    for (size_t i = 0; i < rows; ++i) {
+        total += owner[i] == ownerId ? balance[i] : 0;
+    }
+    return Money::fromCents(total);
+}
+
+size_t AccountColumns::countBelow(Money threshold) const {
+    const int64_t* balance = balances.data();
+    size_t rows = balances.size();
+    int64_t limit = threshold.minorUnits();
+    size_t count = 0;
+    for (size_t i = 0; i < rows; ++i) {
+        count += balance[i] < limit;
+    }
+    return count;
+}
+
+// Fills rows with the row index of every account below threshold. Matches are counted first to
+// size rows exactly; every index is then written and only kept when it matches, so the loop
+// never branches on the data.
+size_t AccountColumns::selectBelow(Money threshold, vector<uint32_t>& rows) const {
+    const int64_t* balance = balances.data();
+    size_t count = balances.size();
+    int64_t limit = threshold.minorUnits();
+    rows.resize(countBelow(threshold) + 1);
+    uint32_t* out = rows.data();
+    size_t found = 0;
+    for (size_t i = 0; i < count; ++i) {
+        out[found] = (uint32_t)i;
+        found += balance[i] < limit;
+    }
+    rows.pop_back();
+    return found;
+}
+
+// ConcurrentTransferEngine class member functions
+ConcurrentTransferEngine::ConcurrentTransferEngine(BankSystem& bankSystem) : bankSystem(bankSystem) {
+    accountLocks.reset(new mutex[bankSystem.accountIndex.size()]);
+    versionChains.reset(new atomic<BalanceVersion*>[bankSystem.accountIndex.size()]);
+    slots.reserve(bankSystem.accountIndex.size());
+    lockOrder.reserve(bankSystem.accountIndex.size());
+    int next = 0;
+    for (auto& entry : bankSystem.accountIndex) {
+        BankAccount* account = bankSystem.findAccount(entry.first);
+        versionChains[next].store(new BalanceVersion{account->getBalance(), 0, BalanceVersion::Pending, nullptr});
+        slots[entry.first] = {account, &accountLocks[next], &versionChains[next]};
+        ++next;
+        lockOrder.push_back(entry.first);
+    }
+    sort(lockOrder.begin(), lockOrder.end());
+    expectedTotal = totalBalance();
+    bankSystem.heldByEngine = true;
+}
+
+ConcurrentTransferEngine::~ConcurrentTransferEngine() {
+    bankSystem.heldByEngine = false;
+    for (size_t i = 0; i < slots.size(); ++i) {
+        BalanceVersion* version = versionChains[i].load();
+        while (version) {
+            BalanceVersion* older = version->older.load();
+            delete version;
+            version = older;
+        }
+    }
+}
+
+OpStatus ConcurrentTransferEngine::transfer(int fromAccountId, int toAccountId, Money amount) {
+    BANK_METRIC_SCOPE(Metric::Transfer);
+    auto from = slots.find(fromAccountId);
+    auto to = slots.find(toAccountId);
+    if (from == slots.end() || to == slots.end()) {
+        return OpStatus::AccountNotFound;
+    }
+
+    // Always lock the lower account number first so two opposite transfers cannot deadlock
+    mutex* first = fromAccountId < toAccountId ? from->second.lock : to->second.lock;
+    mutex* second = fromAccountId < toAccountId ? to->second.lock : from->second.lock;
+    unique_lock<mutex> firstGuard(*first);
+    unique_lock<mutex> secondGuard;
+    if (second != first) {
+        secondGuard = unique_lock<mutex>(*second);
+    }
+
+    OpStatus status = to->second.account->getBalance().canAdd(amount) ? from->second.account->withdraw(amount)
+                                                                        : OpStatus::InvalidAmount;
+    if (status == OpStatus::Success) {
+        to->second.account->deposit(amount);
+        // The new versions go up before the ledger slot is claimed and are stamped with it
+        // after, so a snapshot whose ledger includes this entry finds both balances
+        uint64_t epoch = EpochManager::global().current();
+        BalanceVersion* fromVersion = pushVersion(from->second, epoch);
+        BalanceVersion* toVersion = fromAccountId == toAccountId ? fromVersion : pushVersion(to->second, epoch);
+        size_t index = bankSystem.transactions.claim();
+        epoch = EpochManager::global().current();
+        fromVersion->commitStamp.store(index + 1, memory_order_release);
+        toVersion->commitStamp.store(index + 1, memory_order_release);
+        for (BalanceVersion* version : {fromVersion, toVersion}) {
+            if (BalanceVersion* older = version->older.load(memory_order_relaxed)) {
+                older->replacedEpoch = epoch;
+            }
+        }
+        Transaction& entry = bankSystem.transactions.emplace(index, amount);
+        bankSystem.logTransfer(entry.getTransactionId(), fromAccountId, toAccountId, amount);
+        // Writers move the epoch along; readers only ever hold it back
+        thread_local unsigned untilAdvance = 0;
+        if (untilAdvance-- == 0) {
+            untilAdvance = 63;
+            EpochManager::global().tryAdvance();
+        }
+    }
+    return status;
+}
+
+// Caller holds the account's lock. Reuses a reclaimed version when there is one, so a busy
+// account does not allocate.
+ConcurrentTransferEngine::BalanceVersion* ConcurrentTransferEngine::pushVersion(const Slot& slot, uint64_t epoch) {
+    BalanceVersion* newest = slot.versions->load(memory_order_relaxed);
+    BalanceVersion* version = reclaimVersions(slot, epoch);
+    if (version) {
+        version->balance = slot.account->getBalance();
+        version->commitStamp.store(BalanceVersion::Pending, memory_order_relaxed);
+        version->replacedEpoch = BalanceVersion::Pending;
+        version->older.store(newest, memory_order_relaxed);
+    } else {
+        version = new BalanceVersion{slot.account->getBalance(), BalanceVersion::Pending, BalanceVersion::Pending, newest};
+    }
+    slot.versions->store(version, memory_order_release);
+    return version;
+}
+
+// Unlinks the versions replaced at least two epochs before the given one, frees all but one and
+// returns that one for reuse (nullptr if there were none). Down the chain versions only get
+// older and were replaced earlier, so they come off as a tail. No snapshot still open can need
+// them, and none can reach them: each stops at the first version its ledger includes.
+// Caller holds the account's lock.
+ConcurrentTransferEngine::BalanceVersion* ConcurrentTransferEngine::reclaimVersions(const Slot& slot, uint64_t epoch) {
+    BalanceVersion* newer = slot.versions->load(memory_order_relaxed);
+    BalanceVersion* version = newer->older.load(memory_order_relaxed);
+    while (version && version->replacedEpoch + 2 > epoch) {
+        newer = version;
+        version = version->older.load(memory_order_relaxed);
+    }
+    if (version == nullptr) {
+        return nullptr;
+    }
+    newer->older.store(nullptr, memory_order_relaxed);
+    for (BalanceVersion* older = version->older.load(memory_order_relaxed); older;) {
+        BalanceVersion* next = older->older.load(memory_order_relaxed);
+        delete older;
+        older = next;
+    }
+    return version;
+}
+
+// Sums every balance while holding all account locks, taken in the same order as transfers
+Money ConcurrentTransferEngine::totalBalance() {
+    vector<unique_lock<mutex>> guards;
+    guards.reserve(lockOrder.size());
+    for (int accountNumber : lockOrder) {
+        guards.emplace_back(*slots[accountNumber].lock);
+    }
+    Money total;
+    for (int accountNumber : lockOrder) {
+        total += slots[accountNumber].account->getBalance();
+    }
+    return total;
+}
+
+// Money is only moved between accounts, so the total must never change
+bool ConcurrentTransferEngine::checkConservation() {
+    return totalBalance() == expectedTotal;
+}
+
+// Pins the epoch before reading the ledger size, so no version this snapshot needs can be freed
+ConcurrentTransferEngine::Snapshot::Snapshot(const ConcurrentTransferEngine& engine)
+    : engine(engine), ledgerEnd(engine.bankSystem.transactions.size()) {}
+
+OpStatus ConcurrentTransferEngine::Snapshot::getBalance(int accountNumber, Money& balance) const {
+    auto slot = engine.slots.find(accountNumber);
+    if (slot == engine.slots.end()) {
+        return OpStatus::AccountNotFound;
+    }
+    BalanceVersion* version = slot->second.versions->load(memory_order_acquire);
+    while (true) {
+        uint64_t stamp = version->commitStamp.load(memory_order_acquire);
+        if (stamp == BalanceVersion::Pending) {
+            this_thread::yield(); // its transfer is between claiming a ledger slot and stamping
+            continue;
+        }
+        if (stamp <= ledgerEnd) {
+            balance = version->balance;
+            return OpStatus::Success;
+        }
+        version = version->older.load(memory_order_acquire);
+    }
+}
+
+Money ConcurrentTransferEngine::Snapshot::totalBalance() const {
+    Money total;
+    for (int accountNumber : engine.lockOrder) {
+        Money balance;
+        getBalance(accountNumber, balance);
+        total += balance;
+    }
+    return total;
+}
+
+void ConcurrentTransferEngine::Snapshot::listAccounts(ostream& out) const {
+    for (int accountNumber : engine.lockOrder) {
+        Money balance;
+        getBalance(accountNumber, balance);
+        out << "Account " << accountNumber << ", Balance: $" << balance << endl;
+    }
+}
+
+void ConcurrentTransferEngine::Snapshot::listTransactions(ostream& out) const {
+    out << "Transactions list:" << endl;
+    engine.bankSystem.transactions.forEachBefore(ledgerEnd, [&](const Transaction& transaction) {
+        out << "Transaction ID: " << transaction.getTransactionId() << ", Amount: $" << transaction.getAmount() << endl;
+    });
+}
+
+// ShardedBank class member functions
+// Pins a thread to one CPU; a no-op where the platform has no affinity call
+void pinThread(thread& worker, unsigned cpu) {
+#ifdef _WIN32
+    SetThreadAffinityMask(worker.native_handle(), DWORD_PTR(1) << cpu);
+#elif defined(__linux__)
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+    pthread_setaffinity_np(worker.native_handle(), sizeof(cpus), &cpus);
+#else
+    (void)worker;
+    (void)cpu;
+#endif
+}
+
+ShardedBank::ShardedBank(BankSystem& bankSystem, unsigned shardCount) : bankSystem(bankSystem) {
+    shardCount = max(shardCount, 1u);
+    for (unsigned i = 0; i < shardCount; ++i) {
+        shards.push_back(make_unique<Shard>());
+    }
+    for (auto& entry : bankSystem.accountIndex) {
+        shards[shardOf(entry.first)]->accounts[entry.first] = bankSystem.findAccount(entry.first);
+    }
+    expectedTotal = totalBalance();
+    unsigned cpuCount = max(thread::hardware_concurrency(), 1u);
+    for (unsigned i = 0; i < shardCount; ++i) {
+        shards[i]->worker = thread(&ShardedBank::run, this, i);
+        pinThread(shards[i]->worker, i % cpuCount);
+    }
+}
+
+ShardedBank::~ShardedBank() {
+    for (const unique_ptr<Shard>& shard : shards) {
+        lock_guard<mutex> guard(shard->lock);
+        shard->stopping = true;
+        shard->wake.notify_one();
+    }
+    for (const unique_ptr<Shard>& shard : shards) {
+        shard->worker.join();
+    }
+}
+
+void ShardedBank::post(int shard, span<const Message> messages) {
+    Shard& target = *shards[shard];
+    bool wasEmpty;
+    {
+        lock_guard<mutex> guard(target.lock);
+        wasEmpty = target.inbox.empty();
+        target.inbox.insert(target.inbox.end(), messages.begin(), messages.end());
+    }
+    // A non-empty inbox means the worker has already been woken for it
+    if (wasEmpty) {
+        target.wake.notify_one();
+    }
+}
+
+// Worker loop: takes the whole inbox at once, handles it, then forwards the messages it produced
+// one post per target shard and reports finished requests one batch update at a time
+void ShardedBank::run(int shard) {
+    Shard& self = *shards[shard];
+    vector<Message> messages;
+    vector<vector<Message>> outgoing(shards.size());
+    vector<pair<Batch*, size_t>> completed;
+    while (true) {
+        {
+            unique_lock<mutex> guard(self.lock);
+            self.wake.wait(guard, [&self]() { return !self.inbox.empty() || self.stopping; });
+            if (self.inbox.empty()) {
+                return;
+            }
+            messages.swap(self.inbox);
+        }
+        for (const Message& message : messages) {
+            if (!handle(shard, message, outgoing)) {
+                continue;
+            }
+            if (completed.empty() || completed.back().first != message.batch) {
+                completed.emplace_back(message.batch, 0);
+            }
+            ++completed.back().second;
+        }
+        messages.clear();
+        for (size_t target = 0; target < outgoing.size(); ++target) {
+            if (!outgoing[target].empty()) {
+                post(target, outgoing[target]);
+                outgoing[target].clear();
+            }
+        }
+        for (auto& [batch, count] : completed) {
+            if (batch->remaining.fetch_sub(count, memory_order_acq_rel) == count) {
+                lock_guard<mutex> guard(batch->lock);
+                batch->finished = true;
+                batch->done.notify_one();
+            }
+        }
+        completed.clear();
+    }
+}
+
+// Applies one message on its shard's worker; true once the message's request has its result
+bool ShardedBank::handle(int shard, const Message& message, vector<vector<Message>>& outgoing) {
+    Shard& self = *shards[shard];
+    OpStatus& result = message.batch->results[message.slot];
+    switch (message.kind) {
+        case MessageKind::Transfer: {
+            auto from = self.accounts.find(message.fromAccountId);
+            if (from == self.accounts.end()) {
+                result = OpStatus::AccountNotFound;
+                return true;
+            }
+            int target = shardOf(message.toAccountId);
+            if (target == shard) {
+                auto to = self.accounts.find(message.toAccountId);
+                if (to == self.accounts.end()) {
+                    result = OpStatus::AccountNotFound;
+                    return true;
+                }
+                result = to->second->getBalance().canAdd(message.amount) ? from->second->withdraw(message.amount)
+                                                                         : OpStatus::InvalidAmount;
+                if (result == OpStatus::Success) {
+                    to->second->deposit(message.amount);
+                    int transactionId = bankSystem.transactions.append(message.amount).getTransactionId();
+                    bankSystem.logTransfer(transactionId, message.fromAccountId, message.toAccountId, message.amount);
+                    self.ledger.push_back({transactionId, message.fromAccountId, message.toAccountId, message.amount});
+                }
+                return true;
+            }
+            // Phase one: reserve the amount here, then ask the destination shard to take it
+            result = from->second->withdraw(message.amount);
+            if (result != OpStatus::Success) {
+                return true;
+            }
+            self.reserved += message.amount;
+            Message prepare = message;
+            prepare.kind = MessageKind::Prepare;
+            prepare.transactionId = Transaction::transactionIds.allocate();
+            outgoing[target].push_back(prepare);
+            return false;
+        }
+        case MessageKind::Prepare: {
+            auto to = self.accounts.find(message.toAccountId);
+            Message reply = message;
+            if (to == self.accounts.end() || !to->second->getBalance().canAdd(message.amount)) {
+                reply.kind = MessageKind::Abort;
+                reply.status = to == self.accounts.end() ? OpStatus::AccountNotFound : OpStatus::InvalidAmount;
+            } else {
+                // Logged before the credit, so anything this shard does with the money is logged after it
+                bankSystem.transactions.append(message.transactionId, message.amount);
+                bankSystem.logTransfer(message.transactionId, message.fromAccountId, message.toAccountId, message.amount);
+                to->second->deposit(message.amount);
+                self.ledger.push_back({message.transactionId, message.fromAccountId, message.toAccountId, message.amount});
+                reply.kind = MessageKind::Commit;
+            }
+            outgoing[shardOf(message.fromAccountId)].push_back(reply);
+            return false;
+        }
+        case MessageKind::Commit:
+            // Phase two: the destination has the money, so the reservation becomes a ledger entry
+            self.reserved -= message.amount;
+            self.ledger.push_back({message.transactionId, message.fromAccountId, message.toAccountId, message.amount});
+            result = OpStatus::Success;
+            return true;
+        case MessageKind::Abort:
+            self.reserved -= message.amount;
+            self.accounts[message.fromAccountId]->deposit(message.amount);
+            result = message.status;
+            return true;
+    }
+    return false;
+}
+
+OpStatus ShardedBank::performTransaction(int fromAccountId, int toAccountId, Money amount) {
+    TransferRequest request = {fromAccountId, toAccountId, amount};
+    return performTransactions(span<const TransferRequest>(&request, 1))[0];
+}
+
+// Routes every request to the shard that owns its source account and waits for all of them
+vector<OpStatus> ShardedBank::performTransactions(span<const TransferRequest> requests) {
+    if (bankSystem.heldByEngine) {
+        return vector<OpStatus>(requests.size(), OpStatus::HeldByEngine);
+    }
+    if (requests.empty()) {
+        return {};
+    }
+    Batch batch;
+    batch.results.resize(requests.size());
+    batch.remaining.store(requests.size(), memory_order_relaxed);
+    vector<vector<Message>> routed(shards.size());
+    for (size_t i = 0; i < requests.size(); ++i) {
+        const TransferRequest& request = requests[i];
+        routed[shardOf(request.fromAccountId)].push_back(
+            {MessageKind::Transfer, 0, request.fromAccountId, request.toAccountId, request.amount, &batch, i});
+    }
+    for (size_t shard = 0; shard < routed.size(); ++shard) {
+        if (!routed[shard].empty()) {
+            post(shard, routed[shard]);
+        }
+    }
+    unique_lock<mutex> guard(batch.lock);
+    batch.done.wait(guard, [&batch]() { return batch.finished; });
+    return move(batch.results);
+}
+
+// Ledger entries across all shards; a cross-shard transfer has one on each side.
+// Like totalBalance, only meaningful while no transfers are in flight.
+size_t ShardedBank::ledgerSize() {
+    size_t total = 0;
+    for (const unique_ptr<Shard>& shard : shards) {
+        total += shard->ledger.size();
+    }
+    return total;
+}
+
+Money ShardedBank::totalBalance() {
+    Money total;
+    for (const unique_ptr<Shard>& shard : shards) {
+        for (auto& entry : shard->accounts) {
+            total += entry.second->getBalance();
+        }
+        total += shard->reserved;
+    }
+    return total;
+}
+
+bool ShardedBank::checkConservation() {
+    return totalBalance() == expectedTotal;
+}
+
+// TransferScheduler class member functions
+TransferScheduler::TransferScheduler(BankSystem& bankSystem, chrono::microseconds window, size_t maxBatch)
+    : bankSystem(bankSystem), window(window), maxBatch(max<size_t>(maxBatch, 1)), stopping(false), batches(0) {
+    worker = thread(&TransferScheduler::run, this);
+}
+
+TransferScheduler::~TransferScheduler() {
+    {
+        lock_guard<mutex> guard(lock);
+        stopping = true;
+    }
+    arrived.notify_one();
+    worker.join();
+}
+
+future<OpStatus> TransferScheduler::submit(int fromAccountId, int toAccountId, Money amount) {
+    promise<OpStatus> result;
+    future<OpStatus> completion = result.get_future();
+    bool wake;
+    {
+        lock_guard<mutex> guard(lock);
+        queue.push_back({{fromAccountId, toAccountId, amount}, move(result), chrono::steady_clock::now()});
+        // The scheduler waits for the first transfer of a batch, then for the batch to fill
+        wake = queue.size() == 1 || queue.size() == maxBatch;
+    }
+    if (wake) {
+        arrived.notify_one();
+    }
+    return completion;
+}
+
+void TransferScheduler::run() {
+    vector<Pending> batch;
+    vector<TransferRequest> requests;
+    unique_lock<mutex> guard(lock);
+    while (true) {
+        arrived.wait(guard, [&]() { return stopping || !queue.empty(); });
+        if (queue.empty()) {
+            return;
+        }
+        arrived.wait_until(guard, queue.front().submittedAt + window,
+                           [&]() { return stopping || queue.size() >= maxBatch; });
+        size_t take = min(queue.size(), maxBatch);
+        batch.assign(make_move_iterator(queue.begin()), make_move_iterator(queue.begin() + take));
+        queue.erase(queue.begin(), queue.begin() + take);
+        guard.unlock();
+
+        requests.clear();
+        for (const Pending& pending : batch) {
+            requests.push_back(pending.request);
+        }
+        vector<OpStatus> results = bankSystem.performTransactions(requests);
+        bankSystem.sync();
+        for (size_t i = 0; i < batch.size(); ++i) {
+            batch[i].result.set_value(results[i]);
+        }
+        batch.clear();
+        batches.fetch_add(1, memory_order_relaxed);
+        guard.lock();
+    }
+}
+
+// Benchmarks
+// Every global operator new call, so the benchmarks can report allocation counts.
+// Kept out of line so GCC pairs each new with its delete instead of seeing raw malloc/free.
+atomic<size_t> heapAllocations(0);
+
+[[gnu::noinline]] void* operator new(size_t size) {
+    heapAllocations.fetch_add(1, memory_order_relaxed);
+    if (void* memory = malloc(size ? size : 1)) {
+        return memory;
+    }
+    throw bad_alloc();
+}
+
+[[gnu::noinline]] void operator delete(void* memory) noexcept {
+    free(memory);
+}
+
+[[gnu::noinline]] void operator delete(void* memory, size_t) noexcept {
+    free(memory);
+}
+
+class NullBuffer : public streambuf {
+protected:
+    int overflow(int c) override { return c; }
+    streamsize xsputn(const char*, streamsize count) override { return count; }
+};
+
+// Fills a bank with accountCount accounts of $1000.00, four per customer
+void loadBenchmarkBank(BankSystem& bankSystem, int accountCount, vector<int>& accountNumbers) {
+    const int accountsPerCustomer = 4;
+    accountNumbers.reserve(accountCount);
+
+    string name = "customer";
+    for (int i = 0; i < accountCount / accountsPerCustomer; ++i) {
+        bankSystem.addCustomer(name);
+        for (int j = 0; j < accountsPerCustomer; ++j) {
+            accountNumbers.push_back(bankSystem.addAccount(i + 1, Money::fromMajor(1000)));
+        }
+    }
+}
+
+// Streams a synthetic dataset straight to a file: four accounts per customer with random
+// balances, and one ledger entry per account. Returns the rows written, or 0 on failure.
+uint64_t generateDataset(const string& path, int accountCount, unsigned seed) {
+    const int accountsPerCustomer = 4;
+    DatasetWriter writer(path);
+    mt19937 rng(seed);
+    int customerCount = (accountCount + accountsPerCustomer - 1) / accountsPerCustomer;
+    for (int i = 1; i <= customerCount; ++i) {
+        writer.addCustomer(i, "customer " + to_string(i));
+    }
+    for (int i = 0; i < accountCount; ++i) {
+        writer.addAccount(i + 1, i / accountsPerCustomer + 1, Money::fromCents(rng() % 10000000));
+    }
+    for (int i = 0; i < accountCount; ++i) {
+        writer.addTransaction(i + 1, Money::fromCents(rng() % 100000 + 1));
+    }
+    uint64_t rows = writer.rowCount();
+    return writer.close() ? rows : 0;
+}
+
+void runTransferBenchmark() {
+    const int transferCount = 200000;
+    int accountCounts[] = {1000, 10000, 100000, 1000000};
+
+    cout << "Transfer benchmark (" << transferCount << " transfers per run)" << endl;
+    for (int accountCount : accountCounts) {
+        BankSystem bankSystem;
+        vector<int> accountNumbers;
+        loadBenchmarkBank(bankSystem, accountCount, accountNumbers);
+
+        mt19937 rng(42);
+        uniform_int_distribution<int> pick(0, accountNumbers.size() - 1);
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < transferCount; ++i) {
+            bankSystem.performTransaction(accountNumbers[pick(rng)], accountNumbers[pick(rng)], Money::fromMajor(1));
+        }
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+        cout << "Accounts: " << accountCount << ", Transfers/sec: " << (long long)(transferCount / elapsed.count()) << endl;
+    }
+}
+
+// Total and low-balance queries over the customer/account objects versus exported columns
+void runColumnScanBenchmark() {
+    const int accountCount = 1000000;
+    const Money lowBalance = Money::fromMajor(900);
+    BankSystem bankSystem;
+    vector<int> accountNumbers;
+    loadBenchmarkBank(bankSystem, accountCount, accountNumbers);
+    mt19937 rng(9);
+    uniform_int_distribution<int> pick(0, accountNumbers.size() - 1);
+    for (int i = 0; i < accountCount; ++i) {
+        bankSystem.performTransaction(accountNumbers[pick(rng)], accountNumbers[pick(rng)], Money::fromCents(rng() % 50000));
+    }
+
+    cout << "Column scan benchmark (" << accountCount << " accounts)" << endl;
+    auto start = chrono::steady_clock::now();
+    Money objectTotal;
+    size_t objectLow = 0;
+    for (int accountNumber : accountNumbers) {
+        Money balance;
+        bankSystem.getBalance(accountNumber, balance);
+        objectTotal += balance;
+        objectLow += balance < lowBalance;
+    }
+    chrono::duration<double> objectScan = chrono::steady_clock::now() - start;
+
+    start = chrono::steady_clock::now();
+    AccountColumns columns = bankSystem.exportColumns();
+    chrono::duration<double> exportTime = chrono::steady_clock::now() - start;
+    vector<uint32_t> rows;
+    start = chrono::steady_clock::now();
+    Money columnTotal = columns.totalBalance();
+    size_t columnLow = columns.countBelow(lowBalance);
+    columns.selectBelow(lowBalance, rows);
+    chrono::duration<double> columnScan = chrono::steady_clock::now() - start;
+
+    cout << "Lookup per account: " << objectScan.count() * 1000 << " ms" << endl;
+    cout << "Export: " << exportTime.count() * 1000 << " ms, column queries: " << columnScan.count() * 1000 << " ms, results "
+         << (objectTotal == columnTotal && objectLow == columnLow && rows.size() == columnLow ? "match" : "DIFFER") << endl;
+}
+
+void runBatchBenchmark() {
+    const int accountCount = 1000000;
+    const int transferCount = 500000;
+
+    mt19937 rng(7);
+    vector<TransferRequest> requests(transferCount);
+    BankSystem loopedBank, batchBank;
+    vector<int> loopedNumbers, batchNumbers;
+    loadBenchmarkBank(loopedBank, accountCount, loopedNumbers);
+    loadBenchmarkBank(batchBank, accountCount, batchNumbers);
+
+    // Both banks get the same transfers, addressed by position in their account lists
+    uniform_int_distribution<int> pick(0, accountCount - 1);
+    vector<pair<int, int>> positions(transferCount);
+    for (int i = 0; i < transferCount; ++i) {
+        positions[i] = make_pair(pick(rng), pick(rng));
+        requests[i] = {batchNumbers[positions[i].first], batchNumbers[positions[i].second], Money::fromMajor(1)};
+    }
+
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < transferCount; ++i) {
+        loopedBank.performTransaction(loopedNumbers[positions[i].first], loopedNumbers[positions[i].second], Money::fromMajor(1));
+    }
+    chrono::duration<double> loopedElapsed = chrono::steady_clock::now() - start;
+
+    start = chrono::steady_clock::now();
+    vector<OpStatus> results = batchBank.performTransactions(requests);
+    chrono::duration<double> batchElapsed = chrono::steady_clock::now() - start;
+
+    cout << "Batch benchmark (" << transferCount << " transfers, " << accountCount << " accounts)" << endl;
+    cout << "Looped performTransaction, Transfers/sec: " << (long long)(transferCount / loopedElapsed.count()) << endl;
+    cout << "performTransactions batch, Transfers/sec: " << (long long)(transferCount / batchElapsed.count())
+         << " (" << count(results.begin(), results.end(), OpStatus::Success) << " succeeded)" << endl;
+}
+
+void runEventSinkBenchmark() {
+    const int accountCount = 100000;
+    const int transferCount = 500000;
+
+    // Console output goes to a discarding stream so only formatting cost is measured
+    NullBuffer nullBuffer;
+    ostream nullStream(&nullBuffer);
+    ConsoleSink consoleSink(nullStream);
+    BufferedBinarySink binarySink(nullStream);
+    NullSink nullSink;
+    pair<const char*, EventSink*> sinks[] = {{"Console sink", &consoleSink}, {"Binary sink", &binarySink}, {"Null sink", &nullSink}};
+
+    cout << "Event sink benchmark (" << transferCount << " transfers, " << accountCount << " accounts)" << endl;
+    for (auto& entry : sinks) {
+        BankSystem bankSystem;
+        vector<int> accountNumbers;
+        loadBenchmarkBank(bankSystem, accountCount, accountNumbers);
+        bankSystem.setEventSink(entry.second);
+
+        mt19937 rng(11);
+        uniform_int_distribution<int> pick(0, accountCount - 1);
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < transferCount; ++i) {
+            bankSystem.performTransaction(accountNumbers[pick(rng)], accountNumbers[pick(rng)], Money::fromMajor(1));
+        }
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+        cout << entry.first << ", Ops/sec: " << (long long)(transferCount / elapsed.count()) << endl;
+    }
+}
+
+// Runs transfersPerThread random transfers on each of threadCount threads; returns transfers/sec
+double runConcurrentTransfers(ConcurrentTransferEngine& engine, const vector<int>& accountNumbers, int threadCount, int transfersPerThread) {
+    vector<thread> workers;
+    auto start = chrono::steady_clock::now();
+    for (int t = 0; t < threadCount; ++t) {
+        workers.emplace_back([&, t]() {
+            mt19937 rng(100 + t);
+            uniform_int_distribution<int> pick(0, accountNumbers.size() - 1);
+            uniform_int_distribution<int> amount(1, 50);
+            for (int i = 0; i < transfersPerThread; ++i) {
+                engine.transfer(accountNumbers[pick(rng)], accountNumbers[pick(rng)], Money::fromMajor(amount(rng)));
+            }
+        });
+    }
+    for (thread& worker : workers) {
+        worker.join();
+    }
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    return threadCount * transfersPerThread / elapsed.count();
+}
+
+void runConcurrentBenchmark() {
+    const int transfersPerThread = 200000;
+    int maxThreads = max(4u, thread::hardware_concurrency());
+
+    // Low contention: transfers spread over a million accounts
+    BankSystem bankSystem;
+    vector<int> accountNumbers;
+    loadBenchmarkBank(bankSystem, 1000000, accountNumbers);
+    ConcurrentTransferEngine engine(bankSystem);
+    cout << "Concurrent transfer benchmark (" << transfersPerThread << " transfers per thread, 1000000 accounts)" << endl;
+    for (int threadCount = 1; threadCount <= maxThreads; threadCount *= 2) {
+        double rate = runConcurrentTransfers(engine, accountNumbers, threadCount, transfersPerThread);
+        cout << "Threads: " << threadCount << ", Transfers/sec: " << (long long)rate << endl;
+    }
+    cout << "Money conserved: " << (engine.checkConservation() ? "yes" : "NO") << endl;
+
+    // Stress: every thread fights over eight accounts
+    BankSystem hotBank;
+    vector<int> hotAccounts;
+    loadBenchmarkBank(hotBank, 8, hotAccounts);
+    ConcurrentTransferEngine hotEngine(hotBank);
+    runConcurrentTransfers(hotEngine, hotAccounts, maxThreads * 2, transfersPerThread);
+    cout << "Stress test (" << maxThreads * 2 << " threads, 8 accounts), money conserved: "
+         << (hotEngine.checkConservation() ? "yes" : "NO") << endl;
+}
+
+// Writers transferring over 100000 accounts while a reporter thread sums every balance in a loop,
+// through snapshots and through the engine's stop-the-world total. In the snapshot run a further
+// snapshot is held open throughout and must still show the starting balances at the end.
+void runSnapshotBenchmark() {
+    const int writerCount = 3;
+    const int transfersPerWriter = 200000;
+    cout << "Snapshot benchmark (" << writerCount << " writers, " << transfersPerWriter
+         << " transfers each, 100000 accounts)" << endl;
+    BankSystem bankSystem;
+    vector<int> accountNumbers;
+    loadBenchmarkBank(bankSystem, 100000, accountNumbers);
+    ConcurrentTransferEngine engine(bankSystem);
+    Money expected = engine.totalBalance();
+
+    // mode 0: no reports, 1: snapshot reports, 2: locked reports
+    auto run = [&](int mode) {
+        atomic<int> writing(writerCount);
+        size_t reports = 0;
+        bool consistent = true;
+        thread reporter([&]() {
+            while (mode > 0 && writing.load() > 0) {
+                Money total = mode == 1 ? engine.snapshot().totalBalance() : engine.totalBalance();
+                consistent = consistent && total == expected;
+                ++reports;
+            }
+        });
+        vector<thread> writers;
+        auto start = chrono::steady_clock::now();
+        for (int w = 0; w < writerCount; ++w) {
+            writers.emplace_back([&, w]() {
+                mt19937 rng(400 + w + mode * writerCount);
+                uniform_int_distribution<int> pick(0, accountNumbers.size() - 1);
+                uniform_int_distribution<int> amount(1, 50);
+                for (int i = 0; i < transfersPerWriter; ++i) {
+                    engine.transfer(accountNumbers[pick(rng)], accountNumbers[pick(rng)], Money::fromMajor(amount(rng)));
+                }
+                --writing;
+            });
+        }
+        for (thread& writer : writers) {
+            writer.join();
+        }
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+        reporter.join();
+        const char* modeNames[] = {"No reports", "Snapshot reports", "Locked reports"};
+        cout << modeNames[mode] << ", Transfers/sec: " << (long long)(writerCount * transfersPerWriter / elapsed.count());
+        if (mode > 0) {
+            cout << ", reports: " << reports << ", all consistent: " << (consistent ? "yes" : "NO");
+        }
+    };
+
+    run(0);
+    cout << endl;
+    {
+        ConcurrentTransferEngine::Snapshot held = engine.snapshot();
+        vector<Money> before(accountNumbers.size());
+        for (size_t i = 0; i < accountNumbers.size(); ++i) {
+            held.getBalance(accountNumbers[i], before[i]);
+        }
+        size_t ledgerSize = held.ledgerSize();
+        run(1);
+        bool unchanged = held.ledgerSize() == ledgerSize && held.totalBalance() == expected;
+        for (size_t i = 0; i < accountNumbers.size(); ++i) {
+            Money balance;
+            held.getBalance(accountNumbers[i], balance);
+            unchanged = unchanged && balance == before[i];
+        }
+        cout << ", held snapshot unchanged: " << (unchanged ? "yes" : "NO") << endl;
+    }
+    run(2);
+    cout << endl;
+}
+
+// Uniform transfers over a million accounts through ShardedBank, submitted in batches by two
+// client threads, for a growing shard count
+void runShardedBenchmark() {
+    const int batchSize = 4096;
+    const int batchesPerClient = 100;
+    const int clientCount = 2;
+    unsigned maxShards = max(4u, thread::hardware_concurrency());
+
+    BankSystem bankSystem;
+    vector<int> accountNumbers;
+    loadBenchmarkBank(bankSystem, 1000000, accountNumbers);
+    cout << "Sharded transfer benchmark (" << clientCount * batchesPerClient * batchSize << " transfers, batches of "
+         << batchSize << ", 1000000 accounts)" << endl;
+    for (unsigned shardCount = 1; shardCount <= maxShards; shardCount *= 2) {
+        ShardedBank sharded(bankSystem, shardCount);
+        atomic<size_t> crossShard{0};
+        vector<thread> clients;
+        auto start = chrono::steady_clock::now();
+        for (int c = 0; c < clientCount; ++c) {
+            clients.emplace_back([&, c]() {
+                mt19937 rng(200 + c);
+                uniform_int_distribution<int> pick(0, accountNumbers.size() - 1);
+                uniform_int_distribution<int> amount(1, 50);
+                vector<TransferRequest> batch(batchSize);
+                size_t cross = 0;
+                for (int b = 0; b < batchesPerClient; ++b) {
+                    for (TransferRequest& request : batch) {
+                        request = {accountNumbers[pick(rng)], accountNumbers[pick(rng)], Money::fromMajor(amount(rng))};
+                        cross += (unsigned)request.fromAccountId % shardCount != (unsigned)request.toAccountId % shardCount;
+                    }
+                    sharded.performTransactions(batch);
+                }
+                crossShard += cross;
+            });
+        }
+        for (thread& client : clients) {
+            client.join();
+        }
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+        double total = (double)clientCount * batchesPerClient * batchSize;
+        cout << "Shards: " << shardCount << ", Transfers/sec: " << (long long)(total / elapsed.count()) << ", cross-shard: "
+             << (int)(crossShard * 100 / total) << "%, money conserved: " << (sharded.checkConservation() ? "yes" : "NO")
+             << endl;
+    }
+}
+
+// Durable transfers from four client threads, each keeping 64 transfers in flight, applied one at a
+// time with a log sync each, then through TransferScheduler as its window grows. Latency is from
+// submit() until the future is ready.
+void runGroupCommitBenchmark() {
+    const int clientCount = 4;
+    const int inFlight = 64;
+    const int transfersPerClient = 5000;
+    const size_t maxBatch = 4096;
+    string basePath = (filesystem::temp_directory_path() / "bank_system_group").string();
+    cout << "Group commit benchmark (" << clientCount << " clients, " << inFlight << " in flight each, "
+         << clientCount * transfersPerClient << " durable transfers, 10000 accounts)" << endl;
+    for (int windowMicros : {-1, 0, 100, 500, 2000, 10000}) {
+        filesystem::remove(basePath + ".wal");
+        filesystem::remove(basePath + ".snap");
+        BankSystem bankSystem;
+        bankSystem.openStorage(basePath, maxBatch);
+        vector<int> accountNumbers;
+        loadBenchmarkBank(bankSystem, 10000, accountNumbers);
+        bankSystem.sync();
+
+        // A window of -1 means no scheduler: each transfer is applied and synced under one lock
+        mutex unbatched;
+        unique_ptr<TransferScheduler> scheduler;
+        if (windowMicros >= 0) {
+            scheduler = make_unique<TransferScheduler>(bankSystem, chrono::microseconds(windowMicros), maxBatch);
+        }
+        vector<vector<uint32_t>> latencies(clientCount);
+        vector<thread> clients;
+        auto start = chrono::steady_clock::now();
+        for (int c = 0; c < clientCount; ++c) {
+            clients.emplace_back([&, c]() {
+                mt19937 rng(300 + c);
+                uniform_int_distribution<int> pick(0, accountNumbers.size() - 1);
+                vector<uint32_t>& samples = latencies[c];
+                samples.reserve(transfersPerClient);
+                if (!scheduler) {
+                    for (int i = 0; i < transfersPerClient; ++i) {
+                        auto submitted = chrono::steady_clock::now();
+                        {
+                            lock_guard<mutex> guard(unbatched);
+                            bankSystem.performTransaction(accountNumbers[pick(rng)], accountNumbers[pick(rng)], Money::fromMajor(1));
+                            bankSystem.sync();
+                        }
+                        samples.push_back((uint32_t)chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - submitted).count());
+                    }
+                    return;
+                }
+                deque<pair<future<OpStatus>, chrono::steady_clock::time_point>> waiting;
+                for (int i = 0; i < transfersPerClient || !waiting.empty();) {
+                    if (i < transfersPerClient && waiting.size() < inFlight) {
+                        auto submitted = chrono::steady_clock::now();
+                        waiting.emplace_back(scheduler->submit(accountNumbers[pick(rng)], accountNumbers[pick(rng)], Money::fromMajor(1)),
+                                             submitted);
+                        ++i;
+                        continue;
+                    }
+                    waiting.front().first.get();
+                    samples.push_back((uint32_t)chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - waiting.front().second).count());
+                    waiting.pop_front();
+                }
+            });
+        }
+        for (thread& client : clients) {
+            client.join();
+        }
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+        uint64_t batchCount = scheduler ? scheduler->batchCount() : clientCount * transfersPerClient;
+        scheduler.reset();
+
+        vector<uint32_t> all;
+        for (const vector<uint32_t>& samples : latencies) {
+            all.insert(all.end(), samples.begin(), samples.end());
+        }
+        sort(all.begin(), all.end());
+        // Nearest-rank percentile
+        auto percentile = [&](double fraction) {
+            return all[(size_t)ceil(fraction * all.size()) - 1];
+        };
+        cout << (windowMicros < 0 ? string("Unbatched") : "Window " + to_string(windowMicros) + " us") << ", Transfers/sec: "
+             << (long long)(all.size() / elapsed.count()) << ", mean batch: " << all.size() / max<uint64_t>(batchCount, 1)
+             << ", latency p50 " << percentile(0.5) << " us, p99 " << percentile(0.99) << " us" << endl;
+    }
+    filesystem::remove(basePath + ".wal");
+    filesystem::remove(basePath + ".snap");
+}
+
+// Ids per second from IdService and from a single shared counter as threads are added, with a
+// check that no IdService id was handed out twice
+void runIdBenchmark() {
+    const int idsPerThread = 2000000;
+    int maxThreads = max(4u, thread::hardware_concurrency());
+    static IdService service;
+    atomic<int> shared(1);
+
+    cout << "Id benchmark (" << idsPerThread << " ids per thread, blocks of " << IdService::BlockSize << ")" << endl;
+    for (int threadCount = 1; threadCount <= maxThreads; threadCount *= 2) {
+        vector<vector<int>> issued(threadCount, vector<int>(idsPerThread));
+        vector<thread> workers;
+        auto start = chrono::steady_clock::now();
+        for (int t = 0; t < threadCount; ++t) {
+            workers.emplace_back([&, t]() {
+                for (int& id : issued[t]) {
+                    id = service.allocate();
+                }
+            });
+        }
+        for (thread& worker : workers) {
+            worker.join();
+        }
+        chrono::duration<double> serviceTime = chrono::steady_clock::now() - start;
+
+        workers.clear();
+        start = chrono::steady_clock::now();
+        for (int t = 0; t < threadCount; ++t) {
+            workers.emplace_back([&, t]() {
+                for (int& id : issued[t]) {
+                    atomic_signal_fence(memory_order_seq_cst);
+                    id = shared.fetch_add(1, memory_order_relaxed);
+                }
+            });
+        }
+        for (thread& worker : workers) {
+            worker.join();
+        }
+        chrono::duration<double> sharedTime = chrono::steady_clock::now() - start;
+
+        // The shared counter's ids were written over the service's; draw a fresh set to check
+        workers.clear();
+        for (int t = 0; t < threadCount; ++t) {
+            workers.emplace_back([&, t]() {
+                for (int& id : issued[t]) {
+                    id = service.allocate();
+                }
+            });
+        }
+        for (thread& worker : workers) {
+            worker.join();
+        }
+        vector<int> all;
+        all.reserve((size_t)threadCount * idsPerThread);
+        for (const vector<int>& ids : issued) {
+            all.insert(all.end(), ids.begin(), ids.end());
+        }
+        sort(all.begin(), all.end());
+        bool unique = adjacent_find(all.begin(), all.end()) == all.end();
+
+        double total = (double)threadCount * idsPerThread;
+        cout << "Threads: " << threadCount << ", IdService ids/sec: " << (long long)(total / serviceTime.count())
+             << ", shared counter ids/sec: " << (long long)(total / sharedTime.count()) << ", unique: " << (unique ? "yes" : "NO")
+             << endl;
+        shared = 1;
+    }
+}
+
+// Heap allocations made by steady-state deposits, withdrawals and transfers, in memory and with
+// the write-ahead log open. A warm-up pass first sizes every reused buffer, and the ledger is
+// reserved up front, since it grows with every transfer by design.
+void runAllocationBenchmark() {
+    const int accountCount = 1000;
+    const int operationCount = 100000;
+    string basePath = (filesystem::temp_directory_path() / "bank_system_alloc_bench").string();
+    cout << "Allocation check (" << operationCount << " deposits, withdrawals and transfers, " << accountCount
+         << " accounts)" << endl;
+    for (bool durable : {false, true}) {
+        filesystem::remove(basePath + ".wal");
+        filesystem::remove(basePath + ".snap");
+        BankSystem bankSystem;
+        if (durable) {
+            bankSystem.openStorage(basePath);
+            bankSystem.setCheckpointInterval(UINT64_MAX);
+        }
+        vector<int> accountNumbers;
+        loadBenchmarkBank(bankSystem, accountCount, accountNumbers);
+        bankSystem.reserveLedger(2 * operationCount);
+
+        size_t allocations = 0;
+        for (int pass = 0; pass < 2; ++pass) {
+            mt19937 rng(pass);
+            uniform_int_distribution<int> pick(0, accountCount - 1);
+            size_t before = heapAllocations.load(memory_order_relaxed);
+            for (int i = 0; i < operationCount; ++i) {
+                int accountNumber = accountNumbers[pick(rng)];
+                switch (i % 3) {
+                    case 0:
+                        bankSystem.deposit(accountNumber, Money::fromMajor(2));
+                        break;
+                    case 1:
+                        bankSystem.withdraw(accountNumber, Money::fromMajor(1));
+                        break;
+                    default:
+                        bankSystem.performTransaction(accountNumber, accountNumbers[pick(rng)], Money::fromMajor(1));
+                        break;
+                }
+            }
+            allocations = heapAllocations.load(memory_order_relaxed) - before;
+        }
+        cout << (durable ? "With write-ahead log" : "In memory") << ", heap allocations after warm-up: " << allocations
+             << endl;
+    }
+    filesystem::remove(basePath + ".wal");
+    filesystem::remove(basePath + ".snap");
+}
+
+// Bulk loading a columnar dataset against building the same bank through the menu operations
+void runBulkLoadBenchmark() {
+    const int accountCount = 1000000;
+    string path = (filesystem::temp_directory_path() / "bank_system_bench.bcol").string();
+    string copyPath = path + ".copy";
+
+    cout << "Bulk load benchmark (" << accountCount << " accounts)" << endl;
+    auto start = chrono::steady_clock::now();
+    uint64_t rows = generateDataset(path, accountCount, 13);
+    chrono::duration<double> writeTime = chrono::steady_clock::now() - start;
+
+    start = chrono::steady_clock::now();
+    BankSystem bankSystem;
+    uint64_t loaded = bankSystem.importDataset(DatasetReader(path));
+    chrono::duration<double> loadTime = chrono::steady_clock::now() - start;
+
+    start = chrono::steady_clock::now();
+    {
+        BankSystem typedBank;
+        vector<int> accountNumbers;
+        loadBenchmarkBank(typedBank, accountCount, accountNumbers);
+    }
+    chrono::duration<double> typedTime = chrono::steady_clock::now() - start;
+
+    // Export and reload: the copy must hold the same rows and balances
+    bankSystem.exportDataset(copyPath);
+    BankSystem copy;
+    uint64_t copied = copy.importDataset(DatasetReader(copyPath));
+    bool same = copied == loaded && filesystem::file_size(copyPath) == filesystem::file_size(path) &&
+                copy.exportColumns().totalBalance() == bankSystem.exportColumns().totalBalance();
+
+    cout << "Write: " << (long long)(rows / writeTime.count()) << " rows/sec, " << filesystem::file_size(path) / rows
+         << " bytes/row" << endl;
+    cout << "Load: " << loaded << " rows, " << (long long)(loaded / loadTime.count()) << " rows/sec ("
+         << (long long)(loadTime.count() * 1000) << " ms), account-by-account: " << (long long)(typedTime.count() * 1000)
+         << " ms, round trip " << (same ? "matches" : "DIFFERS") << endl;
+    filesystem::remove(path);
+    filesystem::remove(copyPath);
+}
+
+void runDurabilityBenchmark() {
+    const int accountCount = 1000000;
+    const int transferCount = 100000;
+    string basePath = (filesystem::temp_directory_path() / "bank_system_bench").string();
+    auto removeFiles = [&]() {
+        filesystem::remove(basePath + ".wal");
+        filesystem::remove(basePath + ".snap");
+    };
+
+    // Per-operation cost of logging transfers at different group-commit sizes
+    cout << "Durability benchmark (" << transferCount / 10 << " transfers, 10000 accounts)" << endl;
+    size_t groupSizes[] = {0, 1, 16, 256};
+    for (size_t groupSize : groupSizes) {
+        removeFiles();
+        BankSystem bankSystem;
+        if (groupSize > 0) {
+            bankSystem.openStorage(basePath, groupSize);
+        }
+        vector<int> accountNumbers;
+        loadBenchmarkBank(bankSystem, 10000, accountNumbers);
+        bankSystem.sync();
+
+        mt19937 rng(5);
+        uniform_int_distribution<int> pick(0, accountNumbers.size() - 1);
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < transferCount / 10; ++i) {
+            bankSystem.performTransaction(accountNumbers[pick(rng)], accountNumbers[pick(rng)], Money::fromMajor(1));
+        }
+        bankSystem.sync();
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+        cout << (groupSize == 0 ? string("No log") : "Group size " + to_string(groupSize))
+             << ", Transfers/sec: " << (long long)(transferCount / 10 / elapsed.count()) << endl;
+    }
+
+    // Startup: snapshot plus log tail, against replaying the whole history from the log
+    for (int useSnapshot = 1; useSnapshot >= 0; --useSnapshot) {
+        removeFiles();
+        {
+            BankSystem bankSystem;
+            bankSystem.openStorage(basePath, 4096);
+            bankSystem.setCheckpointInterval(UINT64_MAX);
+            vector<int> accountNumbers;
+            loadBenchmarkBank(bankSystem, accountCount, accountNumbers);
+            if (useSnapshot) {
+                bankSystem.checkpoint();
+            }
+            mt19937 rng(9);
+            uniform_int_distribution<int> pick(0, accountNumbers.size() - 1);
+            for (int i = 0; i < transferCount; ++i) {
+                bankSystem.performTransaction(accountNumbers[pick(rng)], accountNumbers[pick(rng)], Money::fromMajor(1));
+            }
+        }
+        auto start = chrono::steady_clock::now();
+        BankSystem restored;
+        restored.setCheckpointInterval(UINT64_MAX);
+        restored.openStorage(basePath);
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+        cout << (useSnapshot ? "Startup from snapshot + log tail" : "Startup from full log replay") << " ("
+             << restored.accountCount() << " accounts): " << (long long)(elapsed.count() * 1000) << " ms" << endl;
+    }
+    removeFiles();
+}
+
+// Synthetic workloads. A seeded generator picks accounts by Zipf-distributed popularity, so a
+// few hot accounts (merchants, payroll) see most of the traffic, and mixes reads with writes.
+// It is cheap enough per operation to drive the engine at full speed.
+
+// xoshiro256** seeded through splitmix64: small, fast, and the same sequence on every platform
+class WorkloadRandom {
+private:
+    uint64_t state[4];
+    static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+public:
+    explicit WorkloadRandom(uint64_t seed);
+    uint64_t next();
+    double nextDouble() { return (next() >> 11) * 0x1.0p-53; } // [0, 1)
+    uint32_t below(uint32_t bound) { return (uint32_t)(((next() >> 32) * bound) >> 32); }
+};
+
+// Draws ranks 1..n with P(k) proportional to 1/k^exponent, in constant time and memory, by
+// rejection-inversion (Hormann and Derflinger). An exponent of 0 is uniform.
+class ZipfSampler {
+private:
+    uint32_t n;
+    double exponent;
+    double hIntegralX1;
+    double hIntegralN;
+    double cutoff;
+    double h(double x) const { return exp(-exponent * log(x)); }
+    double hIntegral(double x) const;
+    double hIntegralInverse(double x) const;
+
+public:
+    ZipfSampler(uint32_t n, double exponent);
+    uint32_t sample(WorkloadRandom& random) const;
+};
+
+struct WorkloadConfig {
+    int accountCount = 100000;
+    int accountsPerCustomer = 4;
+    double skew = 0.99;      // Zipf exponent of account popularity
+    double readRatio = 0.5;  // share of operations that only read a balance
+    uint64_t seed = 1;
+};
+
+enum class WorkloadKind : uint8_t {
+    Read,
+    Deposit,
+    Withdraw,
+    Transfer
+};
+const int workloadKindCount = 4;
+
+struct WorkloadOp {
+    WorkloadKind kind;
+    int account;
+    int toAccount;
+    Money amount;
+};
+
+// Produces operations over a population of account numbers. Writes are 70% transfers and 15%
+// each deposits and withdrawals. Transfer sources are uniform and every other account pick,
+// including the transfer destination, follows the Zipf popularity. Popularity ranks are
+// shuffled over the population so the hot accounts are not simply the oldest ones.
+class WorkloadGenerator {
+private:
+    WorkloadConfig config;
+    WorkloadRandom random;
+    ZipfSampler zipf;
+    vector<int> accountsByRank;
+
+public:
+    WorkloadGenerator(const WorkloadConfig& config, vector<int> accountNumbers);
+    void fill(span<WorkloadOp> ops);
+    int hotAccount() { return accountsByRank[zipf.sample(random) - 1]; }
+    int anyAccount() { return accountsByRank[random.below((uint32_t)accountsByRank.size())]; }
+};
+
+struct WorkloadResult {
+    uint64_t counts[workloadKindCount] = {};
+    uint64_t succeeded = 0;
+    double seconds = 0;
+};
+
+WorkloadRandom::WorkloadRandom(uint64_t seed) {
+    for (uint64_t& word : state) {
+        uint64_t z = (seed += 0x9e3779b97f4a7c15ull);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        word = z ^ (z >> 31);
+    }
+}
+
+uint64_t WorkloadRandom::next() {
+    uint64_t result = rotl(state[1] * 5, 7) * 9;
+    uint64_t t = state[1] << 17;
+    state[2] ^= state[0];
+    state[3] ^= state[1];
+    state[1] ^= state[2];
+    state[0] ^= state[3];
+    state[2] ^= t;
+    state[3] = rotl(state[3], 45);
+    return result;
+}
+
+// log1p(x) / x and expm1(x) / x, with series near 0 where the division loses precision
+double zipfHelper1(double x) {
+    return fabs(x) > 1e-8 ? log1p(x) / x : 1 - x * (0.5 - x * (1.0 / 3 - 0.25 * x));
+}
+
+double zipfHelper2(double x) {
+    return fabs(x) > 1e-8 ? expm1(x) / x : 1 + x * 0.5 * (1 + x / 3 * (1 + 0.25 * x));
+}
+
+ZipfSampler::ZipfSampler(uint32_t n, double exponent) : n(max<uint32_t>(n, 1)), exponent(exponent) {
+    hIntegralX1 = hIntegral(1.5) - 1;
+    hIntegralN = hIntegral(this->n + 0.5);
+    cutoff = 2 - hIntegralInverse(hIntegral(2.5) - h(2));
+}
+
+double ZipfSampler::hIntegral(double x) const {
+    double logX = log(x);
+    return zipfHelper2((1 - exponent) * logX) * logX;
+}
+
+double ZipfSampler::hIntegralInverse(double x) const {
+    double t = max(x * (1 - exponent), -1.0);
+    return exp(zipfHelper1(t) * x);
+}
+
+uint32_t ZipfSampler::sample(WorkloadRandom& random) const {
+    while (true) {
+        double u = hIntegralN + random.nextDouble() * (hIntegralX1 - hIntegralN);
+        double x = hIntegralInverse(u);
+        uint32_t k = (uint32_t)clamp(x + 0.5, 1.0, (double)n);
+        // Most draws are accepted by the first test, which needs no further logarithms
+        if (k - x <= cutoff || u >= hIntegral(k + 0.5) - h(k)) {
+            return k;
+        }
+    }
+}
+
+WorkloadGenerator::WorkloadGenerator(const WorkloadConfig& config, vector<int> accountNumbers)
+    : config(config), random(config.seed), zipf((uint32_t)accountNumbers.size(), config.skew),
+      accountsByRank(move(accountNumbers)) {
+    for (size_t i = accountsByRank.size(); i > 1; --i) {
+        swap(accountsByRank[i - 1], accountsByRank[random.below((uint32_t)i)]);
+    }
+}
+
+void WorkloadGenerator::fill(span<WorkloadOp> ops) {
+    uint64_t readThreshold = (uint64_t)(config.readRatio * 1000);
+    for (WorkloadOp& op : ops) {
+        uint32_t roll = random.below(1000);
+        op.amount = Money::fromCents(random.below(10000) + 1);
+        if (roll < readThreshold) {
+            op.kind = WorkloadKind::Read;
+            op.account = hotAccount();
+        } else {
+            // Spread the write share 70/15/15 over transfers, deposits and withdrawals
+            uint32_t write = (uint32_t)((roll - readThreshold) * 100 / (1000 - readThreshold));
+            op.kind = write < 70 ? WorkloadKind::Transfer : write < 85 ? WorkloadKind::Deposit : WorkloadKind::Withdraw;
+            op.account = op.kind == WorkloadKind::Transfer ? anyAccount() : hotAccount();
+            op.toAccount = op.kind == WorkloadKind::Transfer ? hotAccount() : 0;
+        }
+    }
+}
+
+// Customers with config.accountsPerCustomer accounts each, balances between $100.00 and $5000.00
+vector<int> loadWorkloadPopulation(BankSystem& bankSystem, const WorkloadConfig& config) {
+    WorkloadRandom random(config.seed ^ 0x5bd1e995);
+    vector<int> accountNumbers;
+    accountNumbers.reserve(config.accountCount);
+    string name = "customer";
+    for (int i = 0; i < config.accountCount; ++i) {
+        if (i % config.accountsPerCustomer == 0) {
+            bankSystem.addCustomer(name);
+        }
+        int customerId = (int)bankSystem.customerCount();
+        accountNumbers.push_back(bankSystem.addAccount(customerId, Money::fromCents(10000 + random.below(490001))));
+    }
+    return accountNumbers;
+}
+
+// Generates and applies operations in batches, so the generator stays in cache between runs
+WorkloadResult runWorkload(BankSystem& bankSystem, WorkloadGenerator& generator, uint64_t operations) {
+    WorkloadResult result;
+    WorkloadOp batch[1024];
+    auto start = chrono::steady_clock::now();
+    for (uint64_t done = 0; done < operations;) {
+        span<WorkloadOp> ops(batch, (size_t)min<uint64_t>(size(batch), operations - done));
+        generator.fill(ops);
+        for (const WorkloadOp& op : ops) {
+            OpStatus status = OpStatus::Success;
+            Money balance;
+            switch (op.kind) {
+                case WorkloadKind::Read:
+                    status = bankSystem.getBalance(op.account, balance);
+                    break;
+                case WorkloadKind::Deposit:
+                    status = bankSystem.deposit(op.account, op.amount);
+                    break;
+                case WorkloadKind::Withdraw:
+                    status = bankSystem.withdraw(op.account, op.amount);
+                    break;
+                case WorkloadKind::Transfer:
+                    status = bankSystem.performTransaction(op.account, op.toAccount, op.amount);
+                    break;
+            }
+            ++result.counts[(int)op.kind];
+            result.succeeded += status == OpStatus::Success;
+        }
+        done += ops.size();
+    }
+    result.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+// Engine throughput as the access skew grows, and the generator's own rate
+void runWorkloadBenchmark() {
+    const uint64_t operationCount = 2000000;
+    WorkloadConfig config;
+    config.accountCount = 1000000;
+    BankSystem bankSystem;
+    vector<int> accountNumbers = loadWorkloadPopulation(bankSystem, config);
+
+    cout << "Workload benchmark (" << config.accountCount << " accounts, " << operationCount << " operations, "
+         << config.readRatio * 100 << "% reads)" << endl;
+    double skews[] = {0, 0.8, 0.99, 1.2};
+    for (double skew : skews) {
+        config.skew = skew;
+        WorkloadGenerator generator(config, accountNumbers);
+        ZipfSampler zipf(config.accountCount, skew);
+        WorkloadRandom random(config.seed);
+        size_t hot = 0;
+        for (int i = 0; i < 1000000; ++i) {
+            hot += zipf.sample(random) <= (uint32_t)config.accountCount / 100;
+        }
+
+        WorkloadOp batch[1024];
+        auto start = chrono::steady_clock::now();
+        for (uint64_t done = 0; done < operationCount; done += size(batch)) {
+            generator.fill(batch);
+        }
+        chrono::duration<double> generateTime = chrono::steady_clock::now() - start;
+        WorkloadResult result = runWorkload(bankSystem, generator, operationCount);
+        cout << "Skew " << skew << ": top 1% of accounts get " << hot / 100 / 100.0 << "% of picks, generator "
+             << (long long)(operationCount / generateTime.count()) << " ops/sec, engine + generator "
+             << (long long)(operationCount / result.seconds) << " ops/sec" << endl;
+    }
+}
+
+// Headless command driver. A script is a text file with one command per line; amounts are whole
+// cents, and blank lines and lines starting with # are skipped:
+//   C <name>                     add customer (IDs are handed out 1, 2, ...)
+//   A <customer id> <balance>    add account (numbers are handed out 1, 2, ...)
+//   D <account> <amount>         deposit
+//   W <account> <amount>         withdraw
+//   T <from> <to> <amount>       transfer
+enum class ScriptOp : uint8_t {
+    AddCustomer,
+    AddAccount,
+    Deposit,
+    Withdraw,
+    Transfer
+};
+const int scriptOpCount = 5;
+const char* scriptOpNames[scriptOpCount] = {"Add customer", "Add account", "Deposit", "Withdraw", "Transfer"};
+
+struct ScriptCommand {
+    ScriptOp op;
+    int account;      // customer ID for AddAccount, source account for Transfer
+    int toAccount;
+    Money amount;
+    string name;
+};
+
+// Latency of every replayed command, by operation
+class ReplayStats {
+private:
+    vector<uint32_t> samples[scriptOpCount]; // nanoseconds
+    double elapsed = 0;                       // seconds
+
+public:
+    void record(ScriptOp op, int64_t nanoseconds) { samples[(int)op].push_back((uint32_t)min<int64_t>(nanoseconds, UINT32_MAX)); }
+    void finish(double seconds) { elapsed = seconds; }
+    void print(ostream& out);
+};
+
+// Splits the next space-separated token off the front of line
+string_view nextToken(string_view& line) {
+    size_t start = line.find_first_not_of(' ');
+    line.remove_prefix(start == string_view::npos ? line.size() : start);
+    string_view token = line.substr(0, line.find(' '));
+    line.remove_prefix(token.size());
+    return token;
+}
+
+template <typename T>
+bool parseNumber(string_view token, T& value) {
+    auto [end, error] = from_chars(token.data(), token.data() + token.size(), value);
+    return error == errc() && end == token.data() + token.size() && !token.empty();
+}
+
+bool parseCommand(string_view line, ScriptCommand& command) {
+    string_view op = nextToken(line);
+    int64_t cents = 0;
+    bool ok = op.size() == 1;
+    switch (ok ? op[0] : 0) {
+        case 'C':
+            command.op = ScriptOp::AddCustomer;
+            command.name = string(line.substr(min(line.find_first_not_of(' '), line.size())));
+            return !command.name.empty();
+        case 'A':
+            command.op = ScriptOp::AddAccount;
+            ok = parseNumber(nextToken(line), command.account) && parseNumber(nextToken(line), cents);
+            break;
+        case 'D':
+        case 'W':
+            command.op = op[0] == 'D' ? ScriptOp::Deposit : ScriptOp::Withdraw;
+            ok = parseNumber(nextToken(line), command.account) && parseNumber(nextToken(line), cents);
+            break;
+        case 'T':
+            command.op = ScriptOp::Transfer;
+            ok = parseNumber(nextToken(line), command.account) && parseNumber(nextToken(line), command.toAccount) &&
+                 parseNumber(nextToken(line), cents);
+            break;
+        default:
+            return false;
+    }
+    command.amount = Money::fromCents(cents);
+    return ok && nextToken(line).empty();
+}
+
+// Parses a whole script up front, so replay timings do not include parsing. On a bad line,
+// returns false with its number in errorLine.
+bool loadScript(const string& path, vector<ScriptCommand>& commands, size_t& errorLine) {
+    ifstream in(path);
+    string line;
+    errorLine = 0;
+    if (!in) {
+        return false;
+    }
+    while (getline(in, line)) {
+        ++errorLine;
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (line.find_first_not_of(' ') == string::npos || line[line.find_first_not_of(' ')] == '#') {
+            continue;
+        }
+        commands.emplace_back();
+        if (!parseCommand(line, commands.back())) {
+            return false;
+        }
+    }
+    errorLine = 0;
+    return !in.bad();
+}
+
+// Runs every command against the bank, timing each one
+ReplayStats replayScript(BankSystem& bankSystem, const vector<ScriptCommand>& commands) {
+    ReplayStats stats;
+    auto start = chrono::steady_clock::now();
+    auto previous = start;
+    for (const ScriptCommand& command : commands) {
+        switch (command.op) {
+            case ScriptOp::AddCustomer: {
+                string name = command.name;
+                bankSystem.addCustomer(name);
+                break;
+            }
+            case ScriptOp::AddAccount:
+                bankSystem.addAccount(command.account, command.amount);
+                break;
+            case ScriptOp::Deposit:
+                bankSystem.deposit(command.account, command.amount);
+                break;
+            case ScriptOp::Withdraw:
+                bankSystem.withdraw(command.account, command.amount);
+                break;
+            case ScriptOp::Transfer:
+                bankSystem.performTransaction(command.account, command.toAccount, command.amount);
+                break;
+        }
+        auto now = chrono::steady_clock::now();
+        stats.record(command.op, chrono::duration_cast<chrono::nanoseconds>(now - previous).count());
+        previous = now;
+    }
+    bankSystem.sync();
+    stats.finish(chrono::duration<double>(chrono::steady_clock::now() - start).count());
+    return stats;
+}
+
+void ReplayStats::print(ostream& out) {
+    size_t total = 0;
+    for (const vector<uint32_t>& opSamples : samples) {
+        total += opSamples.size();
+    }
+    out << "Replayed " << total << " commands in " << (long long)(elapsed * 1000) << " ms ("
+        << (long long)(total / max(elapsed, 1e-9)) << " ops/sec)" << endl;
+    out << left << setw(14) << "Operation" << right << setw(10) << "Count" << setw(14) << "Ops/sec" << setw(10) << "p50 ns"
+        << setw(10) << "p99 ns" << setw(10) << "p999 ns" << endl;
+    for (int op = 0; op < scriptOpCount; ++op) {
+        vector<uint32_t>& opSamples = samples[op];
+        if (opSamples.empty()) {
+            continue;
+        }
+        sort(opSamples.begin(), opSamples.end());
+        uint64_t busy = 0;
+        for (uint32_t sample : opSamples) {
+            busy += sample;
+        }
+        // Nearest-rank percentile
+        auto percentile = [&](double fraction) {
+            return opSamples[(size_t)ceil(fraction * opSamples.size()) - 1];
+        };
+        out << left << setw(14) << scriptOpNames[op] << right << setw(10) << opSamples.size() << setw(14)
+            << (long long)(opSamples.size() * 1e9 / max<uint64_t>(busy, 1)) << setw(10) << percentile(0.5) << setw(10)
+            << percentile(0.99) << setw(10) << percentile(0.999) << endl;
+    }
+}
+
+// Writes a random script: four accounts per customer with $1000.00 each, then operationCount
+// deposits (20%), withdrawals (20%) and transfers (60%) between uniformly chosen accounts
+bool writeScript(const string& path, int accountCount, int operationCount, unsigned seed) {
+    const int accountsPerCustomer = 4;
+    ofstream out(path);
+    mt19937 rng(seed);
+    int customerCount = (accountCount + accountsPerCustomer - 1) / accountsPerCustomer;
+    for (int i = 1; i <= customerCount; ++i) {
+        out << "C customer " << i << '\n';
+    }
+    for (int i = 0; i < accountCount; ++i) {
+        out << "A " << i / accountsPerCustomer + 1 << " 100000\n";
+    }
+    uniform_int_distribution<int> pick(1, accountCount);
+    for (int i = 0; i < operationCount; ++i) {
+        unsigned kind = rng() % 10;
+        int64_t cents = rng() % 10000 + 1;
+        if (kind < 2) {
+            out << "D " << pick(rng) << ' ' << cents << '\n';
+        } else if (kind < 4) {
+            out << "W " << pick(rng) << ' ' << cents << '\n';
+        } else {
+            int from = pick(rng);
+            out << "T " << from << ' ' << pick(rng) << ' ' << cents << '\n';
+        }
+    }
+    return bool(out.flush());
+}
+
+// Network front end. Clients send binary requests over a Unix domain socket, or over TCP on
+// 127.0.0.1 when the address is a port number. A request frame is its length (u16, counting the
+// bytes after it), the operation (u8) and a tag (u32), then the operation's arguments:
+//   AddCustomer   name (the rest of the frame)
+//   AddAccount    customer id (i32), opening balance in cents (i64)
+//   Deposit       account (i32), amount in cents (i64)
+//   Withdraw      account (i32), amount in cents (i64)
+//   Transfer      from account (i32), to account (i32), amount in cents (i64)
+// Every request gets a 16-byte reply: its tag (u32), an OpStatus (u8), three zero bytes, then a
+// value (i64): the new customer id or account number, or the balance in cents after a deposit or
+// withdrawal. A connection may have any number of requests in flight, and replies come back in
+// request order. A malformed frame closes the connection.
+enum class RequestOp : uint8_t {
+    AddCustomer,
+    AddAccount,
+    Deposit,
+    Withdraw,
+    Transfer
+};
+
+struct Reply {
+    uint32_t tag;
+    OpStatus status;
+    uint8_t padding[3];
+    int64_t value;
+};
+static_assert(sizeof(Reply) == 16);
+
+// Appends one request frame with fixed-size arguments
+template <typename... Args>
+void putRequest(string& out, RequestOp op, uint32_t tag, const Args&... args) {
+    putField(out, (uint16_t)(sizeof(RequestOp) + sizeof(tag) + (sizeof(Args) + ... + 0)));
+    putField(out, op);
+    putField(out, tag);
+    (putField(out, args), ...);
+}
+
+#ifdef __linux__
+// Fills in the socket address for a Unix socket path, or for 127.0.0.1 when address is a port
+// number. Returns the address length, or 0 if the path does not fit.
+socklen_t socketAddress(const string& address, sockaddr_storage& storage) {
+    memset(&storage, 0, sizeof(storage));
+    uint16_t port;
+    if (parseNumber(string_view(address), port)) {
+        sockaddr_in& inet = reinterpret_cast<sockaddr_in&>(storage);
+        inet.sin_family = AF_INET;
+        inet.sin_port = htons(port);
+        inet.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        return sizeof(sockaddr_in);
+    }
+    sockaddr_un& local = reinterpret_cast<sockaddr_un&>(storage);
+    if (address.empty() || address.size() >= sizeof(local.sun_path)) {
+        return 0;
+    }
+    local.sun_family = AF_UNIX;
+    memcpy(local.sun_path, address.data(), address.size());
+    return sizeof(sockaddr_un);
+}
+
+// Serves the protocol above from one thread. epoll reports the connections with data; each round
+// reads everything they have sent and applies every complete request to the bank in arrival
+// order, handing each run of consecutive transfers to performTransactions as one batch. Then it
+// writes the replies. With storage open, the round's log records are synced before any reply goes
+// out, so an acknowledged request is durable and one fsync covers the whole round.
+class BankServer {
+private:
+    struct Connection {
+        int fd;
+        string input;      // received, not yet applied
+        size_t parsed = 0; // bytes of input queued as requests this round
+        string output;     // replies not yet written
+        uint32_t events = EPOLLIN; // what epoll watches for
+        bool closing = false;      // closed once its output is written
+    };
+    struct Request {
+        Connection* connection = nullptr;
+        RequestOp op = RequestOp::AddCustomer;
+        uint32_t tag = 0;
+        int32_t first = 0;
+        int32_t second = 0;
+        Money amount;
+        string_view name; // points into the connection's input
+    };
+    BankSystem& bankSystem;
+    int listenFd;
+    int epollFd;
+    int wakeFd;
+    bool tcp;
+    string unixPath;
+    atomic<bool> stopping;
+    unordered_map<int, unique_ptr<Connection>> connections;
+    vector<Connection*> readable;
+    vector<Request> requests;
+    vector<TransferRequest> transfers;
+    void acceptAll();
+    void receive(Connection& connection);
+    void parse(Connection& connection);
+    void apply();
+    void reply(const Request& request, OpStatus status, int64_t value);
+    void flush(Connection& connection);
+    void close(Connection& connection);
+
+public:
+    BankServer(BankSystem& bankSystem);
+    ~BankServer();
+    bool listen(const string& address);
+    void run(); // until stop()
+    void stop();
+};
+
+// BankServer class member functions
+BankServer::BankServer(BankSystem& bankSystem)
+    : bankSystem(bankSystem), listenFd(-1), tcp(false), stopping(false) {
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = wakeFd;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &event);
+}
+
+BankServer::~BankServer() {
+    for (auto& [fd, connection] : connections) {
+        ::close(fd);
+    }
+    if (listenFd >= 0) {
+        ::close(listenFd);
+    }
+    if (!unixPath.empty()) {
+        unlink(unixPath.c_str());
+    }
+    ::close(wakeFd);
+    ::close(epollFd);
+}
+
+bool BankServer::listen(const string& address) {
+    sockaddr_storage storage;
+    socklen_t length = socketAddress(address, storage);
+    if (length == 0) {
+        return false;
+    }
+    tcp = storage.ss_family == AF_INET;
+    listenFd = socket(storage.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listenFd < 0) {
+        return false;
+    }
+    int on = 1;
+    if (tcp) {
+        setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    } else {
+        // Replaces a stale socket left by an earlier server, but never any other kind of file
+        struct stat existing;
+        if (lstat(address.c_str(), &existing) == 0 && S_ISSOCK(existing.st_mode)) {
+            unlink(address.c_str());
+        }
+    }
+    if (bind(listenFd, reinterpret_cast<sockaddr*>(&storage), length) != 0) {
+        return false;
+    }
+    if (!tcp) {
+        unixPath = address; // ours now, so the destructor removes it
+    }
+    if (::listen(listenFd, SOMAXCONN) != 0) {
+        return false;
+    }
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = listenFd;
+    return epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &event) == 0;
+}
+
+void BankServer::run() {
+    epoll_event events[64];
+    while (!stopping.load()) {
+        int ready = epoll_wait(epollFd, events, 64, -1);
+        if (ready < 0 && errno != EINTR) {
+            break;
+        }
+        readable.clear();
+        for (int i = 0; i < ready; ++i) {
+            int fd = events[i].data.fd;
+            if (fd == listenFd) {
+                acceptAll();
+                continue;
+            }
+            auto found = connections.find(fd);
+            if (found == connections.end()) {
+                continue; // the wake-up event
+            }
+            Connection& connection = *found->second;
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                receive(connection);
+                readable.push_back(&connection);
+            } else if (events[i].events & EPOLLOUT) {
+                flush(connection);
+                if (connection.closing && connection.output.empty()) {
+                    close(connection);
+                }
+            }
+        }
+        requests.clear();
+        for (Connection* connection : readable) {
+            parse(*connection);
+        }
+        apply();
+        if (!requests.empty()) {
+            bankSystem.sync();
+        }
+        for (Connection* connection : readable) {
+            connection->input.erase(0, connection->parsed);
+            connection->parsed = 0;
+            flush(*connection);
+            if (connection->closing && connection->output.empty()) {
+                close(*connection);
+            }
+        }
+    }
+}
+
+void BankServer::stop() {
+    stopping = true;
+    uint64_t one = 1;
+    if (write(wakeFd, &one, sizeof(one)) < 0) {
+        // The counter is already non-zero, so the loop wakes anyway
+    }
+}
+
+void BankServer::acceptAll() {
+    int fd;
+    while ((fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+        if (tcp) {
+            int on = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        }
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+        unique_ptr<Connection> connection = make_unique<Connection>();
+        connection->fd = fd;
+        connections.emplace(fd, move(connection));
+    }
+}
+
+// Reads until the socket is drained; end of stream or an error marks the connection for closing
+void BankServer::receive(Connection& connection) {
+    const size_t chunk = 64 * 1024;
+    while (true) {
+        size_t used = connection.input.size();
+        connection.input.resize(used + chunk);
+        ssize_t count = read(connection.fd, connection.input.data() + used, chunk);
+        connection.input.resize(used + max<ssize_t>(count, 0));
+        if (count > 0) {
+            continue;
+        }
+        if (count == 0 || (errno != EAGAIN && errno != EINTR)) {
+            connection.closing = true;
+        }
+        if (count == 0 || errno != EINTR) {
+            return;
+        }
+    }
+}
+
+// Queues every complete request in the connection's input
+void BankServer::parse(Connection& connection) {
+    const char* data = connection.input.data();
+    size_t size = connection.input.size();
+    size_t offset = 0;
+    while (size - offset >= sizeof(uint16_t)) {
+        const char* in = data + offset;
+        size_t length = getField<uint16_t>(in);
+        if (size - offset - sizeof(uint16_t) < length) {
+            break;
+        }
+        offset += sizeof(uint16_t) + length;
+        if (length < sizeof(RequestOp) + sizeof(uint32_t)) {
+            connection.closing = true;
+            break;
+        }
+        Request request;
+        request.connection = &connection;
+        request.op = getField<RequestOp>(in);
+        request.tag = getField<uint32_t>(in);
+        length -= sizeof(RequestOp) + sizeof(uint32_t);
+        bool valid = true;
+        switch (request.op) {
+            case RequestOp::AddCustomer:
+                request.name = string_view(in, length);
+                break;
+            case RequestOp::AddAccount:
+            case RequestOp::Deposit:
+            case RequestOp::Withdraw:
+                valid = length == sizeof(int32_t) + sizeof(int64_t);
+                if (valid) {
+                    request.first = getField<int32_t>(in);
+                    request.amount = Money::fromCents(getField<int64_t>(in));
+                }
+                break;
+            case RequestOp::Transfer:
+                valid = length == 2 * sizeof(int32_t) + sizeof(int64_t);
+                if (valid) {
+                    request.first = getField<int32_t>(in);
+                    request.second = getField<int32_t>(in);
+                    request.amount = Money::fromCents(getField<int64_t>(in));
+                }
+                break;
+            default:
+                valid = false;
+        }
+        if (!valid) {
+            connection.closing = true;
+            break;
+        }
+        requests.push_back(request);
+    }
+    connection.parsed = connection.closing ? size : offset;
+}
+
+void BankServer::apply() {
+    for (size_t i = 0; i < requests.size();) {
+        const Request& request = requests[i];
+        if (request.op == RequestOp::Transfer) {
+            size_t first = i;
+            transfers.clear();
+            for (; i < requests.size() && requests[i].op == RequestOp::Transfer; ++i) {
+                transfers.push_back({requests[i].first, requests[i].second, requests[i].amount});
+            }
+            vector<OpStatus> results = bankSystem.performTransactions(transfers);
+            for (size_t k = first; k < i; ++k) {
+                reply(requests[k], results[k - first], 0);
+            }
+            continue;
+        }
+        OpStatus status = OpStatus::Success;
+        Money balance;
+        switch (request.op) {
+            case RequestOp::AddCustomer:
+                reply(request, status, bankSystem.addCustomer(request.name));
+                break;
+            case RequestOp::AddAccount: {
+                int accountNumber = bankSystem.addAccount(request.first, request.amount);
+                reply(request, accountNumber < 0 ? OpStatus::CustomerNotFound : status, accountNumber);
+                break;
+            }
+            case RequestOp::Deposit:
+            case RequestOp::Withdraw:
+                status = request.op == RequestOp::Deposit ? bankSystem.deposit(request.first, request.amount)
+                                                          : bankSystem.withdraw(request.first, request.amount);
+                if (status == OpStatus::Success) {
+                    bankSystem.getBalance(request.first, balance);
+                }
+                reply(request, status, balance.minorUnits());
+                break;
+            default:
+                break;
+        }
+        ++i;
+    }
+}
+
+void BankServer::reply(const Request& request, OpStatus status, int64_t value) {
+    putField(request.connection->output, Reply{request.tag, status, {}, value});
+}
+
+// Writes as much pending output as the socket takes, and waits for EPOLLOUT while any is left
+void BankServer::flush(Connection& connection) {
+    size_t written = 0;
+    while (written < connection.output.size()) {
+        ssize_t count = send(connection.fd, connection.output.data() + written, connection.output.size() - written,
+                             MSG_NOSIGNAL);
+        if (count > 0) {
+            written += count;
+        } else if (errno == EAGAIN) {
+            break;
+        } else if (errno != EINTR) {
+            connection.closing = true;
+            connection.output.clear();
+            return;
+        }
+    }
+    connection.output.erase(0, written);
+    // A closing connection is no longer read, only drained
+    uint32_t events = connection.output.empty() ? EPOLLIN : connection.closing ? EPOLLOUT : EPOLLIN | EPOLLOUT;
+    if (events != connection.events) {
+        epoll_event event{};
+        event.events = events;
+        event.data.fd = connection.fd;
+        epoll_ctl(epollFd, EPOLL_CTL_MOD, connection.fd, &event);
+        connection.events = events;
+    }
+}
+
+void BankServer::close(Connection& connection) {
+    int fd = connection.fd;
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+    ::close(fd);
+    connections.erase(fd);
+}
+
+// Blocking connection to a BankServer, or -1
+int connectTo(const string& address) {
+    sockaddr_storage storage;
+    socklen_t length = socketAddress(address, storage);
+    int fd = length > 0 ? socket(storage.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0) : -1;
+    if (fd >= 0 && connect(fd, reinterpret_cast<sockaddr*>(&storage), length) != 0) {
+        ::close(fd);
+        return -1;
+    }
+    if (fd >= 0 && storage.ss_family == AF_INET) {
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    }
+    return fd;
+}
+
+bool sendAll(int fd, const string& data) {
+    size_t written = 0;
+    while (written < data.size()) {
+        ssize_t count = send(fd, data.data() + written, data.size() - written, MSG_NOSIGNAL);
+        if (count < 0 && errno != EINTR) {
+            return false;
+        }
+        written += max<ssize_t>(count, 0);
+    }
+    return true;
+}
+
+// Sends a batch of requests and reads back one reply for each
+bool exchange(int fd, const string& requests, size_t count, vector<Reply>& replies) {
+    replies.resize(count);
+    char* out = reinterpret_cast<char*>(replies.data());
+    size_t received = 0;
+    if (!sendAll(fd, requests)) {
+        return false;
+    }
+    while (received < count * sizeof(Reply)) {
+        ssize_t bytes = read(fd, out + received, count * sizeof(Reply) - received);
+        if (bytes <= 0 && (bytes == 0 || errno != EINTR)) {
+            return false;
+        }
+        received += max<ssize_t>(bytes, 0);
+    }
+    return true;
+}
+
+struct LoadResult {
+    bool ok = false;
+    double requestsPerSecond = 0;
+    double p50 = 0; // round-trip latency percentiles, in microseconds
+    double p99 = 0;
+    double p999 = 0;
+};
+
+// Load generator for a BankServer. One connection sets up a customer with accountCount accounts
+// of $1000.00. Then connectionCount threads each open a connection and send requestCount
+// deposits (20%), withdrawals (20%) and transfers (60%) between uniformly chosen accounts,
+// keeping depth requests in flight, and time every round trip.
+LoadResult runLoad(const string& address, int connectionCount, int requestCount, int depth, int accountCount) {
+    LoadResult result;
+    int fd = connectTo(address);
+    if (fd < 0) {
+        return result;
+    }
+    string frames;
+    const string name = "load generator";
+    putField(frames, (uint16_t)(sizeof(RequestOp) + sizeof(uint32_t) + name.size()));
+    putField(frames, RequestOp::AddCustomer);
+    putField(frames, (uint32_t)0);
+    frames += name;
+    vector<Reply> replies;
+    bool ok = exchange(fd, frames, 1, replies);
+    int32_t customerId = (int32_t)replies[0].value;
+    frames.clear();
+    for (int i = 0; i < accountCount; ++i) {
+        putRequest(frames, RequestOp::AddAccount, (uint32_t)i, customerId, (int64_t)100000);
+    }
+    ok = ok && exchange(fd, frames, accountCount, replies);
+    ::close(fd);
+    vector<int32_t> accountNumbers;
+    for (const Reply& reply : replies) {
+        accountNumbers.push_back((int32_t)reply.value);
+    }
+    if (!ok) {
+        return result;
+    }
+
+    vector<vector<uint32_t>> latencies(connectionCount);
+    atomic<bool> failed(false);
+    auto client = [&](int index) {
+        int fd = connectTo(address);
+        if (fd < 0) {
+            failed = true;
+            return;
+        }
+        WorkloadRandom random(index + 1);
+        vector<chrono::steady_clock::time_point> sentAt(depth);
+        vector<uint32_t>& samples = latencies[index];
+        samples.reserve(requestCount);
+        string out;
+        char in[64 * 1024];
+        size_t buffered = 0;
+        int sent = 0;
+        int received = 0;
+        auto sendNext = [&](chrono::steady_clock::time_point now) {
+            int32_t from = accountNumbers[random.below(accountCount)];
+            int64_t cents = random.below(10000) + 1;
+            unsigned kind = random.below(10);
+            if (kind < 2) {
+                putRequest(out, RequestOp::Deposit, (uint32_t)sent, from, cents);
+            } else if (kind < 4) {
+                putRequest(out, RequestOp::Withdraw, (uint32_t)sent, from, cents);
+            } else {
+                putRequest(out, RequestOp::Transfer, (uint32_t)sent, from, accountNumbers[random.below(accountCount)], cents);
+            }
+            sentAt[sent % depth] = now;
+            ++sent;
+        };
+        auto now = chrono::steady_clock::now();
+        while (sent < min(depth, requestCount)) {
+            sendNext(now);
+        }
+        bool ok = sendAll(fd, out);
+        while (ok && received < requestCount) {
+            ssize_t bytes = read(fd, in + buffered, sizeof(in) - buffered);
+            if (bytes <= 0) {
+                ok = bytes < 0 && errno == EINTR;
+                continue;
+            }
+            buffered += bytes;
+            now = chrono::steady_clock::now();
+            out.clear();
+            size_t offset = 0;
+            for (; buffered - offset >= sizeof(Reply); offset += sizeof(Reply)) {
+                Reply reply;
+                memcpy(&reply, in + offset, sizeof(reply));
+                samples.push_back((uint32_t)chrono::duration_cast<chrono::nanoseconds>(now - sentAt[reply.tag % depth]).count());
+                ++received;
+                if (sent < requestCount) {
+                    sendNext(now);
+                }
+            }
+            memmove(in, in + offset, buffered - offset);
+            buffered -= offset;
+            ok = out.empty() || sendAll(fd, out);
+        }
+        if (!ok) {
+            failed = true;
+        }
+        ::close(fd);
+    };
+    auto start = chrono::steady_clock::now();
+    vector<thread> clients;
+    for (int i = 0; i < connectionCount; ++i) {
+        clients.emplace_back(client, i);
+    }
+    for (thread& t : clients) {
+        t.join();
+    }
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    if (failed) {
+        return result;
+    }
+    vector<uint32_t> all;
+    for (const vector<uint32_t>& samples : latencies) {
+        all.insert(all.end(), samples.begin(), samples.end());
+    }
+    sort(all.begin(), all.end());
+    // Nearest-rank percentile
+    auto percentile = [&](double fraction) {
+        return all.empty() ? 0.0 : all[(size_t)ceil(fraction * all.size()) - 1] / 1000.0;
+    };
+    result.ok = true;
+    result.requestsPerSecond = all.size() / elapsed.count();
+    result.p50 = percentile(0.5);
+    result.p99 = percentile(0.99);
+    result.p999 = percentile(0.999);
+    return result;
+}
+
+void printLoadResult(ostream& out, const LoadResult& result) {
+    if (!result.ok) {
+        out << "failed: could not reach the server, or it closed a connection" << endl;
+        return;
+    }
+    out << fixed << setprecision(1) << (long long)result.requestsPerSecond << " requests/sec, latency p50 " << result.p50
+        << " us, p99 " << result.p99 << " us, p999 " << result.p999 << " us" << defaultfloat << endl;
+}
+
+// Throughput and tail latency through an in-process server on a Unix socket, as connections and
+// pipeline depth grow. Each run sets up its own accounts.
+void runServerBenchmark() {
+    const int accountCount = 10000;
+    const int requestCount = 100000;
+    string path = (filesystem::temp_directory_path() / "bank_system_bench.sock").string();
+    cout << "Server benchmark (" << accountCount << " accounts, " << requestCount << " requests per run)" << endl;
+    BankSystem bankSystem;
+    BankServer server(bankSystem);
+    if (!server.listen(path)) {
+        cout << "Could not listen on " << path << endl;
+        return;
+    }
+    thread serving([&] { server.run(); });
+    for (int connectionCount : {1, 4}) {
+        for (int depth : {1, 16, 128}) {
+            LoadResult result = runLoad(path, connectionCount, requestCount / connectionCount, depth, accountCount);
+            cout << "Connections " << connectionCount << ", depth " << setw(3) << depth << ": ";
+            printLoadResult(cout, result);
+        }
+    }
+    server.stop();
+    serving.join();
+}
+#endif
+
+// Cost of an empty probe, then a workload with the metrics it records
+void runMetricsBenchmark() {
+    const int probeCount = 10000000;
+    cout << "Metrics benchmark (" << (BANK_METRICS ? "probes on" : "probes compiled out") << ", 1 in "
+         << Metrics::SamplePeriod << " operations timed)" << endl;
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < probeCount; ++i) {
+        BANK_METRIC_SCOPE(Metric::Lookup);
+        atomic_signal_fence(memory_order_seq_cst);
+    }
+    chrono::duration<double, nano> elapsed = chrono::steady_clock::now() - start;
+    cout << "Empty probe: " << elapsed.count() / probeCount << " ns" << endl;
+
+    WorkloadConfig config;
+    config.accountCount = 100000;
+    BankSystem bankSystem;
+    vector<int> accountNumbers = loadWorkloadPopulation(bankSystem, config);
+    WorkloadGenerator generator(config, accountNumbers);
+    WorkloadResult result = runWorkload(bankSystem, generator, 2000000);
+    cout << "Workload: " << (long long)(2000000 / result.seconds) << " ops/sec" << endl;
+    Metrics::global().report(cout, false);
+}
+
+// A generated script replayed through the command driver
+void runReplayBenchmark() {
+    const int accountCount = 100000;
+    const int operationCount = 1000000;
+    string path = (filesystem::temp_directory_path() / "bank_system_bench.script").string();
+    writeScript(path, accountCount, operationCount, 21);
+    vector<ScriptCommand> commands;
+    size_t errorLine;
+    loadScript(path, commands, errorLine);
+    cout << "Replay benchmark (" << accountCount << " accounts, " << operationCount << " operations)" << endl;
+    BankSystem bankSystem;
+    replayScript(bankSystem, commands).print(cout);
+    filesystem::remove(path);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && string(argv[1]) == "--bench") {
+        runTransferBenchmark();
+        runBatchBenchmark();
+        runColumnScanBenchmark();
+        runEventSinkBenchmark();
+        runConcurrentBenchmark();
+        runSnapshotBenchmark();
+        runShardedBenchmark();
+        runGroupCommitBenchmark();
+        runIdBenchmark();
+        runAllocationBenchmark();
+        runDurabilityBenchmark();
+        runBulkLoadBenchmark();
+        runReplayBenchmark();
+        runWorkloadBenchmark();
+        runMetricsBenchmark();
+#ifdef __linux__
+        runServerBenchmark();
+#endif
+        return 0;
+    }
+    string command = argc > 2 ? argv[1] : "";
+    if (command == "--make-script" && argc > 4) {
+        return writeScript(argv[2], atoi(argv[3]), atoi(argv[4]), argc > 5 ? atoi(argv[5]) : 1) ? 0 : 1;
+    }
+    if (command == "--workload" && argc > 3) {
+        // --workload <accounts> <operations> [skew] [read ratio] [seed]
+        WorkloadConfig config;
+        config.accountCount = atoi(argv[2]);
+        config.skew = argc > 4 ? atof(argv[4]) : config.skew;
+        config.readRatio = argc > 5 ? atof(argv[5]) : config.readRatio;
+        config.seed = argc > 6 ? strtoull(argv[6], nullptr, 10) : config.seed;
+        // Written so a NaN fails too
+        if (!(config.accountCount >= 1 && config.skew >= 0 && config.readRatio >= 0 && config.readRatio <= 1)) {
+            cout << "Usage: --workload <accounts, at least 1> <operations> [skew, at least 0] [read ratio, 0 to 1] [seed]"
+                 << endl;
+            return 1;
+        }
+        BankSystem bankSystem;
+        WorkloadGenerator generator(config, loadWorkloadPopulation(bankSystem, config));
+        WorkloadResult result = runWorkload(bankSystem, generator, strtoull(argv[3], nullptr, 10));
+        const char* kindNames[workloadKindCount] = {"reads", "deposits", "withdrawals", "transfers"};
+        uint64_t total = 0;
+        for (int kind = 0; kind < workloadKindCount; ++kind) {
+            cout << result.counts[kind] << " " << kindNames[kind] << (kind + 1 < workloadKindCount ? ", " : "\n");
+            total += result.counts[kind];
+        }
+        cout << result.succeeded << " succeeded, " << (long long)(total / max(result.seconds, 1e-9)) << " ops/sec" << endl;
+        return 0;
+    }
+    if (command == "--replay") {
+        // Runs against an in-memory bank, or against the storage files at the optional base path
+        vector<ScriptCommand> commands;
+        size_t errorLine;
+        if (!loadScript(argv[2], commands, errorLine)) {
+            cout << "Could not read " << argv[2];
+            if (errorLine > 0) {
+                cout << ": bad command on line " << errorLine;
+            }
+            cout << endl;
+            return 1;
+        }
+        BankSystem bankSystem;
+        if (argc > 3 && !bankSystem.openStorage(argv[3])) {
+            cout << "Could not open " << argv[3] << ".wal" << endl;
+            return 1;
+        }
+        replayScript(bankSystem, commands).print(cout);
+        return 0;
+    }
+    if (command == "--serve" || (command == "--load" && argc > 4)) {
+#ifdef __linux__
+        if (command == "--load") {
+            // --load <socket path | port> <connections> <requests per connection> [depth] [accounts]
+            LoadResult result = runLoad(argv[2], atoi(argv[3]), atoi(argv[4]), argc > 5 ? max(atoi(argv[5]), 1) : 16,
+                                        argc > 6 ? max(atoi(argv[6]), 2) : 10000);
+            printLoadResult(cout, result);
+            return result.ok ? 0 : 1;
+        }
+        // --serve <socket path | port> [storage base path]; runs until the process is stopped
+        BankSystem bankSystem;
+        if (argc > 3 && !bankSystem.openStorage(argv[3])) {
+            cout << "Could not open " << argv[3] << ".wal" << endl;
+            return 1;
+        }
+        BankServer server(bankSystem);
+        if (!server.listen(argv[2])) {
+            cout << "Could not listen on " << argv[2] << endl;
+            return 1;
+        }
+        server.run();
+        return 0;
+#else
+        cout << "The network front end needs epoll and is only built on Linux." << endl;
+        return 1;
+#endif
+    }
+    if (command == "--generate" && argc > 3) {
+        auto start = chrono::steady_clock::now();
+        uint64_t rows = generateDataset(argv[2], atoi(argv[3]), 1);
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+        cout << "Wrote " << rows << " rows (" << (long long)(rows / elapsed.count()) << " rows/sec)" << endl;
+        return rows > 0 ? 0 : 1;
+    }
+    if (command == "--import" || command == "--export") {
+        BankSystem bankSystem;
+        bankSystem.openStorage("bank_system");
+        auto start = chrono::steady_clock::now();
+        uint64_t rows = 0;
+        if (command == "--export") {
+            rows = bankSystem.exportDataset(argv[2]);
+        } else if (bankSystem.customerCount() > 0) {
+            cout << "Import needs an empty bank; remove bank_system.snap and bank_system.wal first." << endl;
+            return 1;
+        } else {
+            DatasetReader dataset(argv[2]);
+            if (!dataset.isValid()) {
+                cout << argv[2] << " is not a valid dataset file." << endl;
+                return 1;
+            }
+            rows = bankSystem.importDataset(dataset);
+        }
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+        cout << (command == "--export" ? "Exported " : "Imported ") << rows << " rows ("
+             << (long long)(rows / elapsed.count()) << " rows/sec)" << endl;
+        return rows > 0 ? 0 : 1;
+    }
+
+    BankSystem bankSystem;
+    ConsoleSink consoleSink;
+    bankSystem.setEventSink(&consoleSink);
+    if (!bankSystem.openStorage("bank_system")) {
+        cout << "Warning: could not open bank_system.wal; changes will not be saved." << endl;
+    } else if (bankSystem.customerCount() > 0) {
+        cout << "Restored " << bankSystem.customerCount() << " customers and " << bankSystem.accountCount() << " accounts." << endl;
+    }
     int choice;
     int customerId;
 
@@ -233,7 +4615,7 @@ int main() {
                 break;
             }
             case 2: {
-                double initialBalance;
+                Money initialBalance;
                 cout << "Enter customer ID: ";
                 cin >> customerId;
                 cout << "Enter initial account balance: ";
@@ -252,7 +4634,7 @@ int main() {
             }
             case 5: {
                 int fromAccountId, toAccountId;
-                double amount;
+                Money amount;
                 cout << "Enter source account ID: ";
                 cin >> fromAccountId;
                 cout << "Enter destination account ID: ";
@@ -272,6 +4654,7 @@ int main() {
                 cout << "Invalid choice. Please try again." << endl;
         }
 
+        bankSystem.sync();
         cout << "-----------------------------------------" << endl;
 
     } while (choice != 7);
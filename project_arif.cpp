@@ -3,154 +3,1978 @@
 #include <string>
 #include<conio.h>
 #include<math.h>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <filesystem>
+#include <functional>
+#include <chrono>
+#include <stdexcept>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <random>
+#include <string_view>
+#include <unordered_set>
+#include <unordered_map>
+#include <cstdlib>
+#include <algorithm>
+#include <charconv>
+#include <iomanip>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <bit>
+#if defined(__x86_64__) || defined(_M_X64)
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#endif
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 //git purpose ,GIT GIT GIT GIT GIT
 using namespace std;
 
-class Account
+// An amount of money held as a whole number of cents, so sums and comparisons are exact.
+// Arithmetic is checked: a result that does not fit in 64 bits throws overflow_error, so account
+// operations test canAdd first and refuse the change instead.
+class Money
 {
-    friend class Bank;
-//git purpose ,GIT GIT GIT GIT GIT
-//Finally it works
-protected:
-    string name;
-    string accountNumber;
-    double balance;
+private:
+    int64_t cents;
+    constexpr explicit Money(int64_t cents) : cents(cents) {}
 
 public:
-    Account(string nam, string accNumber, double initialBalance)
-        : name(nam), accountNumber(accNumber), balance(initialBalance) {}
+    constexpr Money() : cents(0) {}
 
-    virtual void deposit(double amount)
+    static constexpr Money fromCents(int64_t cents)
     {
-        balance += amount;
+        return Money(cents);
+    }
+
+    static Money fromMajor(int64_t units)
+    {
+        return Money(units) * 100;
+    }
+
+    // Rounds to the nearest cent
+    static Money fromDouble(double value)
+    {
+        double scaled = value * 100.0;
+        if (!(scaled > -9.2e18 && scaled < 9.2e18))
+            throw overflow_error("money amount out of range");
+        return Money(llround(scaled));
+    }
+
+    int64_t minorUnits() const
+    {
+        return cents;
+    }
+
+    Money operator+(Money other) const
+    {
+        int64_t result;
+        if (__builtin_add_overflow(cents, other.cents, &result))
+            throw overflow_error("money overflow");
+        return Money(result);
+    }
+
+    bool canAdd(Money other) const
+    {
+        int64_t result;
+        return !__builtin_add_overflow(cents, other.cents, &result);
+    }
+
+    Money operator-(Money other) const
+    {
+        int64_t result;
+        if (__builtin_sub_overflow(cents, other.cents, &result))
+            throw overflow_error("money overflow");
+        return Money(result);
+    }
+
+    Money operator*(int64_t factor) const
+    {
+        int64_t result;
+        if (__builtin_mul_overflow(cents, factor, &result))
+            throw overflow_error("money overflow");
+        return Money(result);
+    }
+
+    Money &operator+=(Money other)
+    {
+        return *this = *this + other;
+    }
+
+    Money &operator-=(Money other)
+    {
+        return *this = *this - other;
+    }
+
+    auto operator<=>(const Money &) const = default;
+};
+
+ostream &operator<<(ostream &out, Money money)
+{
+    int64_t cents = money.minorUnits();
+    uint64_t magnitude = cents < 0 ? 0 - (uint64_t)cents : cents;
+    if (cents < 0)
+        out << '-';
+    out << magnitude / 100 << '.' << (char)('0' + magnitude % 100 / 10) << (char)('0' + magnitude % 10);
+    return out;
+}
+
+// Reads a decimal amount such as 12.5; fails the stream if it is out of range
+istream &operator>>(istream &in, Money &money)
+{
+    double value;
+    if (in >> value)
+    {
+        if (value > -9.2e16 && value < 9.2e16)
+            money = Money::fromDouble(value);
+        else
+            in.setstate(ios::failbit);
+    }
+    return in;
+}
+
+// Built-in latency metrics for the hot operations. On by default; build with -DBANK_METRICS=0
+// to compile every probe out. Set BANK_METRICS_REPORT to a file path (or "-" for stdout) to
+// get a report on exit, as JSON if the path ends in .json and as a text table otherwise.
+#ifndef BANK_METRICS
+#define BANK_METRICS 1
+#endif
+
+enum class Metric : uint8_t
+{
+    Lookup,
+    Deposit,
+    Withdraw,
+    Transfer
+};
+const int metricCount = 4;
+const char *metricNames[metricCount] = {"lookup", "deposit", "withdraw", "transfer"};
+
+// Log-linear histogram in the style of HdrHistogram: 16 linear sub-buckets per power of two,
+// so each bucket is within 1/16 of the values it holds. Written by one thread only, with
+// relaxed loads and stores instead of locked increments; any thread may read it meanwhile.
+class LatencyHistogram
+{
+public:
+    static constexpr int SubBuckets = 16;
+    static constexpr int BucketCount = SubBuckets * 61;
+
+private:
+    atomic<uint64_t> buckets[BucketCount] = {};
+    atomic<uint64_t> sum{0};
+
+public:
+    static int bucketOf(uint64_t value)
+    {
+        int shift = max((int)bit_width(value) - 5, 0);
+        return shift * SubBuckets + (int)(value >> shift);
+    }
+
+    static uint64_t bucketStart(int bucket)
+    {
+        int shift = max(bucket / SubBuckets - 1, 0);
+        return (uint64_t)(bucket - shift * SubBuckets) << shift;
+    }
+
+    void record(uint64_t value)
+    {
+        atomic<uint64_t> &bucket = buckets[bucketOf(value)];
+        bucket.store(bucket.load(memory_order_relaxed) + 1, memory_order_relaxed);
+        sum.store(sum.load(memory_order_relaxed) + value, memory_order_relaxed);
     }
 
-    virtual bool withdraw(double amount)
+    uint64_t countAt(int bucket) const { return buckets[bucket].load(memory_order_relaxed); }
+    uint64_t total() const { return sum.load(memory_order_relaxed); }
+};
+
+// Count of every operation; the times come from the sampled ones
+struct LatencySummary
+{
+    uint64_t count = 0;
+    double meanNs = 0;
+    double p50Ns = 0;
+    double p99Ns = 0;
+    double p999Ns = 0;
+    double maxNs = 0;
+};
+
+// Every thread records into its own shard, registered on its first operation; summaries merge
+// the shards. Every operation is counted, and one in SamplePeriod is timed, which keeps the
+// average probe to a few nanoseconds even where reading the clock is slow. Times come from
+// the CPU timestamp counter where there is one, converted to nanoseconds only when reported.
+class Metrics
+{
+public:
+    static constexpr uint32_t SamplePeriod = 16;
+
+private:
+    struct Shard
+    {
+        atomic<uint64_t> counts[metricCount] = {};
+        uint32_t untilSample[metricCount] = {};
+        LatencyHistogram histograms[metricCount];
+    };
+
+    mutex lock;
+    vector<unique_ptr<Shard>> shards;
+    uint64_t startTicks;
+    chrono::steady_clock::time_point startTime;
+    static inline thread_local Shard *localShard = nullptr;
+
+    Metrics() : startTicks(ticks()), startTime(chrono::steady_clock::now()) {}
+
+    ~Metrics()
     {
-        if (amount <= balance)
+        const char *path = getenv("BANK_METRICS_REPORT");
+        if (path == nullptr || *path == '\0')
+            return;
+        string target = path;
+        bool json = target.size() >= 5 && target.compare(target.size() - 5, 5, ".json") == 0;
+        if (target == "-")
+            report(cout, json);
+        else
         {
-            balance -= amount;
-            return true;
+            ofstream out(target);
+            report(out, json);
         }
-        return false;
     }
 
-    virtual void display() const
+    Shard *registerThread()
     {
-        cout << " Name: " << name;
-        cout << ", Number: " << accountNumber << ", Balance: " << balance << endl;
+        lock_guard<mutex> guard(lock);
+        shards.push_back(make_unique<Shard>());
+        localShard = shards.back().get();
+        return localShard;
+    }
+
+    // Timestamp-counter rate, measured against the steady clock over the life of the process
+    double nanosecondsPerTick()
+    {
+#if defined(__x86_64__) || defined(_M_X64)
+        chrono::duration<double, nano> elapsed = chrono::steady_clock::now() - startTime;
+        if (elapsed.count() < 1e7)
+        {
+            this_thread::sleep_for(chrono::milliseconds(10));
+            elapsed = chrono::steady_clock::now() - startTime;
+        }
+        return elapsed.count() / (double)max<uint64_t>(ticks() - startTicks, 1);
+#else
+        return 1;
+#endif
+    }
+
+public:
+    static Metrics &global()
+    {
+        static Metrics metrics;
+        return metrics;
+    }
+
+    static uint64_t ticks()
+    {
+#if defined(__x86_64__) || defined(_M_X64)
+        return __rdtsc();
+#else
+        return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    // Counts one operation; returns its start time if it is to be timed, otherwise 0
+    static uint64_t begin(Metric metric)
+    {
+        Shard *shard = localShard ? localShard : global().registerThread();
+        atomic<uint64_t> &count = shard->counts[(int)metric];
+        count.store(count.load(memory_order_relaxed) + 1, memory_order_relaxed);
+        if (shard->untilSample[(int)metric]-- != 0)
+            return 0;
+        shard->untilSample[(int)metric] = SamplePeriod - 1;
+        return ticks();
+    }
+
+    static void end(Metric metric, uint64_t start)
+    {
+        localShard->histograms[(int)metric].record(ticks() - start);
+    }
+
+    LatencySummary summary(Metric metric)
+    {
+        vector<uint64_t> counts(LatencyHistogram::BucketCount);
+        uint64_t total = 0;
+        LatencySummary result;
+        {
+            lock_guard<mutex> guard(lock);
+            for (const unique_ptr<Shard> &shard : shards)
+            {
+                const LatencyHistogram &histogram = shard->histograms[(int)metric];
+                for (int bucket = 0; bucket < LatencyHistogram::BucketCount; ++bucket)
+                    counts[bucket] += histogram.countAt(bucket);
+                total += histogram.total();
+                result.count += shard->counts[(int)metric].load(memory_order_relaxed);
+            }
+        }
+        uint64_t sampled = 0;
+        for (uint64_t count : counts)
+            sampled += count;
+        if (sampled == 0)
+            return result;
+        double scale = nanosecondsPerTick();
+        result.meanNs = total * scale / sampled;
+        // Each percentile is reported as the start of the bucket holding that rank
+        double *targets[] = {&result.p50Ns, &result.p99Ns, &result.p999Ns};
+        double fractions[] = {0.5, 0.99, 0.999};
+        uint64_t seen = 0;
+        int next = 0;
+        for (int bucket = 0; bucket < LatencyHistogram::BucketCount; ++bucket)
+        {
+            if (counts[bucket] == 0)
+                continue;
+            seen += counts[bucket];
+            while (next < 3 && seen >= (uint64_t)ceil(fractions[next] * sampled))
+                *targets[next++] = LatencyHistogram::bucketStart(bucket) * scale;
+            result.maxNs = LatencyHistogram::bucketStart(bucket) * scale;
+        }
+        return result;
+    }
+
+    void report(ostream &out, bool json)
+    {
+        if (json)
+            out << "{\"operations\": [";
+        else
+            out << left << setw(10) << "Operation" << right << setw(12) << "Count" << setw(10) << "Mean ns" << setw(10)
+                << "p50 ns" << setw(10) << "p99 ns" << setw(10) << "p999 ns" << setw(10) << "Max ns" << endl;
+        for (int metric = 0; metric < metricCount; ++metric)
+        {
+            LatencySummary summary = this->summary((Metric)metric);
+            if (json)
+                out << (metric ? ", " : "") << "{\"name\": \"" << metricNames[metric] << "\", \"count\": " << summary.count
+                    << ", \"mean_ns\": " << (uint64_t)summary.meanNs << ", \"p50_ns\": " << (uint64_t)summary.p50Ns
+                    << ", \"p99_ns\": " << (uint64_t)summary.p99Ns << ", \"p999_ns\": " << (uint64_t)summary.p999Ns
+                    << ", \"max_ns\": " << (uint64_t)summary.maxNs << "}";
+            else
+                out << left << setw(10) << metricNames[metric] << right << setw(12) << summary.count << setw(10)
+                    << (uint64_t)summary.meanNs << setw(10) << (uint64_t)summary.p50Ns << setw(10) << (uint64_t)summary.p99Ns
+                    << setw(10) << (uint64_t)summary.p999Ns << setw(10) << (uint64_t)summary.maxNs << endl;
+        }
+        if (json)
+            out << "]}" << endl;
     }
 };
 
-class RegularAccount : public Account
+// Times the enclosing block as one operation of the given kind
+class MetricScope
 {
+private:
+    Metric metric;
+    uint64_t start;
+
 public:
-    RegularAccount(const string &nam, const string &accNumber, double initialBalance)
-        : Account(nam, accNumber, initialBalance) {}
+    explicit MetricScope(Metric metric) : metric(metric), start(Metrics::begin(metric)) {}
 
-    void display() const override
+    ~MetricScope()
     {
-        cout << "Regular Account - ";
-        Account::display();
+        if (start != 0)
+            Metrics::end(metric, start);
     }
 };
 
-class SavingsAccount : public Account
+#if BANK_METRICS
+#define BANK_METRIC_SCOPE(metric) MetricScope metricScope(metric)
+#else
+#define BANK_METRIC_SCOPE(metric)
+#endif
+
+// Durable storage: every change is appended to a write-ahead log, and the whole bank is
+// periodically written to a snapshot so a restart only replays the log tail.
+// Log record layout: payload size (u32), checksum (u32), LSN (u64), payload.
+uint32_t checksum(const char *data, size_t size)
 {
-public:
-    SavingsAccount(const string &nam, const string &accNumber, double initialBalance)
-        : Account(nam, accNumber, initialBalance) {}
+    uint32_t hash = 2166136261u; // FNV-1a
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash = (hash ^ (unsigned char)data[i]) * 16777619u;
+    }
+    return hash;
+}
 
-    void display() const override
+void syncFile(FILE *file)
+{
+    fflush(file);
+#ifdef _WIN32
+    _commit(_fileno(file));
+#else
+    fsync(fileno(file));
+#endif
+}
+
+// Makes a rename or a new file in the directory holding path durable; Windows has no equivalent
+void syncDirectory(const string &path)
+{
+#ifndef _WIN32
+    string directory = filesystem::path(path).parent_path().string();
+    int fd = open(directory.empty() ? "." : directory.c_str(), O_RDONLY);
+    if (fd >= 0)
     {
-        cout << "Savings Account - ";
-        Account::display();
+        fsync(fd);
+        close(fd);
     }
+#endif
+}
+
+template <typename T>
+void putField(string &out, const T &value)
+{
+    out.append(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template <typename T>
+T getField(const char *&in)
+{
+    T value;
+    memcpy(&value, in, sizeof(T));
+    in += sizeof(T);
+    return value;
+}
+
+void putString(string &out, string_view value)
+{
+    putField(out, (uint32_t)value.size());
+    out += value;
+}
+
+string getString(const char *&in)
+{
+    uint32_t length = getField<uint32_t>(in);
+    string value(in, length);
+    in += length;
+    return value;
+}
+
+// Read-only view of a whole file, memory-mapped where the platform supports it
+class MappedFile
+{
+private:
+    const char *mappedData;
+    size_t mappedSize;
+    vector<char> fallback;
 
-    bool withdraw(double amount) override
+public:
+    MappedFile(const string &path) : mappedData(nullptr), mappedSize(0)
     {
-        // Allow withdrawal only if the remaining balance is at least 100
-        if (balance - amount >= 100)
+#ifdef _WIN32
+        ifstream in(path, ios::binary);
+        if (in)
         {
-            balance -= amount;
-            return true;
+            fallback.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+            mappedData = fallback.data();
+            mappedSize = fallback.size();
         }
-        return false;
+#else
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            return;
+        }
+        struct stat info;
+        if (fstat(fd, &info) == 0 && info.st_size > 0)
+        {
+            void *address = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (address != MAP_FAILED)
+            {
+                mappedData = static_cast<const char *>(address);
+                mappedSize = info.st_size;
+            }
+        }
+        close(fd);
+#endif
+    }
+
+    ~MappedFile()
+    {
+#ifndef _WIN32
+        if (mappedData)
+        {
+            munmap(const_cast<char *>(mappedData), mappedSize);
+        }
+#endif
     }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    const char *data() const { return mappedData; }
+    size_t size() const { return mappedSize; }
 };
 
-class Bank
+// Buffers records and makes each group durable with one fwrite + fsync (group commit)
+class WriteAheadLog
 {
 private:
-    vector<Account *> accounts;
+    string path;
+    FILE *file;
+    string pending;
+    size_t pendingRecords;
+    size_t groupSize;
+    uint64_t nextLsn;
 
 public:
-    ~Bank()
+    WriteAheadLog(const string &path, uint64_t nextLsn, size_t groupSize)
+        : path(path), pendingRecords(0), groupSize(groupSize ? groupSize : 1), nextLsn(nextLsn)
     {
-        for (Account *acc : accounts)
+        file = fopen(path.c_str(), "ab");
+    }
+
+    ~WriteAheadLog()
+    {
+        if (file)
         {
-            cout << acc->name << "'s has been deleted with id of " << acc->accountNumber << endl;
-            delete acc;
+            commit();
+            fclose(file);
         }
     }
 
-    void addAccount(Account *account)
+    bool isOpen() const { return file != nullptr; }
+    uint64_t lastLsn() const { return nextLsn - 1; }
+
+    uint64_t append(string_view payload)
     {
-        accounts.push_back(account);
+        uint64_t lsn = nextLsn++;
+        // Built in place in the pending buffer, which keeps its capacity between groups
+        putField(pending, (uint32_t)payload.size());
+        size_t checksumAt = pending.size();
+        putField(pending, (uint32_t)0);
+        putField(pending, lsn);
+        pending += payload;
+        uint32_t sum = checksum(pending.data() + checksumAt + 4, pending.size() - checksumAt - 4);
+        memcpy(&pending[checksumAt], &sum, sizeof(sum));
+        if (++pendingRecords >= groupSize)
+        {
+            commit();
+        }
+        return lsn;
     }
 
-    void displayAccounts() const
+    void commit()
     {
-        for (const Account *acc : accounts)
+        if (file && !pending.empty())
         {
-            acc->display();
+            fwrite(pending.data(), 1, pending.size(), file);
+            syncFile(file);
         }
+        pending.clear();
+        pendingRecords = 0;
     }
 
-    void deposit(const string &accNumber, double amount)
+    // Empties the log once a snapshot covers it; LSNs keep counting up
+    void reset()
     {
-        for (Account *acc : accounts)
+        commit();
+        if (file)
         {
-            if (acc->accountNumber == accNumber)
+            fclose(file);
+        }
+        file = fopen(path.c_str(), "wb");
+        if (file)
+        {
+            syncFile(file); // the truncation must be durable before records land after it
+        }
+    }
+
+    // Applies every intact record above afterLsn and cuts off a torn tail left by a crash.
+    // Returns the highest LSN seen.
+    static uint64_t replay(const string &path, uint64_t afterLsn, const function<void(const char *, size_t)> &apply)
+    {
+        uint64_t lastLsn = afterLsn;
+        size_t goodBytes = 0;
+        {
+            MappedFile log(path);
+            const char *cursor = log.data();
+            const char *end = log.data() + log.size();
+            while (end - cursor >= 16)
             {
-                acc->deposit(amount);
-                return;
+                const char *record = cursor;
+                uint32_t size = getField<uint32_t>(cursor);
+                uint32_t sum = getField<uint32_t>(cursor);
+                if ((size_t)(end - cursor) < 8 + (size_t)size || checksum(cursor, 8 + size) != sum)
+                {
+                    cursor = record;
+                    break;
+                }
+                uint64_t lsn = getField<uint64_t>(cursor);
+                if (lsn > afterLsn)
+                {
+                    apply(cursor, size);
+                    lastLsn = lsn;
+                }
+                cursor += size;
+            }
+            goodBytes = cursor - log.data();
+            if (goodBytes == log.size())
+            {
+                return lastLsn;
             }
         }
-        cout << "Account not found." << endl;
+        filesystem::resize_file(path, goodBytes);
+        return lastLsn;
     }
+};
+
+enum class LogRecordType : uint8_t
+{
+    AddAccount = 1,
+    Deposit,
+    Withdraw,
+    Transfer
+};
+
+const uint32_t snapshotMagic = 0x33534142; // "BAS3"
 
-    bool withdraw(const string &accNumber, double amount)
+// Owns objects of one type in fixed-size slabs: creating one is a pointer bump, addresses never
+// move, and clear() destroys everything slab by slab and frees each slab with a single delete.
+template <typename T, size_t SlabSize = 1024>
+class ObjectPool
+{
+private:
+    struct Slab
     {
-        for (Account *acc : accounts)
+        alignas(T) unsigned char storage[SlabSize * sizeof(T)];
+    };
+    vector<unique_ptr<Slab>> slabs;
+    size_t used = 0; // objects in the last slab
+
+public:
+    ObjectPool() = default;
+    ObjectPool(const ObjectPool &) = delete;
+    ObjectPool &operator=(const ObjectPool &) = delete;
+
+    ~ObjectPool()
+    {
+        clear();
+    }
+
+    template <typename... Args>
+    T *create(Args &&...args)
+    {
+        if (slabs.empty() || used == SlabSize)
+        {
+            slabs.emplace_back(new Slab);
+            used = 0;
+        }
+        T *object = new (slabs.back()->storage + used * sizeof(T)) T(forward<Args>(args)...);
+        ++used;
+        return object;
+    }
+
+    size_t size() const
+    {
+        return slabs.empty() ? 0 : (slabs.size() - 1) * SlabSize + used;
+    }
+
+    void clear()
+    {
+        if constexpr (!is_trivially_destructible_v<T>)
         {
-            if (acc->accountNumber == accNumber)
+            for (size_t i = 0; i < slabs.size(); ++i)
             {
-                return acc->withdraw(amount);
+                T *objects = reinterpret_cast<T *>(slabs[i]->storage);
+                size_t count = i + 1 == slabs.size() ? used : SlabSize;
+                for (size_t j = 0; j < count; ++j)
+                    objects[j].~T();
             }
         }
-        cout << "Account not found." << endl;
-        return false;
+        slabs.clear();
+        used = 0;
     }
 };
 
-int main()
+// An account number stored inline and zero-padded, so keys are copied, hashed and compared
+// without touching the heap
+class AccountKey
 {
-    Bank bank;
+public:
+    static constexpr size_t capacity = 23;
+
+private:
+    char text[capacity];
+    uint8_t length;
 
-    // Sample data
-    RegularAccount *acc1 = new RegularAccount("Arif", "1001", 5000);
-    SavingsAccount *acc2 = new SavingsAccount("Rohan", "2002", 7000);
-    SavingsAccount *acc3 = new SavingsAccount("Rian", "2003", 7000);
+public:
+    AccountKey() : text{}, length(0) {}
+
+    explicit AccountKey(string_view number) : text{}, length((uint8_t)number.size())
+    {
+        if (number.size() > capacity)
+            throw length_error("account number longer than " + to_string(capacity) + " characters");
+        memcpy(text, number.data(), number.size());
+    }
+
+    static bool fits(string_view number)
+    {
+        return number.size() <= capacity;
+    }
+
+    string_view view() const
+    {
+        return string_view(text, length);
+    }
+
+    bool operator==(const AccountKey &other) const
+    {
+        return memcmp(this, &other, sizeof(AccountKey)) == 0;
+    }
+};
+
+ostream &operator<<(ostream &out, const AccountKey &key)
+{
+    return out << key.view();
+}
+
+// Owner names, each stored once. Names are copied into fixed blocks that never move, so an
+// interned view stays valid for the life of the program.
+class NamePool
+{
+private:
+    static constexpr size_t blockSize = 64 * 1024;
+    vector<vector<char>> blocks;    // moving a block keeps its buffer, so views stay valid
+    vector<vector<char>> longNames; // names too big to share a block
+    size_t used = blockSize;              // bytes taken in the last block
+    unordered_set<string_view> names;
+
+public:
+    static NamePool &shared()
+    {
+        static NamePool pool;
+        return pool;
+    }
 
-    bank.addAccount(acc1);
-    bank.addAccount(acc2);
-    bank.addAccount(acc3);
+    string_view intern(string_view name)
+    {
+        if (name.empty()) // needs no storage, and there may be no block yet to point into
+            return string_view();
+        auto found = names.find(name);
+        if (found != names.end())
+            return *found;
+        char *copy;
+        if (name.size() > blockSize / 4)
+        {
+            copy = longNames.emplace_back(name.size()).data();
+        }
+        else
+        {
+            if (used + name.size() > blockSize)
+            {
+                blocks.emplace_back(blockSize);
+                used = 0;
+            }
+            copy = blocks.back().data() + used;
+            used += name.size();
+        }
+        memcpy(copy, name.data(), name.size());
+        return *names.insert(string_view(copy, name.size())).first;
+    }
+};
+
+class Account
+{
+    friend class Bank;
+//git purpose ,GIT GIT GIT GIT GIT
+//Finally it works
+protected:
+    string_view name; // interned in NamePool::shared()
+    AccountKey accountNumber;
+    Money balance;
+
+public:
+    Account(string_view nam, string_view accNumber, Money initialBalance)
+        : name(NamePool::shared().intern(nam)), accountNumber(accNumber), balance(initialBalance) {}
+
+    // False, leaving the balance alone, for a negative amount or one the balance cannot hold
+    virtual bool deposit(Money amount)
+    {
+        if (amount < Money() || !balance.canAdd(amount))
+            return false;
+        balance += amount;
+        return true;
+    }
+
+    virtual bool withdraw(Money amount)
+    {
+        if (amount >= Money() && amount <= balance)
+        {
+            balance -= amount;
+            return true;
+        }
+        return false;
+    }
+
+    virtual void display() const
+    {
+        cout << " Name: " << name;
+        cout << ", Number: " << accountNumber << ", Balance: " << balance << endl;
+    }
+
+    virtual bool isSavings() const
+    {
+        return false;
+    }
+
+    Money getBalance() const
+    {
+        return balance;
+    }
+
+    string_view getAccountNumber() const
+    {
+        return accountNumber.view();
+    }
+};
+
+class RegularAccount final : public Account
+{
+public:
+    RegularAccount(string_view nam, string_view accNumber, Money initialBalance)
+        : Account(nam, accNumber, initialBalance) {}
+
+    void display() const override
+    {
+        cout << "Regular Account - ";
+        Account::display();
+    }
+};
+
+class SavingsAccount final : public Account
+{
+public:
+    SavingsAccount(string_view nam, string_view accNumber, Money initialBalance)
+        : Account(nam, accNumber, initialBalance) {}
+
+    void display() const override
+    {
+        cout << "Savings Account - ";
+        Account::display();
+    }
+
+    bool isSavings() const override
+    {
+        return true;
+    }
+
+    bool withdraw(Money amount) override
+    {
+        // Allow withdrawal only if the remaining balance is at least 100
+        if (amount >= Money() && amount <= balance && balance - amount >= Money::fromMajor(100))
+        {
+            balance -= amount;
+            return true;
+        }
+        return false;
+    }
+};
+
+// Accounts stored by value, one contiguous vector per concrete type, instead of behind
+// Account pointers. Both classes are final, so every call in the bulk loops is bound
+// statically and each loop runs over a single account type.
+class AccountTable
+{
+private:
+    vector<RegularAccount> regular;
+    vector<SavingsAccount> savings;
+
+    template <typename Visit>
+    void forEach(Visit visit)
+    {
+        for (RegularAccount &acc : regular)
+            visit(acc);
+        for (SavingsAccount &acc : savings)
+            visit(acc);
+    }
+
+public:
+    size_t size() const
+    {
+        return regular.size() + savings.size();
+    }
+
+    void addRegular(string_view nam, string_view accNumber, Money initialBalance)
+    {
+        regular.emplace_back(nam, accNumber, initialBalance);
+    }
+
+    void addSavings(string_view nam, string_view accNumber, Money initialBalance)
+    {
+        savings.emplace_back(nam, accNumber, initialBalance);
+    }
+
+    void depositAll(Money amount)
+    {
+        forEach([amount](auto &acc) { acc.deposit(amount); });
+    }
+
+    // Returns how many accounts allowed the withdrawal
+    size_t withdrawAll(Money amount)
+    {
+        size_t done = 0;
+        forEach([amount, &done](auto &acc) { done += acc.withdraw(amount); });
+        return done;
+    }
+
+    Money totalBalance()
+    {
+        Money total;
+        forEach([&total](auto &acc) { total += acc.getBalance(); });
+        return total;
+    }
+
+    void display()
+    {
+        forEach([](auto &acc) { acc.display(); });
+    }
+};
+
+// Open-addressing hash map from account key to account: linear probing over one flat array
+// kept at most half full. Accounts are never removed, so there are no tombstones.
+class AccountIndex
+{
+private:
+    struct Entry
+    {
+        AccountKey key;
+        Account *account = nullptr;
+    };
+    vector<Entry> entries;
+    size_t count = 0;
+
+    static size_t hash(const AccountKey &key)
+    {
+        string_view text = key.view();
+        return checksum(text.data(), text.size());
+    }
+
+    void grow()
+    {
+        vector<Entry> old(max<size_t>(16, entries.size() * 2));
+        old.swap(entries);
+        count = 0;
+        for (const Entry &entry : old)
+        {
+            if (entry.account)
+                insert(entry.key, entry.account);
+        }
+    }
+
+public:
+    void reserve(size_t accounts)
+    {
+        while (entries.size() < accounts * 2)
+            grow();
+    }
+
+    size_t size() const
+    {
+        return count;
+    }
+
+    Account *find(const AccountKey &key) const
+    {
+        if (entries.empty())
+            return nullptr;
+        size_t mask = entries.size() - 1;
+        for (size_t i = hash(key) & mask;; i = (i + 1) & mask)
+        {
+            if (!entries[i].account)
+                return nullptr;
+            if (entries[i].key == key)
+                return entries[i].account;
+        }
+    }
+
+    // Keeps the first account if the key is already taken; returns whether this one was added
+    bool insert(const AccountKey &key, Account *account)
+    {
+        if ((count + 1) * 2 > entries.size())
+            grow();
+        size_t mask = entries.size() - 1;
+        for (size_t i = hash(key) & mask;; i = (i + 1) & mask)
+        {
+            if (!entries[i].account)
+            {
+                entries[i] = {key, account};
+                ++count;
+                return true;
+            }
+            if (entries[i].key == key)
+                return false;
+        }
+    }
+};
+
+class Bank
+{
+private:
+    ObjectPool<RegularAccount> regularAccounts;
+    ObjectPool<SavingsAccount> savingsAccounts;
+    vector<Account *> accounts; // points into the pools above
+    AccountIndex index;
+    WriteAheadLog *wal = nullptr;
+    string storagePath;
+    uint64_t checkpointLsn = 0;
+    uint64_t checkpointInterval = 100000;
+    string logRecord; // reused for every log record, so logging does not allocate once it has grown
+
+    Account *find(string_view accNumber)
+    {
+        BANK_METRIC_SCOPE(Metric::Lookup);
+        return AccountKey::fits(accNumber) ? index.find(AccountKey(accNumber)) : nullptr;
+    }
+
+    Account *restore(Account *account)
+    {
+        accounts.push_back(account);
+        index.insert(account->accountNumber, account);
+        return account;
+    }
+
+    void logChange(LogRecordType type, const Account *acc, Money amount, const Account *counterparty = nullptr)
+    {
+        if (wal)
+        {
+            string &record = logRecord;
+            record.clear();
+            putField(record, type);
+            putField(record, amount.minorUnits());
+            putString(record, acc->accountNumber.view());
+            if (type == LogRecordType::AddAccount)
+            {
+                putField(record, acc->isSavings());
+                putString(record, acc->name);
+            }
+            else if (type == LogRecordType::Transfer)
+            {
+                putString(record, counterparty->accountNumber.view());
+            }
+            wal->append(record);
+        }
+    }
+
+    Account *track(Account *account)
+    {
+        restore(account);
+        logChange(LogRecordType::AddAccount, account, account->balance);
+        return account;
+    }
+
+    // Re-applies one logged change during recovery, without logging it again
+    void applyLogRecord(const char *data, size_t)
+    {
+        LogRecordType type = getField<LogRecordType>(data);
+        Money amount = Money::fromCents(getField<int64_t>(data));
+        string accNumber = getString(data);
+        if (type == LogRecordType::AddAccount)
+        {
+            bool savings = getField<bool>(data);
+            string nam = getString(data);
+            if (savings)
+                restore(savingsAccounts.create(nam, accNumber, amount));
+            else
+                restore(regularAccounts.create(nam, accNumber, amount));
+            return;
+        }
+        Account *acc = find(accNumber);
+        if (acc && type == LogRecordType::Deposit)
+        {
+            acc->deposit(amount);
+        }
+        else if (acc && type == LogRecordType::Withdraw)
+        {
+            acc->withdraw(amount);
+        }
+        else if (acc && type == LogRecordType::Transfer)
+        {
+            Account *to = find(getString(data));
+            if (to && acc->withdraw(amount))
+                to->deposit(amount);
+        }
+    }
+
+    // Walks count snapshot accounts without restoring them; false if any of them runs past end
+    // or holds an account number too long for an AccountKey
+    static bool snapshotAccountsFit(const char *cursor, const char *end, uint32_t count)
+    {
+        auto takeString = [&](size_t limit)
+        {
+            if ((size_t)(end - cursor) < sizeof(uint32_t))
+                return false;
+            uint32_t length = getField<uint32_t>(cursor);
+            if (length > limit || length > (size_t)(end - cursor))
+                return false;
+            cursor += length;
+            return true;
+        };
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            if ((size_t)(end - cursor) < sizeof(bool) + sizeof(int64_t))
+                return false;
+            cursor += sizeof(bool) + sizeof(int64_t);
+            if (!takeString(AccountKey::capacity) || !takeString(SIZE_MAX))
+                return false;
+        }
+        return true;
+    }
+
+    // Snapshot: magic, LSN, account count, checksum of those header fields, then
+    // (savings flag, balance, number, name) per account
+    uint64_t loadSnapshot(const string &path)
+    {
+        const size_t headerSize = 16;
+        MappedFile snapshot(path);
+        if (snapshot.size() < headerSize + sizeof(uint32_t))
+        {
+            return 0;
+        }
+        const char *cursor = snapshot.data();
+        if (getField<uint32_t>(cursor) != snapshotMagic)
+        {
+            return 0;
+        }
+        uint64_t lsn = getField<uint64_t>(cursor);
+        uint32_t count = getField<uint32_t>(cursor);
+        // The whole file is checked before anything is restored, so a truncated or corrupt one is
+        // rejected as a whole and the log is replayed from the start instead
+        if (getField<uint32_t>(cursor) != checksum(snapshot.data(), headerSize) ||
+            !snapshotAccountsFit(cursor, snapshot.data() + snapshot.size(), count))
+        {
+            return 0;
+        }
+        accounts.reserve(count);
+        index.reserve(count);
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            bool savings = getField<bool>(cursor);
+            Money balance = Money::fromCents(getField<int64_t>(cursor));
+            string accNumber = getString(cursor);
+            string nam = getString(cursor);
+            if (savings)
+                restore(savingsAccounts.create(nam, accNumber, balance));
+            else
+                restore(regularAccounts.create(nam, accNumber, balance));
+        }
+        return lsn;
+    }
+
+    // Written to a temporary file and renamed into place, so a crash leaves the old snapshot intact
+    void writeSnapshot(const string &path, uint64_t lsn)
+    {
+        string data;
+        putField(data, snapshotMagic);
+        putField(data, lsn);
+        putField(data, (uint32_t)accounts.size());
+        putField(data, checksum(data.data(), data.size()));
+        for (const Account *acc : accounts)
+        {
+            putField(data, acc->isSavings());
+            putField(data, acc->balance.minorUnits());
+            putString(data, acc->accountNumber.view());
+            putString(data, acc->name);
+        }
+        string temporaryPath = path + ".tmp";
+        FILE *file = fopen(temporaryPath.c_str(), "wb");
+        if (file)
+        {
+            fwrite(data.data(), 1, data.size(), file);
+            syncFile(file);
+            fclose(file);
+            filesystem::rename(temporaryPath, path);
+            syncDirectory(path);
+        }
+    }
+
+public:
+    bool verboseTeardown = true;
+
+    ~Bank()
+    {
+        delete wal;
+        if (verboseTeardown)
+        {
+            for (Account *acc : accounts)
+                cout << acc->name << "'s has been deleted with id of " << acc->accountNumber << endl;
+        }
+        // The pools release every account in bulk when they are destroyed
+    }
+
+    // Restores <basePath>.snap plus the tail of <basePath>.wal and logs every change from here on.
+    // Call once, before any account is added.
+    bool openStorage(const string &basePath, size_t groupSize = 64)
+    {
+        storagePath = basePath;
+        checkpointLsn = loadSnapshot(basePath + ".snap");
+        uint64_t lastLsn = WriteAheadLog::replay(basePath + ".wal", checkpointLsn, [this](const char *data, size_t size)
+                                                 { applyLogRecord(data, size); });
+        wal = new WriteAheadLog(basePath + ".wal", lastLsn + 1, groupSize);
+        return wal->isOpen();
+    }
+
+    // Makes all logged changes durable; checkpoints once the log has grown long enough
+    void sync()
+    {
+        if (wal)
+        {
+            wal->commit();
+            if (wal->lastLsn() - checkpointLsn >= checkpointInterval)
+            {
+                checkpoint();
+            }
+        }
+    }
+
+    void checkpoint()
+    {
+        if (wal)
+        {
+            wal->commit();
+            writeSnapshot(storagePath + ".snap", wal->lastLsn());
+            checkpointLsn = wal->lastLsn();
+            wal->reset();
+        }
+    }
+
+    size_t accountCount() const
+    {
+        return accounts.size();
+    }
+
+    Account *addRegularAccount(string_view nam, string_view accNumber, Money initialBalance)
+    {
+        return track(regularAccounts.create(nam, accNumber, initialBalance));
+    }
+
+    Account *addSavingsAccount(string_view nam, string_view accNumber, Money initialBalance)
+    {
+        return track(savingsAccounts.create(nam, accNumber, initialBalance));
+    }
+
+    void displayAccounts() const
+    {
+        for (const Account *acc : accounts)
+        {
+            acc->display();
+        }
+    }
+
+    bool deposit(string_view accNumber, Money amount)
+    {
+        BANK_METRIC_SCOPE(Metric::Deposit);
+        Account *acc = find(accNumber);
+        if (acc)
+        {
+            if (!acc->deposit(amount))
+            {
+                cout << "Invalid deposit amount." << endl;
+                return false;
+            }
+            logChange(LogRecordType::Deposit, acc, amount);
+            return true;
+        }
+        cout << "Account not found." << endl;
+        return false;
+    }
+
+    bool withdraw(string_view accNumber, Money amount)
+    {
+        BANK_METRIC_SCOPE(Metric::Withdraw);
+        Account *acc = find(accNumber);
+        if (acc)
+        {
+            bool done = acc->withdraw(amount);
+            if (done)
+                logChange(LogRecordType::Withdraw, acc, amount);
+            return done;
+        }
+        cout << "Account not found." << endl;
+        return false;
+    }
+
+    // Moves amount between two accounts; false if either is unknown, the source refuses the
+    // withdrawal or the destination cannot hold the amount. Nothing changes when it fails.
+    bool transfer(string_view fromNumber, string_view toNumber, Money amount)
+    {
+        BANK_METRIC_SCOPE(Metric::Transfer);
+        Account *from = find(fromNumber);
+        Account *to = find(toNumber);
+        if (!from || !to)
+        {
+            cout << "Account not found." << endl;
+            return false;
+        }
+        if (!to->getBalance().canAdd(amount) || !from->withdraw(amount))
+            return false;
+        to->deposit(amount);
+        logChange(LogRecordType::Transfer, from, amount, to);
+        return true;
+    }
+};
+
+// Every global operator new call, so the benchmarks can report allocation counts.
+// Kept out of line so GCC pairs each new with its delete instead of seeing raw malloc/free.
+size_t heapAllocations = 0;
+
+[[gnu::noinline]] void *operator new(size_t size)
+{
+    ++heapAllocations;
+    if (void *memory = malloc(size ? size : 1))
+        return memory;
+    throw bad_alloc();
+}
+
+[[gnu::noinline]] void operator delete(void *memory) noexcept
+{
+    free(memory);
+}
+
+[[gnu::noinline]] void operator delete(void *memory, size_t) noexcept
+{
+    free(memory);
+}
+
+// Loads accounts one new per object (the old Bank layout) and through the slab pools Bank uses
+void runAllocationBenchmark()
+{
+    const int accountCount = 1000000;
+    cout << "Allocation benchmark (" << accountCount << " accounts)" << endl;
+    {
+        size_t allocationsBefore = heapAllocations;
+        auto start = chrono::steady_clock::now();
+        vector<Account *> accounts;
+        for (int i = 0; i < accountCount; ++i)
+        {
+            if (i % 2)
+                accounts.push_back(new SavingsAccount("customer", to_string(i), Money::fromMajor(1000)));
+            else
+                accounts.push_back(new RegularAccount("customer", to_string(i), Money::fromMajor(1000)));
+        }
+        chrono::duration<double> loadTime = chrono::steady_clock::now() - start;
+        size_t allocations = heapAllocations - allocationsBefore;
+        start = chrono::steady_clock::now();
+        for (Account *acc : accounts)
+        {
+            if (acc->isSavings())
+                delete static_cast<SavingsAccount *>(acc);
+            else
+                delete static_cast<RegularAccount *>(acc);
+        }
+        chrono::duration<double> teardownTime = chrono::steady_clock::now() - start;
+        cout << "new per account: load " << (long long)(loadTime.count() * 1000) << " ms, " << allocations
+             << " allocations, teardown " << (long long)(teardownTime.count() * 1000) << " ms" << endl;
+    }
+    {
+        size_t allocationsBefore = heapAllocations;
+        auto start = chrono::steady_clock::now();
+        auto *regularPool = new ObjectPool<RegularAccount>;
+        auto *savingsPool = new ObjectPool<SavingsAccount>;
+        vector<Account *> accounts;
+        for (int i = 0; i < accountCount; ++i)
+        {
+            if (i % 2)
+                accounts.push_back(savingsPool->create("customer", to_string(i), Money::fromMajor(1000)));
+            else
+                accounts.push_back(regularPool->create("customer", to_string(i), Money::fromMajor(1000)));
+        }
+        chrono::duration<double> loadTime = chrono::steady_clock::now() - start;
+        size_t allocations = heapAllocations - allocationsBefore;
+        start = chrono::steady_clock::now();
+        delete regularPool;
+        delete savingsPool;
+        chrono::duration<double> teardownTime = chrono::steady_clock::now() - start;
+        cout << "Slab pools: load " << (long long)(loadTime.count() * 1000) << " ms, " << allocations
+             << " allocations, teardown " << (long long)(teardownTime.count() * 1000) << " ms" << endl;
+    }
+}
+
+// Heap allocations made by steady-state deposits, withdrawals and transfers through Bank, in
+// memory and with the write-ahead log open. A warm-up pass first sizes every reused buffer.
+void runOperationAllocationBenchmark()
+{
+    const int accountCount = 1000;
+    const int operationCount = 100000;
+    string basePath = (filesystem::temp_directory_path() / "arif_bank_alloc_bench").string();
+    vector<string> numbers;
+    for (int i = 0; i < accountCount; ++i)
+        numbers.push_back(to_string(i + 1));
+    cout << "Allocation check (" << operationCount << " deposits, withdrawals and transfers, " << accountCount
+         << " accounts)" << endl;
+    for (bool durable : {false, true})
+    {
+        filesystem::remove(basePath + ".wal");
+        filesystem::remove(basePath + ".snap");
+        Bank bank;
+        bank.verboseTeardown = false;
+        if (durable)
+            bank.openStorage(basePath);
+        for (int i = 0; i < accountCount; ++i)
+            bank.addRegularAccount("customer", numbers[i], Money::fromMajor(1000));
+
+        size_t allocations = 0;
+        for (int pass = 0; pass < 2; ++pass)
+        {
+            mt19937 rng(pass);
+            uniform_int_distribution<int> pick(0, accountCount - 1);
+            size_t before = heapAllocations;
+            for (int i = 0; i < operationCount; ++i)
+            {
+                string_view number = numbers[pick(rng)];
+                switch (i % 3)
+                {
+                case 0:
+                    bank.deposit(number, Money::fromMajor(2));
+                    break;
+                case 1:
+                    bank.withdraw(number, Money::fromMajor(1));
+                    break;
+                default:
+                    bank.transfer(number, numbers[pick(rng)], Money::fromMajor(1));
+                    break;
+                }
+            }
+            allocations = heapAllocations - before;
+        }
+        cout << (durable ? "With write-ahead log" : "In memory") << ", heap allocations after warm-up: " << allocations
+             << endl;
+    }
+    filesystem::remove(basePath + ".wal");
+    filesystem::remove(basePath + ".snap");
+}
+
+// Bulk deposit/withdraw passes over the same randomly mixed accounts held three ways:
+// Account pointers with virtual calls, a vector of variants visited per element, and an AccountTable
+void runDispatchBenchmark()
+{
+    const int accountCount = 1000000;
+    const int passes = 20;
+    const Money amount = Money::fromMajor(1);
+    ObjectPool<RegularAccount> regularPool;
+    ObjectPool<SavingsAccount> savingsPool;
+    vector<Account *> pointers;
+    vector<variant<RegularAccount, SavingsAccount>> variants;
+    AccountTable table;
+    variants.reserve(accountCount);
+    mt19937 rng(11);
+    for (int i = 0; i < accountCount; ++i)
+    {
+        Money balance = Money::fromMajor(100 + rng() % 10);
+        if (rng() % 2)
+        {
+            pointers.push_back(savingsPool.create("customer", to_string(i), balance));
+            variants.emplace_back(in_place_type<SavingsAccount>, "customer", to_string(i), balance);
+            table.addSavings("customer", to_string(i), balance);
+        }
+        else
+        {
+            pointers.push_back(regularPool.create("customer", to_string(i), balance));
+            variants.emplace_back(in_place_type<RegularAccount>, "customer", to_string(i), balance);
+            table.addRegular("customer", to_string(i), balance);
+        }
+    }
+
+    cout << "Dispatch benchmark (" << accountCount << " accounts, " << passes << " deposit + withdraw passes)" << endl;
+    auto start = chrono::steady_clock::now();
+    size_t pointerWithdrawals = 0;
+    for (int pass = 0; pass < passes; ++pass)
+    {
+        for (Account *acc : pointers)
+            acc->deposit(amount);
+        for (Account *acc : pointers)
+            pointerWithdrawals += acc->withdraw(amount + amount);
+    }
+    chrono::duration<double> pointerTime = chrono::steady_clock::now() - start;
+
+    start = chrono::steady_clock::now();
+    size_t variantWithdrawals = 0;
+    for (int pass = 0; pass < passes; ++pass)
+    {
+        for (auto &acc : variants)
+            visit([amount](auto &account) { account.deposit(amount); }, acc);
+        for (auto &acc : variants)
+            variantWithdrawals += visit([amount](auto &account) { return account.withdraw(amount + amount); }, acc);
+    }
+    chrono::duration<double> variantTime = chrono::steady_clock::now() - start;
+
+    start = chrono::steady_clock::now();
+    size_t tableWithdrawals = 0;
+    for (int pass = 0; pass < passes; ++pass)
+    {
+        table.depositAll(amount);
+        tableWithdrawals += table.withdrawAll(amount + amount);
+    }
+    chrono::duration<double> tableTime = chrono::steady_clock::now() - start;
+
+    Money pointerTotal;
+    for (Account *acc : pointers)
+        pointerTotal += acc->getBalance();
+    Money variantTotal;
+    for (auto &acc : variants)
+        variantTotal += visit([](auto &account) { return account.getBalance(); }, acc);
+    double operations = 2.0 * passes * accountCount;
+    cout << "Virtual calls: " << (long long)(operations / pointerTime.count()) << " ops/sec" << endl;
+    cout << "Variant per element: " << (long long)(operations / variantTime.count()) << " ops/sec" << endl;
+    cout << "AccountTable: " << (long long)(operations / tableTime.count()) << " ops/sec" << endl;
+    cout << "Results "
+         << (pointerWithdrawals == variantWithdrawals && variantWithdrawals == tableWithdrawals &&
+                     pointerTotal == variantTotal && pointerTotal == table.totalBalance()
+                 ? "match"
+                 : "DIFFER")
+         << endl;
+}
+
+// Deposits by account number across 1M accounts: AccountIndex (through Bank), a
+// string-keyed unordered_map, and a sample of linear scans like the old Bank::find
+void runLookupBenchmark()
+{
+    const int accountCount = 1000000;
+    const int lookupCount = 2000000;
+    const int scanCount = 100;
+    const Money amount = Money::fromMajor(1);
+    vector<string> numbers;
+    numbers.reserve(accountCount);
+    for (int i = 0; i < accountCount; ++i)
+        numbers.push_back("AC" + to_string(1000000000 + i));
+    mt19937 rng(13);
+    vector<int> picks(lookupCount);
+    for (int &pick : picks)
+        pick = rng() % accountCount;
+
+    Bank bank;
+    bank.verboseTeardown = false;
+    vector<Account *> accounts(accountCount); // in the order the old Bank kept them
+    for (int i = 0; i < accountCount; ++i)
+        accounts[i] = bank.addRegularAccount("customer", numbers[i], Money::fromMajor(1000));
+    cout << "Lookup benchmark (" << accountCount << " accounts, " << lookupCount << " deposits)" << endl;
+
+    size_t allocationsBefore = heapAllocations;
+    auto start = chrono::steady_clock::now();
+    for (int pick : picks)
+        bank.deposit(numbers[pick], amount);
+    chrono::duration<double> indexTime = chrono::steady_clock::now() - start;
+    size_t indexAllocations = heapAllocations - allocationsBefore;
+
+    unordered_map<string, Account *> byString;
+    byString.reserve(accountCount);
+    for (int i = 0; i < accountCount; ++i)
+        byString[numbers[i]] = accounts[i];
+    start = chrono::steady_clock::now();
+    for (int pick : picks)
+        byString.find(numbers[pick])->second->deposit(amount);
+    chrono::duration<double> stringTime = chrono::steady_clock::now() - start;
+
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < scanCount; ++i)
+    {
+        for (Account *acc : accounts)
+        {
+            if (acc->getAccountNumber() == numbers[picks[i]])
+            {
+                acc->deposit(amount);
+                break;
+            }
+        }
+    }
+    chrono::duration<double> scanTime = chrono::steady_clock::now() - start;
+
+    cout << "AccountIndex: " << (long long)(lookupCount / indexTime.count()) << " deposits/sec, "
+         << indexAllocations << " allocations" << endl;
+    cout << "unordered_map<string>: " << (long long)(lookupCount / stringTime.count()) << " deposits/sec" << endl;
+    cout << "Linear scan: " << (long long)(scanCount / scanTime.count()) << " deposits/sec" << endl;
+}
+
+// Measures the cost of durable changes and of restarting from disk
+void runBenchmarks()
+{
+    const int accountCount = 100000;
+    const int opCount = 20000;
+    string basePath = (filesystem::temp_directory_path() / "arif_bank_bench").string();
+    auto removeFiles = [&]()
+    {
+        filesystem::remove(basePath + ".wal");
+        filesystem::remove(basePath + ".snap");
+    };
+
+    cout << "Durability benchmark (" << opCount << " deposits, 1000 accounts)" << endl;
+    size_t groupSizes[] = {0, 1, 16, 256};
+    for (size_t groupSize : groupSizes)
+    {
+        removeFiles();
+        Bank bank;
+        bank.verboseTeardown = false;
+        if (groupSize)
+            bank.openStorage(basePath, groupSize);
+        for (int i = 0; i < 1000; ++i)
+            bank.addRegularAccount("customer", to_string(i), Money::fromMajor(1000));
+        bank.sync();
+
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < opCount; ++i)
+            bank.deposit(to_string(i % 1000), Money::fromMajor(1));
+        bank.sync();
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+        cout << (groupSize ? "Group size " + to_string(groupSize) : string("No log"))
+             << ", Ops/sec: " << (long long)(opCount / elapsed.count()) << endl;
+    }
+
+    for (int useSnapshot = 1; useSnapshot >= 0; --useSnapshot)
+    {
+        removeFiles();
+        {
+            Bank bank;
+            bank.verboseTeardown = false;
+            bank.openStorage(basePath, 4096);
+            for (int i = 0; i < accountCount; ++i)
+                bank.addSavingsAccount("customer", to_string(i), Money::fromMajor(1000));
+            if (useSnapshot)
+                bank.checkpoint();
+            for (int i = 0; i < opCount; ++i)
+                bank.deposit(to_string(i % 100), Money::fromMajor(1));
+        }
+        auto start = chrono::steady_clock::now();
+        Bank restored;
+        restored.verboseTeardown = false;
+        restored.openStorage(basePath);
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+        cout << (useSnapshot ? "Startup from snapshot + log tail" : "Startup from full log replay") << " ("
+             << restored.accountCount() << " accounts): " << (long long)(elapsed.count() * 1000) << " ms" << endl;
+    }
+    removeFiles();
+}
+
+// Headless command driver. A script is a text file with one command per line; amounts are whole
+// cents, and blank lines and lines starting with # are skipped:
+//   R <number> <balance> <name>   add a regular account (the name is the rest of the line)
+//   S <number> <balance> <name>   add a savings account
+//   D <number> <amount>           deposit
+//   W <number> <amount>           withdraw
+//   T <from> <to> <amount>        transfer
+enum class ScriptOp : uint8_t
+{
+    AddRegular,
+    AddSavings,
+    Deposit,
+    Withdraw,
+    Transfer
+};
+const int scriptOpCount = 5;
+const char *scriptOpNames[scriptOpCount] = {"Add regular", "Add savings", "Deposit", "Withdraw", "Transfer"};
+
+struct ScriptCommand
+{
+    ScriptOp op;
+    string account;
+    string toAccount;
+    Money amount;
+    string name;
+};
+
+// Splits the next space-separated token off the front of line
+string_view nextToken(string_view &line)
+{
+    size_t start = line.find_first_not_of(' ');
+    line.remove_prefix(start == string_view::npos ? line.size() : start);
+    string_view token = line.substr(0, line.find(' '));
+    line.remove_prefix(token.size());
+    return token;
+}
+
+bool parseCents(string_view token, Money &amount)
+{
+    int64_t cents = 0;
+    auto [end, error] = from_chars(token.data(), token.data() + token.size(), cents);
+    amount = Money::fromCents(cents);
+    return error == errc() && end == token.data() + token.size() && !token.empty();
+}
+
+// Takes the next token as an account number, which must fit an AccountKey
+bool parseAccount(string_view &line, string &account)
+{
+    account = string(nextToken(line));
+    return !account.empty() && AccountKey::fits(account);
+}
+
+bool parseCommand(string_view line, ScriptCommand &command)
+{
+    string_view op = nextToken(line);
+    bool ok = op.size() == 1;
+    switch (ok ? op[0] : 0)
+    {
+    case 'R':
+    case 'S':
+        command.op = op[0] == 'R' ? ScriptOp::AddRegular : ScriptOp::AddSavings;
+        ok = parseAccount(line, command.account) && parseCents(nextToken(line), command.amount);
+        command.name = string(line.substr(min(line.find_first_not_of(' '), line.size())));
+        return ok && !command.name.empty();
+    case 'D':
+    case 'W':
+        command.op = op[0] == 'D' ? ScriptOp::Deposit : ScriptOp::Withdraw;
+        ok = parseAccount(line, command.account) && parseCents(nextToken(line), command.amount);
+        break;
+    case 'T':
+        command.op = ScriptOp::Transfer;
+        ok = parseAccount(line, command.account) && parseAccount(line, command.toAccount) &&
+             parseCents(nextToken(line), command.amount);
+        break;
+    default:
+        return false;
+    }
+    return ok && nextToken(line).empty();
+}
+
+// Parses a whole script up front, so replay timings do not include parsing. On a bad line,
+// returns false with its number in errorLine.
+bool loadScript(const string &path, vector<ScriptCommand> &commands, size_t &errorLine)
+{
+    ifstream in(path);
+    string line;
+    errorLine = 0;
+    if (!in)
+        return false;
+    while (getline(in, line))
+    {
+        ++errorLine;
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        if (line.find_first_not_of(' ') == string::npos || line[line.find_first_not_of(' ')] == '#')
+            continue;
+        commands.emplace_back();
+        if (!parseCommand(line, commands.back()))
+            return false;
+    }
+    errorLine = 0;
+    return !in.bad();
+}
+
+// Latency of every replayed command, by operation
+class ReplayStats
+{
+private:
+    vector<uint32_t> samples[scriptOpCount]; // nanoseconds
+    double elapsed = 0;                       // seconds
+
+public:
+    void record(ScriptOp op, int64_t nanoseconds)
+    {
+        samples[(int)op].push_back((uint32_t)min<int64_t>(nanoseconds, UINT32_MAX));
+    }
+
+    void finish(double seconds)
+    {
+        elapsed = seconds;
+    }
+
+    void print(ostream &out)
+    {
+        size_t total = 0;
+        for (const vector<uint32_t> &opSamples : samples)
+            total += opSamples.size();
+        out << "Replayed " << total << " commands in " << (long long)(elapsed * 1000) << " ms ("
+            << (long long)(total / max(elapsed, 1e-9)) << " ops/sec)" << endl;
+        out << left << setw(14) << "Operation" << right << setw(10) << "Count" << setw(14) << "Ops/sec" << setw(10)
+            << "p50 ns" << setw(10) << "p99 ns" << setw(10) << "p999 ns" << endl;
+        for (int op = 0; op < scriptOpCount; ++op)
+        {
+            vector<uint32_t> &opSamples = samples[op];
+            if (opSamples.empty())
+                continue;
+            sort(opSamples.begin(), opSamples.end());
+            uint64_t busy = 0;
+            for (uint32_t sample : opSamples)
+                busy += sample;
+            // Nearest-rank percentile
+            auto percentile = [&](double fraction)
+            {
+                return opSamples[(size_t)ceil(fraction * opSamples.size()) - 1];
+            };
+            out << left << setw(14) << scriptOpNames[op] << right << setw(10) << opSamples.size() << setw(14)
+                << (long long)(opSamples.size() * 1e9 / max<uint64_t>(busy, 1)) << setw(10) << percentile(0.5)
+                << setw(10) << percentile(0.99) << setw(10) << percentile(0.999) << endl;
+        }
+    }
+};
+
+// Runs every command against the bank, timing each one
+ReplayStats replayScript(Bank &bank, const vector<ScriptCommand> &commands)
+{
+    ReplayStats stats;
+    auto start = chrono::steady_clock::now();
+    auto previous = start;
+    for (const ScriptCommand &command : commands)
+    {
+        switch (command.op)
+        {
+        case ScriptOp::AddRegular:
+            bank.addRegularAccount(command.name, command.account, command.amount);
+            break;
+        case ScriptOp::AddSavings:
+            bank.addSavingsAccount(command.name, command.account, command.amount);
+            break;
+        case ScriptOp::Deposit:
+            bank.deposit(command.account, command.amount);
+            break;
+        case ScriptOp::Withdraw:
+            bank.withdraw(command.account, command.amount);
+            break;
+        case ScriptOp::Transfer:
+            bank.transfer(command.account, command.toAccount, command.amount);
+            break;
+        }
+        auto now = chrono::steady_clock::now();
+        stats.record(command.op, chrono::duration_cast<chrono::nanoseconds>(now - previous).count());
+        previous = now;
+    }
+    bank.sync();
+    stats.finish(chrono::duration<double>(chrono::steady_clock::now() - start).count());
+    return stats;
+}
+
+// Writes a random script: accountCount accounts of 1000.00, alternately regular and savings,
+// then operationCount deposits (30%), withdrawals (30%) and transfers (40%) on uniformly
+// chosen accounts
+bool writeScript(const string &path, int accountCount, int operationCount, unsigned seed)
+{
+    ofstream out(path);
+    mt19937 rng(seed);
+    for (int i = 1; i <= accountCount; ++i)
+        out << (i % 2 ? 'R' : 'S') << ' ' << i << " 100000 customer " << i << '\n';
+    uniform_int_distribution<int> pick(1, accountCount);
+    for (int i = 0; i < operationCount; ++i)
+    {
+        unsigned kind = rng() % 10;
+        int64_t cents = rng() % 10000 + 1;
+        if (kind < 3)
+            out << "D " << pick(rng) << ' ' << cents << '\n';
+        else if (kind < 6)
+            out << "W " << pick(rng) << ' ' << cents << '\n';
+        else
+        {
+            int from = pick(rng);
+            out << "T " << from << ' ' << pick(rng) << ' ' << cents << '\n';
+        }
+    }
+    return bool(out.flush());
+}
+
+// A generated script replayed through the command driver
+void runReplayBenchmark()
+{
+    const int accountCount = 100000;
+    const int operationCount = 1000000;
+    string path = (filesystem::temp_directory_path() / "arif_bank_bench.script").string();
+    writeScript(path, accountCount, operationCount, 21);
+    vector<ScriptCommand> commands;
+    size_t errorLine;
+    loadScript(path, commands, errorLine);
+    cout << "Replay benchmark (" << accountCount << " accounts, " << operationCount << " operations)" << endl;
+    Bank bank;
+    bank.verboseTeardown = false;
+    replayScript(bank, commands).print(cout);
+    filesystem::remove(path);
+}
+
+// Cost of an empty probe, then the replay benchmark's script with the metrics it records
+void runMetricsBenchmark()
+{
+    const int probeCount = 10000000;
+    cout << "Metrics benchmark (" << (BANK_METRICS ? "probes on" : "probes compiled out") << ", 1 in "
+         << Metrics::SamplePeriod << " operations timed)" << endl;
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < probeCount; ++i)
+    {
+        BANK_METRIC_SCOPE(Metric::Lookup);
+        atomic_signal_fence(memory_order_seq_cst);
+    }
+    chrono::duration<double, nano> elapsed = chrono::steady_clock::now() - start;
+    cout << "Empty probe: " << elapsed.count() / probeCount << " ns" << endl;
+
+    string path = (filesystem::temp_directory_path() / "arif_bank_metrics.script").string();
+    writeScript(path, 100000, 1000000, 21);
+    vector<ScriptCommand> commands;
+    size_t errorLine;
+    loadScript(path, commands, errorLine);
+    Bank bank;
+    bank.verboseTeardown = false;
+    replayScript(bank, commands).print(cout);
+    filesystem::remove(path);
+    Metrics::global().report(cout, false);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc > 1 && string(argv[1]) == "--bench")
+    {
+        runBenchmarks();
+        runAllocationBenchmark();
+        runOperationAllocationBenchmark();
+        runDispatchBenchmark();
+        runLookupBenchmark();
+        runReplayBenchmark();
+        runMetricsBenchmark();
+        return 0;
+    }
+    string command = argc > 2 ? argv[1] : "";
+    if (command == "--make-script" && argc > 4)
+        return writeScript(argv[2], atoi(argv[3]), atoi(argv[4]), argc > 5 ? atoi(argv[5]) : 1) ? 0 : 1;
+    if (command == "--replay")
+    {
+        // Runs against an in-memory bank, or against the storage files at the optional base path
+        vector<ScriptCommand> commands;
+        size_t errorLine;
+        if (!loadScript(argv[2], commands, errorLine))
+        {
+            cout << "Could not read " << argv[2];
+            if (errorLine > 0)
+                cout << ": bad command on line " << errorLine;
+            cout << endl;
+            return 1;
+        }
+        Bank bank;
+        bank.verboseTeardown = false;
+        if (argc > 3 && !bank.openStorage(argv[3]))
+        {
+            cout << "Could not open " << argv[3] << ".wal" << endl;
+            return 1;
+        }
+        replayScript(bank, commands).print(cout);
+        return 0;
+    }
+
+    Bank bank;
+    if (!bank.openStorage("arif_bank"))
+        cout << "Warning: could not open arif_bank.wal; changes will not be saved." << endl;
+
+    // Sample data, only on the very first run
+    if (bank.accountCount() == 0)
+    {
+        bank.addRegularAccount("Arif", "1001", Money::fromMajor(5000));
+        bank.addSavingsAccount("Rohan", "2002", Money::fromMajor(7000));
+        bank.addSavingsAccount("Rian", "2003", Money::fromMajor(7000));
+    }
 
     int choice;
     string accountNumber;
-    double amount;
+    Money amount;
     string id, nam;
     do
     {
@@ -195,10 +2019,12 @@ int main()
             cin >> nam;
             cout << "ID : ";
             cin >> id;
-            if (q)
-                bank.addAccount(new RegularAccount(nam, id, 0.0));
+            if (!AccountKey::fits(id))
+                cout << "Account number is too long (at most " << AccountKey::capacity << " characters)." << endl;
+            else if (q)
+                bank.addRegularAccount(nam, id, Money());
             else
-                bank.addAccount(new SavingsAccount(nam, id, 0.0));
+                bank.addSavingsAccount(nam, id, Money());
             break;
         case 0:
             cout << "Exiting..." << endl;
@@ -207,6 +2033,7 @@ int main()
             cout << "Invalid choice. Please try again." << endl;
         }
 
+        bank.sync();
         cout << endl;
 
     } while (choice != 0);
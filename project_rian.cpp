@@ -1,26 +1,599 @@
 #include <iostream>
 #include <string>
 #include <vector>
+#include <chrono>
+#include <utility>
+#include <algorithm>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <random>
+#include <span>
+#include <atomic>
+#include <new>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <filesystem>
+#include <functional>
+#include <cmath>
+#include <stdexcept>
+#include <charconv>
+#include <iomanip>
+#include <cstdlib>
+#if defined(__x86_64__) || defined(_M_X64)
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#endif
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 using namespace std;
 
+enum class OpStatus : unsigned char {
+    Success,
+    AccountNotFound,
+    InsufficientBalance,
+    NotEligible,
+    LoanPaidOff,
+    InvalidAmount
+};
+
+// An amount of money held as a whole number of cents, so sums and comparisons are exact.
+// Arithmetic is checked: a result that does not fit in 64 bits throws overflow_error, so account
+// operations test canAdd first and refuse the change instead.
+class Money {
+private:
+    int64_t cents;
+    constexpr explicit Money(int64_t cents) : cents(cents) {}
+public:
+    constexpr Money() : cents(0) {}
+    static constexpr Money fromCents(int64_t cents) {
+        return Money(cents);
+    }
+    static Money fromMajor(int64_t units) {
+        return Money(units) * 100;
+    }
+    static Money fromDouble(double value);
+    int64_t minorUnits() const {
+        return cents;
+    }
+    double toDouble() const {
+        return cents / 100.0;
+    }
+    Money operator+(Money other) const;
+    Money operator-(Money other) const;
+    Money operator*(int64_t factor) const;
+    bool canAdd(Money other) const;
+    Money& operator+=(Money other) {
+        return *this = *this + other;
+    }
+    Money& operator-=(Money other) {
+        return *this = *this - other;
+    }
+    Money percent(int64_t rate) const;
+    auto operator<=>(const Money&) const = default;
+};
+
+ostream& operator<<(ostream& out, Money money);
+istream& operator>>(istream& in, Money& money);
+
+enum class EventType : unsigned char {
+    AccountCreated,
+    Deposit,
+    Withdrawal,
+    Transfer,
+    LoanApproved,
+    LoanPayment
+};
+
+// Structured record of one account operation, handed to an EventSink
+struct Event {
+    EventType type;
+    OpStatus status;
+    int accountNumber;
+    int counterparty; // target account for Transfer
+    Money amount;
+    Money balance;    // balance after the operation
+};
+
+class EventSink {
+public:
+    virtual ~EventSink() {}
+    virtual void onEvent(const Event& event) = 0;
+};
+
+// Reports events with the menu's messages
+class ConsoleSink : public EventSink {
+private:
+    ostream& out;
+public:
+    ConsoleSink(ostream& out = cout) : out(out) {}
+    void onEvent(const Event& event) override;
+};
+
+// Discards events, for batch and server use
+class NullSink : public EventSink {
+public:
+    void onEvent(const Event&) override {}
+};
+
+// Buffers raw Event records and writes them to a binary stream in blocks
+class BufferedBinarySink : public EventSink {
+private:
+    ostream& out;
+    vector<Event> buffer;
+public:
+    BufferedBinarySink(ostream& out, size_t capacity = 4096) : out(out) {
+        buffer.reserve(capacity);
+    }
+    ~BufferedBinarySink() {
+        flush();
+    }
+    void onEvent(const Event& event) override;
+    void flush();
+};
+
+enum class TransactionType : uint8_t {
+    Deposit,
+    Withdrawal,
+    Transfer,
+    Loan,
+    LoanPayment
+};
+
+const char* transactionTypeName(TransactionType type);
+
+// Hands out unique, roughly increasing ids to any number of threads. Each thread reserves
+// BlockSize ids at a time from one atomic counter and issues them from a thread-local block,
+// so threads only meet on the counter once per block.
+class IdService {
+public:
+    static constexpr int BlockSize = 64;
+private:
+    static constexpr int MaxServices = 4;
+    struct Block {
+        int next = 0;
+        int end = 0;
+        uint32_t epoch = 0; // the service's epoch when the block was taken
+    };
+    static atomic<int> serviceCount;
+    static thread_local Block blocks[MaxServices];
+    int slot; // this service's entry in every thread's blocks
+    atomic<int> next;
+    atomic<uint32_t> epoch; // bumped by advancePast, so blocks taken before it are dropped
+public:
+    explicit IdService(int first = 1);
+    int allocate();
+    int reserve(int count);
+    void advancePast(int id);
+    int upperBound() const {
+        return next.load(memory_order_relaxed); // above every id issued so far
+    }
+};
+
+// An entry carries two numbers: an id unique across the whole bank, and its position in its
+// own account's history, which is what the history tiers and the statement are keyed on
 class Transaction {
 private:
     int transactionId;
-    string transactionType;
-    double amount;
+    uint32_t sequence;
+    TransactionType transactionType;
+    Money amount;
+    static IdService ids;
 public:
-    Transaction(int id, const string& type, double amt)
-        : transactionId(id), transactionType(type), amount(amt) {}
-    int getId() {
+    Transaction() : transactionId(0), sequence(0), transactionType(TransactionType::Deposit) {}
+    Transaction(uint32_t sequence, TransactionType type, Money amt)
+        : transactionId(ids.allocate()), sequence(sequence), transactionType(type), amount(amt) {}
+    Transaction(int id, uint32_t sequence, TransactionType type, Money amt) // restore an existing entry
+        : transactionId(id), sequence(sequence), transactionType(type), amount(amt) {}
+    int getId() const {
         return transactionId;
     }
-    string getType() {
+    uint32_t getSequence() const {
+        return sequence;
+    }
+    TransactionType getType() const {
         return transactionType;
     }
-    double getAmount() {
+    Money getAmount() const {
         return amount;
     }
+    friend class Bank;
+};
+
+// Cold tier of every account's history: one append-only file of compressed blocks. A block
+// holds consecutive entries of one account plus the offset of that account's previous block,
+// so an account's spilled history is a chain walked back from its newest block.
+// Block layout: previous offset (i64), first sequence (u32), first id (i32), entry count (u8),
+// payload size (u16), then per entry its type byte, its id as a zigzag varint delta from the
+// entry before, and its amount in cents as a zigzag varint.
+// Without open() the blocks go to an anonymous temporary file.
+class HistoryStore {
+private:
+    FILE* file;
+    uint64_t fileSize;
+    bool atEnd;     // the file position is at fileSize, so a spill can write without seeking
+    string block;   // reused by every spill, so spilling does not allocate once it has grown
+    mutex lock;
+public:
+    HistoryStore();
+    ~HistoryStore();
+    HistoryStore(const HistoryStore&) = delete;
+    HistoryStore& operator=(const HistoryStore&) = delete;
+    bool open(const string& path, uint64_t validSize);
+    bool spill(int64_t& head, const Transaction* entries, size_t count);
+    int64_t load(int64_t offset, vector<Transaction>& entries);
+    uint64_t flush();
+    uint64_t size() {
+        lock_guard<mutex> guard(lock);
+        return fileSize;
+    }
+};
+
+// One account's transaction history: the newest entries in an inline ring, older ones moved
+// to a HistoryStore a batch at a time, so an account's footprint stays fixed however long it lives.
+// Batches the store fails to write are kept in memory instead, and retried oldest first.
+class TransactionHistory {
+public:
+    static constexpr size_t RecentCapacity = 8;
+    static constexpr size_t SpillBatch = 4;
+private:
+    HistoryStore* store;
+    Transaction recent[RecentCapacity];
+    uint32_t total;        // entries ever recorded, which is also the newest sequence
+    uint8_t first;         // ring index of the oldest inline entry
+    uint8_t inlineCount;
+    int64_t spilledHead;   // newest spilled block, or -1
+    unique_ptr<vector<Transaction>> unspilled; // between the spilled and inline entries; null while the store keeps up
+    void spillOldest();
+public:
+    explicit TransactionHistory(HistoryStore& store)
+        : store(&store), total(0), first(0), inlineCount(0), spilledHead(-1) {}
+    void append(TransactionType type, Money amount);
+    int newestId(size_t back = 0) const {
+        return recent[(first + inlineCount + RecentCapacity - 1 - back) % RecentCapacity].getId();
+    }
+    void restoreId(int id, size_t back = 0);
+    size_t size() const {
+        return total;
+    }
+    vector<Transaction> readAll() const;
+    friend class Bank;
+};
+
+// Built-in latency metrics for the hot operations. On by default; build with -DBANK_METRICS=0
+// to compile every probe out. Set BANK_METRICS_REPORT to a file path (or "-" for stdout) to
+// get a report on exit, as JSON if the path ends in .json and as a text table otherwise.
+#ifndef BANK_METRICS
+#define BANK_METRICS 1
+#endif
+
+enum class Metric : uint8_t {
+    Lookup,
+    Deposit,
+    Withdraw,
+    Transfer,
+    LoanPayment
+};
+const int metricCount = 5;
+const char* metricNames[metricCount] = {"lookup", "deposit", "withdraw", "transfer", "loan payment"};
+
+// Log-linear histogram in the style of HdrHistogram: 16 linear sub-buckets per power of two,
+// so each bucket is within 1/16 of the values it holds. Written by one thread only, with
+// relaxed loads and stores instead of locked increments; any thread may read it meanwhile.
+class LatencyHistogram {
+public:
+    static constexpr int SubBuckets = 16;
+    static constexpr int BucketCount = SubBuckets * 61;
+private:
+    atomic<uint64_t> buckets[BucketCount] = {};
+    atomic<uint64_t> sum{0};
+public:
+    static int bucketOf(uint64_t value) {
+        int shift = max((int)bit_width(value) - 5, 0);
+        return shift * SubBuckets + (int)(value >> shift);
+    }
+    static uint64_t bucketStart(int bucket) {
+        int shift = max(bucket / SubBuckets - 1, 0);
+        return (uint64_t)(bucket - shift * SubBuckets) << shift;
+    }
+    void record(uint64_t value) {
+        atomic<uint64_t>& bucket = buckets[bucketOf(value)];
+        bucket.store(bucket.load(memory_order_relaxed) + 1, memory_order_relaxed);
+        sum.store(sum.load(memory_order_relaxed) + value, memory_order_relaxed);
+    }
+    uint64_t countAt(int bucket) const {
+        return buckets[bucket].load(memory_order_relaxed);
+    }
+    uint64_t total() const {
+        return sum.load(memory_order_relaxed);
+    }
+};
+
+// Count of every operation; the times come from the sampled ones
+struct LatencySummary {
+    uint64_t count = 0;
+    double meanNs = 0;
+    double p50Ns = 0;
+    double p99Ns = 0;
+    double p999Ns = 0;
+    double maxNs = 0;
+};
+
+// Every thread records into its own shard, registered on its first operation; summaries merge
+// the shards. Every operation is counted, and one in SamplePeriod is timed, which keeps the
+// average probe to a few nanoseconds even where reading the clock is slow. Times come from
+// the CPU timestamp counter where there is one, converted to nanoseconds only when reported.
+class Metrics {
+public:
+    static constexpr uint32_t SamplePeriod = 16;
+private:
+    struct Shard {
+        atomic<uint64_t> counts[metricCount] = {};
+        uint32_t untilSample[metricCount] = {};
+        LatencyHistogram histograms[metricCount];
+    };
+    mutex lock;
+    vector<unique_ptr<Shard>> shards;
+    uint64_t startTicks;
+    chrono::steady_clock::time_point startTime;
+    static thread_local Shard* localShard;
+    Metrics();
+    ~Metrics();
+    Shard* registerThread();
+    double nanosecondsPerTick();
+public:
+    static Metrics& global();
+    static uint64_t ticks() {
+#if defined(__x86_64__) || defined(_M_X64)
+        return __rdtsc();
+#else
+        return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+    // Counts one operation; returns its start time if it is to be timed, otherwise 0
+    static uint64_t begin(Metric metric) {
+        Shard* shard = localShard ? localShard : global().registerThread();
+        atomic<uint64_t>& count = shard->counts[(int)metric];
+        count.store(count.load(memory_order_relaxed) + 1, memory_order_relaxed);
+        if (shard->untilSample[(int)metric]-- != 0) {
+            return 0;
+        }
+        shard->untilSample[(int)metric] = SamplePeriod - 1;
+        return ticks();
+    }
+    static void end(Metric metric, uint64_t start) {
+        localShard->histograms[(int)metric].record(ticks() - start);
+    }
+    LatencySummary summary(Metric metric);
+    void report(ostream& out, bool json);
+};
+
+// Times the enclosing block as one operation of the given kind
+class MetricScope {
+private:
+    Metric metric;
+    uint64_t start;
+public:
+    explicit MetricScope(Metric metric) : metric(metric), start(Metrics::begin(metric)) {}
+    ~MetricScope() {
+        if (start != 0) {
+            Metrics::end(metric, start);
+        }
+    }
+};
+
+#if BANK_METRICS
+#define BANK_METRIC_SCOPE(metric) MetricScope metricScope(metric)
+#else
+#define BANK_METRIC_SCOPE(metric)
+#endif
+
+// Durable storage: every change is appended to a write-ahead log, and the bank is periodically
+// written to a snapshot so a restart only replays the log tail.
+// Log record layout: payload size (u32), checksum (u32), LSN (u64), payload.
+uint32_t checksum(const char* data, size_t size);
+void syncFile(FILE* file);
+void syncDirectory(const string& path);
+string& recordBuffer();
+
+template <typename T>
+void putField(string& out, const T& value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+T getField(const char*& in) {
+    T value;
+    memcpy(&value, in, sizeof(T));
+    in += sizeof(T);
+    return value;
+}
+
+void putString(string& out, const string& value);
+string getString(const char*& in);
+
+// Read-only view of a whole file, memory-mapped where the platform supports it
+class MappedFile {
+private:
+    const char* mappedData;
+    size_t mappedSize;
+    vector<char> fallback;
+public:
+    MappedFile(const string& path);
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    const char* data() const {
+        return mappedData;
+    }
+    size_t size() const {
+        return mappedSize;
+    }
+};
+
+// Buffers records and makes each group durable with one fwrite + fsync (group commit)
+class WriteAheadLog {
+private:
+    string path;
+    FILE* file;
+    string pending;
+    size_t pendingRecords;
+    size_t groupSize;
+    uint64_t nextLsn;
+    mutex lock;
+    void writePending();
+public:
+    WriteAheadLog(const string& path, uint64_t nextLsn, size_t groupSize);
+    ~WriteAheadLog();
+    bool isOpen() const {
+        return file != nullptr;
+    }
+    uint64_t append(string_view payload);
+    void commit();
+    void reset();
+    uint64_t lastLsn();
+    static uint64_t replay(const string& path, uint64_t afterLsn, const function<void(const char*, size_t)>& apply);
+};
+
+// Change record payload: type, account number (i32), amount in cents (i64), counterparty (i32),
+// then the count (u8) and ids (i32) of the history entries the change added, so a replay
+// gives them the same ids. Records written before the ids were logged end at the counterparty.
+enum class LogRecordType : uint8_t {
+    AddAccount = 1,
+    Deposit,
+    Withdrawal,
+    Transfer,
+    ApplyLoan,
+    PayLoan,
+    MakeLoanPayment,
+    MonthEnd
+};
+
+const uint32_t snapshotMagic = 0x36534152; // "RAS6"
+
+// Columnar dataset files, for loading and exporting a whole bank in bulk.
+// Layout: magic (u32), version (u32), then row groups. A group header gives the table, the row
+// count and the byte size of each column; the columns follow back to back, each padded to a
+// multiple of 8 bytes so a mapped file can be read in place. A string column is stored as two:
+// u32 end offsets, then the concatenated bytes.
+//   Accounts:     number i32, balance i64, loan amount i64, months paid i32, total months i32,
+//                 loan taker u8, name, type (all amounts in cents)
+//   Transactions: account number i32, type u8, amount i64; each account's entries oldest first
+enum class DatasetTable : uint32_t {
+    Accounts = 1,
+    Transactions
+};
+
+struct DatasetGroupHeader {
+    DatasetTable table;
+    uint32_t rowCount;
+    uint32_t columnCount;
+    uint32_t reserved; // then columnCount u64 column sizes
+};
+
+const uint32_t datasetMagic = 0x4c4f4352; // "RCOL"
+
+span<const uint8_t> datasetSchema(DatasetTable table);
+
+struct AccountRow {
+    int accountNumber;
+    string_view name;
+    string_view type;
+    Money balance;
+    bool isLoanTaker;
+    Money loanAmount;
+    int monthsPaid;
+    int totalMonths;
+};
+
+// Streams rows into a dataset file. Rows are buffered per table and written as a row group
+// whenever GroupRows of them have built up, so memory use does not grow with the file.
+class DatasetWriter {
+private:
+    FILE* file;
+    bool failed;
+    uint64_t rows;
+    vector<int32_t> accountNumbers;
+    vector<int64_t> balances;
+    vector<int64_t> loanAmounts;
+    vector<int32_t> monthsPaid;
+    vector<int32_t> totalMonths;
+    vector<uint8_t> loanTakers;
+    vector<uint32_t> nameEnds;
+    string names;
+    vector<uint32_t> typeEnds;
+    string types;
+    vector<int32_t> entryAccounts;
+    vector<uint8_t> entryTypes;
+    vector<int64_t> entryAmounts;
+    void writeGroup(DatasetTable table, size_t rowCount, initializer_list<string_view> columns);
+    void flushAccounts();
+    void flushTransactions();
+public:
+    static constexpr size_t GroupRows = 65536;
+    explicit DatasetWriter(const string& path);
+    ~DatasetWriter() {
+        close();
+    }
+    DatasetWriter(const DatasetWriter&) = delete;
+    DatasetWriter& operator=(const DatasetWriter&) = delete;
+    bool isOpen() const {
+        return file != nullptr;
+    }
+    void addAccount(const AccountRow& account);
+    void addTransaction(int accountNumber, TransactionType type, Money amount);
+    uint64_t rowCount() const {
+        return rows;
+    }
+    bool close();
+};
+
+// One row group, pointing straight into the mapped file
+struct DatasetGroup {
+    DatasetTable table;
+    uint32_t rowCount;
+    vector<string_view> columns;
+
+    template <typename T>
+    span<const T> column(size_t index) const {
+        return {reinterpret_cast<const T*>(columns[index].data()), rowCount};
+    }
+    string_view text(size_t endsColumn, uint32_t row) const;
+};
+
+// Maps a dataset file and checks every group header and string column up front, so readers
+// can index the columns without further bounds checks
+class DatasetReader {
+private:
+    MappedFile file;
+    vector<DatasetGroup> groups;
+    uint64_t rows;
+    bool valid;
+public:
+    explicit DatasetReader(const string& path);
+    bool isValid() const {
+        return valid;
+    }
+    const vector<DatasetGroup>& getGroups() const {
+        return groups;
+    }
+    uint64_t rowCount() const {
+        return rows;
+    }
 };
 
 class Account {
@@ -28,364 +601,3448 @@ private:
     string name;
     int accountNumber;
     string accountType;
-    double balance;
-    vector<Transaction> transactions;
+    Money balance;
+    TransactionHistory transactions;
     bool isLoanTaker;
-    double loanAmount;
+    Money loanAmount;
     int monthsPaid;
     int totalMonths;
+    uint32_t row;   // this account's row in the bank's AccountColumns, set by Bank::appendRow
 public:
-    Account(const string& n, int number, const string& type, double initialBalance)
-        : name(n), accountNumber(number), accountType(type), balance(initialBalance),
-          isLoanTaker(false), loanAmount(0), monthsPaid(0), totalMonths(12) {}
-    void deposit(double amount);
-    bool withdraw(double amount);
-    void addTransaction(const Transaction& transaction);
+    Account(string n, int number, string type, Money initialBalance, HistoryStore& history)
+        : name(move(n)), accountNumber(number), accountType(move(type)), balance(initialBalance), transactions(history),
+          isLoanTaker(false), loanAmount(), monthsPaid(0), totalMonths(12), row(0) {}
+    OpStatus deposit(Money amount, EventSink& sink);
+    OpStatus withdraw(Money amount, EventSink& sink);
     void displayInfo();
-    void applyLoan(double amount);
-    void payLoan();
+    OpStatus applyLoan(Money amount, EventSink& sink);
+    OpStatus payLoan(EventSink& sink);
     int getAccountNumber();
-    vector<Transaction>& getTransactions() {
+    Money getBalance();
+    TransactionHistory& getTransactions() {
         return transactions;
     }
-    void makeLoanPayment();
-    double getRemainingLoan();
+    bool makeLoanPayment();
+    Money getMonthlyPayment();
+    Money getRemainingLoan();
     bool getIsLoanTaker();
-    string getName();
+    const string& getName() const;
+    const string& getAccountType() const;
     int getMonthsPaid();
     int getTotalMonths();
+    friend class Bank;
+};
+
+// Names an account in an AccountTable: its slot, and the slot's generation when the account was
+// placed there
+struct AccountHandle {
+    uint32_t slot = UINT32_MAX;
+    uint32_t generation = 0;
+};
+
+// Slot map of accounts. Accounts live in fixed-size chunks that are never moved or reallocated,
+// so adding an account copies nothing and an Account& stays valid until that account is erased.
+// A slot's generation is odd while it holds an account and is bumped when the account is
+// erased, so a handle to an erased account resolves to nullptr instead of to whichever account
+// reuses the slot.
+class AccountTable {
+public:
+    static constexpr size_t ChunkSize = 1024;
+private:
+    struct Chunk {
+        alignas(Account) unsigned char bytes[ChunkSize * sizeof(Account)];
+    };
+    vector<unique_ptr<Chunk>> chunks;
+    vector<uint32_t> generations;
+    vector<uint32_t> freeSlots;
+    size_t liveCount;
+    Account* slotAddress(uint32_t slot) {
+        return reinterpret_cast<Account*>(chunks[slot / ChunkSize]->bytes) + slot % ChunkSize;
+    }
+public:
+    class Iterator {
+    private:
+        AccountTable* table;
+        uint32_t slot;
+        void skipFree() {
+            while (slot < table->slotCount() && !table->isLive(slot)) {
+                ++slot;
+            }
+        }
+    public:
+        Iterator(AccountTable* table, uint32_t slot) : table(table), slot(slot) {
+            skipFree();
+        }
+        Account& operator*() const {
+            return (*table)[slot];
+        }
+        Iterator& operator++() {
+            ++slot;
+            skipFree();
+            return *this;
+        }
+        bool operator!=(const Iterator& other) const {
+            return slot != other.slot;
+        }
+    };
+
+    AccountTable() : liveCount(0) {}
+    ~AccountTable();
+    AccountTable(const AccountTable&) = delete;
+    AccountTable& operator=(const AccountTable&) = delete;
+    template <typename... Args>
+    AccountHandle emplace(Args&&... args);
+    void erase(AccountHandle handle);
+    Account* get(AccountHandle handle) {
+        bool current = handle.slot < generations.size() && generations[handle.slot] == handle.generation;
+        return current && isLive(handle.slot) ? slotAddress(handle.slot) : nullptr;
+    }
+    // The account in a slot that holds one
+    Account& operator[](uint32_t slot) {
+        return *slotAddress(slot);
+    }
+    AccountHandle handleAt(uint32_t slot) const {
+        return {slot, generations[slot]};
+    }
+    bool isLive(uint32_t slot) const {
+        return generations[slot] % 2 == 1;
+    }
+    size_t slotCount() const {
+        return generations.size();
+    }
+    size_t size() const {
+        return liveCount;
+    }
+    bool empty() const {
+        return liveCount == 0;
+    }
+    void reserve(size_t count) {
+        chunks.reserve((count + ChunkSize - 1) / ChunkSize);
+        generations.reserve(count);
+    }
+    Iterator begin() {
+        return Iterator(this, 0);
+    }
+    Iterator end() {
+        return Iterator(this, (uint32_t)slotCount());
+    }
+};
+
+template <typename... Args>
+AccountHandle AccountTable::emplace(Args&&... args) {
+    uint32_t slot;
+    if (!freeSlots.empty()) {
+        slot = freeSlots.back();
+        new (slotAddress(slot)) Account(forward<Args>(args)...);
+        freeSlots.pop_back();
+    } else {
+        slot = (uint32_t)generations.size();
+        if (slot % ChunkSize == 0) {
+            chunks.push_back(unique_ptr<Chunk>(new Chunk));
+        }
+        new (slotAddress(slot)) Account(forward<Args>(args)...);
+        generations.push_back(0);
+    }
+    ++generations[slot];
+    ++liveCount;
+    return {slot, generations[slot]};
+}
+
+// Hot account fields kept column by column (one contiguous array per field, one row per
+// account) so bulk queries stream through only the bytes they need. The kernels are plain
+// branch-free loops over these arrays, which the compiler turns into SIMD code.
+class AccountColumns {
+private:
+    vector<int32_t> accountNumbers;
+    vector<int64_t> balances;      // cents
+    vector<int64_t> loanAmounts;   // cents
+    vector<int64_t> remainingLoans; // cents
+    vector<int32_t> monthsPaid;
+    vector<uint8_t> loanTakers;
+public:
+    void reserve(size_t rows);
+    void append(int accountNumber, Money balance);
+    void update(size_t row, Money balance, bool isLoanTaker, Money loanAmount, Money remainingLoan, int paid);
+    size_t size() const {
+        return balances.size();
+    }
+    int accountNumberAt(size_t row) const {
+        return accountNumbers[row];
+    }
+    Money balanceAt(size_t row) const {
+        return Money::fromCents(balances[row]);
+    }
+    Money remainingLoanAt(size_t row) const {
+        return Money::fromCents(remainingLoans[row]);
+    }
+    bool isLoanTakerAt(size_t row) const {
+        return loanTakers[row];
+    }
+    Money totalBalance() const;
+    size_t countBelow(Money threshold) const;
+    size_t selectBelow(Money threshold, vector<uint32_t>& rows) const;
+    size_t selectLoanTakers(vector<uint32_t>& rows) const;
+};
+
+struct LoanShortfall {
+    int accountNumber;
+    Money due;
+    Money balance;
+};
+
+// Outcome of one month-end run. Shortfalls are listed in account order, whatever the shard count.
+struct MonthEndReport {
+    size_t loanTakers = 0;
+    size_t charged = 0;
+    size_t paidOff = 0;   // loan takers with every instalment already paid
+    Money collected;
+    vector<LoanShortfall> shortfalls;
 };
 
 class Bank {
 private:
-    vector<Account> accounts;
+    HistoryStore history;   // spilled transactions of every account
+    AccountTable accounts;   // accounts are never erased, so slot i is also row i of columns
+    AccountColumns columns;  // row i mirrors accounts[i]; refreshed by every Bank operation
+    // Kept up to date by refreshRow, so reports never scan every account
+    unordered_map<int, uint32_t> rowsByNumber;      // first account with each number
+    unordered_map<string, size_t> accountsByType;
+    vector<uint32_t> loanTakerRows;                 // in loan approval order
+    atomic<int64_t> totalBalanceCents;
+    atomic<int64_t> outstandingLoanCents;
+    EventSink* sink;
+    static NullSink nullSink;
+    unique_ptr<WriteAheadLog> wal;
+    string storagePath;
+    uint64_t checkpointLsn;
+    uint64_t checkpointInterval;
+    void logChange(LogRecordType type, int accountNumber, Money amount, int counterparty = 0,
+                   initializer_list<int> ids = {});
+    int applyLogRecord(const char* data, size_t size);
+    MonthEndReport runMonthEnd(unsigned shardCount, int firstId);
+    uint64_t loadSnapshot(const string& path, uint64_t& historySize);
+    void writeSnapshot(const string& path, uint64_t lsn);
+    void appendRow(Account& account);
+    void refreshRow(Account& account);
 public:
-    void addAccount(const string& name, int number, const string& type, double initialBalance);
+    Bank() : totalBalanceCents(0), outstandingLoanCents(0), sink(&nullSink), checkpointLsn(0), checkpointInterval(100000) {}
+    ~Bank() {
+        sync();
+    }
+    void setEventSink(EventSink* eventSink) {
+        sink = eventSink ? eventSink : &nullSink;
+    }
+    EventSink& getEventSink() {
+        return *sink;
+    }
+    void addAccount(string name, int number, string type, Money initialBalance);
     Account* findAccount(int accountNumber);
-    void transfer(Account& fromAccount, Account& toAccount, double amount);
+    AccountHandle findHandle(int accountNumber);
+    Account* getAccount(AccountHandle handle) {
+        return accounts.get(handle);
+    }
+    OpStatus transfer(Account& fromAccount, Account& toAccount, Money amount);
+    OpStatus deposit(Account& account, Money amount);
+    OpStatus withdraw(Account& account, Money amount);
+    OpStatus applyLoan(Account& account, Money amount);
+    OpStatus payLoan(Account& account);
+    bool makeLoanPayment(Account& account);
+    MonthEndReport runMonthEnd(unsigned shardCount = 0);
+    void reserve(size_t accountCount) {
+        accounts.reserve(accountCount);
+        columns.reserve(accountCount);
+        rowsByNumber.reserve(accountCount);
+    }
+    bool openStorage(const string& basePath, size_t groupSize = 64);
+    void setCheckpointInterval(uint64_t records) {
+        checkpointInterval = records;
+    }
+    void sync();
+    void checkpoint();
+    uint64_t exportDataset(const string& path);
+    uint64_t importDataset(const DatasetReader& dataset);
+    size_t accountCount() const {
+        return accounts.size();
+    }
+    // Visits every account in table order, without a lookup per account
+    template <typename Visit>
+    void forEachAccount(Visit visit) {
+        for (Account& account : accounts) {
+            visit(account);
+        }
+    }
+    // Bytes of transaction history spilled to the history file so far
+    uint64_t spilledHistoryBytes() {
+        return history.size();
+    }
+    const AccountColumns& getColumns() const {
+        return columns;
+    }
+    Money totalBalance() const {
+        return Money::fromCents(totalBalanceCents.load(memory_order_relaxed));
+    }
+    Money outstandingLoans() const {
+        return Money::fromCents(outstandingLoanCents.load(memory_order_relaxed));
+    }
+    size_t loanTakerCount() const {
+        return loanTakerRows.size();
+    }
+    size_t accountsOfType(const string& type) const;
     void displayAllAccounts();
     void displayAccountDetails(int accountNumber);
     void displayLoanTakers();
+    void displaySummary();
+    friend class ConcurrentTransferEngine;
 };
 
-void Account::deposit(double amount) {
-    balance += amount;
-    Transaction transaction(transactions.size() + 1, "Deposit", amount);
-    transactions.push_back(transaction);
-    cout << "Deposit successful." << endl;
-}
-bool Account::withdraw(double amount) {
-    if (balance >= amount) {
-        balance -= amount;
-        Transaction transaction(transactions.size() + 1, "Withdrawal", amount);
-        transactions.push_back(transaction);
-        cout << "Withdrawal successful." << endl;
-        return true;
+// Runs Bank::transfer from many threads at once. The account list must not change while the
+// engine is in use, and the bank's event sink must be safe to call concurrently (e.g. NullSink).
+// Each account gets its own mutex; both are locked in account-number order.
+class ConcurrentTransferEngine {
+private:
+    struct Slot {
+        Account* account;
+        mutex* lock;
+    };
+    Bank& bank;
+    unique_ptr<mutex[]> accountLocks;
+    unordered_map<int, Slot> slots;
+    vector<int> lockOrder;
+    Money expectedTotal;
+public:
+    ConcurrentTransferEngine(Bank& bank);
+    OpStatus transfer(int fromAccountNumber, int toAccountNumber, Money amount);
+    Money totalBalance();
+    bool checkConservation();
+};
+
+NullSink Bank::nullSink;
+
+void ConsoleSink::onEvent(const Event& event) {
+    switch (event.type) {
+        case EventType::AccountCreated:
+            out << "Account created successfully." << '\n';
+            break;
+        case EventType::Deposit:
+            if (event.status == OpStatus::Success) {
+                out << "Deposit successful." << '\n';
+            } else {
+                out << "Invalid deposit amount." << '\n';
+            }
+            break;
+        case EventType::Withdrawal:
+            if (event.status == OpStatus::Success) {
+                out << "Withdrawal successful." << '\n';
+            } else if (event.status == OpStatus::InvalidAmount) {
+                out << "Invalid withdrawal amount." << '\n';
+            } else {
+                out << "Insufficient balance." << '\n';
+            }
+            break;
+        case EventType::Transfer:
+            if (event.status == OpStatus::Success) {
+                out << "Transfer successful." << '\n';
+            } else {
+                out << "Transfer failed." << '\n';
+            }
+            break;
+        case EventType::LoanApproved:
+            if (event.status == OpStatus::Success) {
+                out << "Loan approved. Loan amount: " << event.amount << '\n';
+                out << "Loan will be paid in 12 months with 5% interest each month." << '\n';
+            } else {
+                out << "Cannot apply for a loan." << '\n';
+            }
+            break;
+        case EventType::LoanPayment:
+            if (event.status == OpStatus::Success) {
+                out << "Loan payment successful. Remaining balance: " << event.balance << '\n';
+            } else if (event.status == OpStatus::LoanPaidOff) {
+                out << "Loan paid off." << '\n';
+            } else {
+                out << "Insufficient balance for loan payment." << '\n';
+            }
+            break;
     }
-    cout << "Insufficient balance." << endl;
-    return false;
 }
-void Account::addTransaction(const Transaction& transaction) {
-    transactions.push_back(transaction);
+
+void BufferedBinarySink::onEvent(const Event& event) {
+    if (buffer.size() == buffer.capacity()) {
+        flush();
+    }
+    buffer.push_back(event);
 }
-void Account::displayInfo() {
-    cout << "Account Holder: " << name << endl;
-    cout << "Account Number: " << accountNumber << endl;
-    cout << "Account Type: " << accountType << endl;
-    cout << "Balance: " << balance << endl;
+
+void BufferedBinarySink::flush() {
+    out.write(reinterpret_cast<const char*>(buffer.data()), buffer.size() * sizeof(Event));
+    buffer.clear();
 }
-void Account::applyLoan(double amount) {
-    if (!isLoanTaker && balance >= amount) {
-        balance -= amount;
-        isLoanTaker = true;
-        loanAmount = amount;
-        Transaction transaction(transactions.size() + 1, "Loan", amount);
-        transactions.push_back(transaction);
-        cout << "Loan approved. Loan amount: " << amount << endl;
-        cout << "Loan will be paid in 12 months with 5% interest each month." << endl;
-    } else {
-        cout << "Cannot apply for a loan." << endl;
+
+// Rounds to the nearest cent
+Money Money::fromDouble(double value) {
+    double scaled = value * 100.0;
+    if (!(scaled > -9.2e18 && scaled < 9.2e18)) {
+        throw overflow_error("money amount out of range");
     }
+    return Money(llround(scaled));
 }
-void Account::payLoan() {
-    double monthlyPayment = loanAmount * 0.05;
-    if (monthsPaid < totalMonths) {
-        if (balance >= monthlyPayment) {
-            balance -= monthlyPayment;
-            Transaction transaction(transactions.size() + 1, "Loan Payment", monthlyPayment);
-            transactions.push_back(transaction);
-            cout << "Loan payment successful. Remaining balance: " << balance << endl;
-            monthsPaid++;
+Money Money::operator+(Money other) const {
+    int64_t result;
+    if (__builtin_add_overflow(cents, other.cents, &result)) {
+        throw overflow_error("money overflow");
+    }
+    return Money(result);
 }
-        else
-            {
-            cout << "Insufficient balance for loan payment." << endl;
+Money Money::operator-(Money other) const {
+    int64_t result;
+    if (__builtin_sub_overflow(cents, other.cents, &result)) {
+        throw overflow_error("money overflow");
+    }
+    return Money(result);
 }
-}   else
-{
-        cout << "Loan paid off." << endl;
+bool Money::canAdd(Money other) const {
+    int64_t result;
+    return !__builtin_add_overflow(cents, other.cents, &result);
 }
+Money Money::operator*(int64_t factor) const {
+    int64_t result;
+    if (__builtin_mul_overflow(cents, factor, &result)) {
+        throw overflow_error("money overflow");
+    }
+    return Money(result);
 }
-int Account::getAccountNumber() {
-    return accountNumber;
+// rate% of this amount, rounded half away from zero
+Money Money::percent(int64_t rate) const {
+    int64_t scaled = (*this * rate).cents;
+    return Money(scaled / 100 + (scaled % 100 >= 50) - (scaled % 100 <= -50));
 }
-void Account::makeLoanPayment() {
-    if (isLoanTaker) {
-        double monthlyPayment = loanAmount * 0.05;
-        if (monthsPaid < totalMonths) {
-            if (balance >= monthlyPayment) {
-                balance -= monthlyPayment;
-                monthsPaid++;
+ostream& operator<<(ostream& out, Money money) {
+    int64_t cents = money.minorUnits();
+    uint64_t magnitude = cents < 0 ? 0 - (uint64_t)cents : cents;
+    if (cents < 0) {
+        out << '-';
+    }
+    out << magnitude / 100 << '.' << (char)('0' + magnitude % 100 / 10) << (char)('0' + magnitude % 10);
+    return out;
 }
+// Reads a decimal amount such as 12.5; fails the stream if it is out of range
+istream& operator>>(istream& in, Money& money) {
+    double value;
+    if (in >> value) {
+        if (value > -9.2e16 && value < 9.2e16) {
+            money = Money::fromDouble(value);
+        } else {
+            in.setstate(ios::failbit);
+        }
+    }
+    return in;
 }
+
+uint32_t checksum(const char* data, size_t size) {
+    uint32_t hash = 2166136261u; // FNV-1a
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ (unsigned char)data[i]) * 16777619u;
+    }
+    return hash;
 }
+
+// Scratch string for building one log record. Each thread reuses its own, so logging a hot-path
+// operation does not allocate.
+string& recordBuffer() {
+    static thread_local string record;
+    record.clear();
+    return record;
 }
-double Account::getRemainingLoan() {
-    double remainingAmount = loanAmount - (loanAmount * 0.05 * monthsPaid);
-    return remainingAmount > 0 ? remainingAmount : 0;
+
+void syncFile(FILE* file) {
+    fflush(file);
+#ifdef _WIN32
+    _commit(_fileno(file));
+#else
+    fsync(fileno(file));
+#endif
 }
 
-bool Account::getIsLoanTaker() {
-    return isLoanTaker;
+// Makes a rename or a new file in the directory holding path durable; Windows has no equivalent
+void syncDirectory(const string& path) {
+#ifndef _WIN32
+    string directory = filesystem::path(path).parent_path().string();
+    int fd = open(directory.empty() ? "." : directory.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+#endif
 }
 
-string Account::getName() {
-    return name;
+void putString(string& out, const string& value) {
+    putField(out, (uint32_t)value.size());
+    out += value;
 }
 
-int Account::getMonthsPaid() {
-    return monthsPaid;
+string getString(const char*& in) {
+    uint32_t length = getField<uint32_t>(in);
+    string value(in, length);
+    in += length;
+    return value;
+}
+
+MappedFile::MappedFile(const string& path) : mappedData(nullptr), mappedSize(0) {
+#ifdef _WIN32
+    ifstream in(path, ios::binary);
+    if (in) {
+        fallback.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+        mappedData = fallback.data();
+        mappedSize = fallback.size();
+    }
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+    struct stat info;
+    if (fstat(fd, &info) == 0 && info.st_size > 0) {
+        void* address = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (address != MAP_FAILED) {
+            mappedData = static_cast<const char*>(address);
+            mappedSize = info.st_size;
+        }
+    }
+    close(fd);
+#endif
+}
+
+MappedFile::~MappedFile() {
+#ifndef _WIN32
+    if (mappedData) {
+        munmap(const_cast<char*>(mappedData), mappedSize);
+    }
+#endif
+}
+
+thread_local Metrics::Shard* Metrics::localShard = nullptr;
+
+atomic<int> IdService::serviceCount(0);
+thread_local IdService::Block IdService::blocks[IdService::MaxServices];
+IdService Transaction::ids(1);
+
+Metrics::Metrics() : startTicks(ticks()), startTime(chrono::steady_clock::now()) {}
+
+Metrics::~Metrics() {
+    const char* path = getenv("BANK_METRICS_REPORT");
+    if (path == nullptr || *path == '\0') {
+        return;
+    }
+    string target = path;
+    bool json = target.size() >= 5 && target.compare(target.size() - 5, 5, ".json") == 0;
+    if (target == "-") {
+        report(cout, json);
+    } else {
+        ofstream out(target);
+        report(out, json);
+    }
+}
+
+Metrics& Metrics::global() {
+    static Metrics metrics;
+    return metrics;
+}
+
+Metrics::Shard* Metrics::registerThread() {
+    lock_guard<mutex> guard(lock);
+    shards.push_back(make_unique<Shard>());
+    localShard = shards.back().get();
+    return localShard;
+}
+
+// Timestamp-counter rate, measured against the steady clock over the life of the process
+double Metrics::nanosecondsPerTick() {
+#if defined(__x86_64__) || defined(_M_X64)
+    chrono::duration<double, nano> elapsed = chrono::steady_clock::now() - startTime;
+    if (elapsed.count() < 1e7) {
+        this_thread::sleep_for(chrono::milliseconds(10));
+        elapsed = chrono::steady_clock::now() - startTime;
+    }
+    return elapsed.count() / (double)max<uint64_t>(ticks() - startTicks, 1);
+#else
+    return 1;
+#endif
+}
+
+LatencySummary Metrics::summary(Metric metric) {
+    vector<uint64_t> counts(LatencyHistogram::BucketCount);
+    uint64_t total = 0;
+    LatencySummary result;
+    {
+        lock_guard<mutex> guard(lock);
+        for (const unique_ptr<Shard>& shard : shards) {
+            const LatencyHistogram& histogram = shard->histograms[(int)metric];
+            for (int bucket = 0; bucket < LatencyHistogram::BucketCount; ++bucket) {
+                counts[bucket] += histogram.countAt(bucket);
+            }
+            total += histogram.total();
+            result.count += shard->counts[(int)metric].load(memory_order_relaxed);
+        }
+    }
+    uint64_t sampled = 0;
+    for (uint64_t count : counts) {
+        sampled += count;
+    }
+    if (sampled == 0) {
+        return result;
+    }
+    double scale = nanosecondsPerTick();
+    result.meanNs = total * scale / sampled;
+    // Each percentile is reported as the start of the bucket holding that rank
+    double* targets[] = {&result.p50Ns, &result.p99Ns, &result.p999Ns};
+    double fractions[] = {0.5, 0.99, 0.999};
+    uint64_t seen = 0;
+    int next = 0;
+    for (int bucket = 0; bucket < LatencyHistogram::BucketCount; ++bucket) {
+        if (counts[bucket] == 0) {
+            continue;
+        }
+        seen += counts[bucket];
+        while (next < 3 && seen >= (uint64_t)ceil(fractions[next] * sampled)) {
+            *targets[next++] = LatencyHistogram::bucketStart(bucket) * scale;
+        }
+        result.maxNs = LatencyHistogram::bucketStart(bucket) * scale;
+    }
+    return result;
+}
+
+void Metrics::report(ostream& out, bool json) {
+    if (json) {
+        out << "{\"operations\": [";
+    } else {
+        out << left << setw(14) << "Operation" << right << setw(12) << "Count" << setw(10) << "Mean ns" << setw(10)
+            << "p50 ns" << setw(10) << "p99 ns" << setw(10) << "p999 ns" << setw(10) << "Max ns" << endl;
+    }
+    for (int metric = 0; metric < metricCount; ++metric) {
+        LatencySummary summary = this->summary((Metric)metric);
+        if (json) {
+            out << (metric ? ", " : "") << "{\"name\": \"" << metricNames[metric] << "\", \"count\": " << summary.count
+                << ", \"mean_ns\": " << (uint64_t)summary.meanNs << ", \"p50_ns\": " << (uint64_t)summary.p50Ns
+                << ", \"p99_ns\": " << (uint64_t)summary.p99Ns << ", \"p999_ns\": " << (uint64_t)summary.p999Ns
+                << ", \"max_ns\": " << (uint64_t)summary.maxNs << "}";
+        } else {
+            out << left << setw(14) << metricNames[metric] << right << setw(12) << summary.count << setw(10)
+                << (uint64_t)summary.meanNs << setw(10) << (uint64_t)summary.p50Ns << setw(10) << (uint64_t)summary.p99Ns
+                << setw(10) << (uint64_t)summary.p999Ns << setw(10) << (uint64_t)summary.maxNs << endl;
+        }
+    }
+    if (json) {
+        out << "]}" << endl;
+    }
+}
+
+span<const uint8_t> datasetSchema(DatasetTable table) {
+    // Element width of each column; 0 marks string bytes, whose end offsets are the column before
+    static const uint8_t accounts[] = {4, 8, 8, 4, 4, 1, 4, 0, 4, 0};
+    static const uint8_t transactions[] = {4, 1, 8};
+    switch (table) {
+        case DatasetTable::Accounts:
+            return accounts;
+        case DatasetTable::Transactions:
+            return transactions;
+    }
+    return {};
+}
+
+template <typename T>
+string_view columnBytes(const vector<T>& values) {
+    return string_view(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+}
+
+DatasetWriter::DatasetWriter(const string& path) : file(fopen(path.c_str(), "wb")), failed(false), rows(0) {
+    if (file) {
+        uint32_t header[2] = {datasetMagic, 1};
+        failed = fwrite(header, sizeof(header), 1, file) != 1;
+    }
+}
+
+void DatasetWriter::writeGroup(DatasetTable table, size_t rowCount, initializer_list<string_view> columns) {
+    static const char padding[8] = {};
+    DatasetGroupHeader header = {table, (uint32_t)rowCount, (uint32_t)columns.size(), 0};
+    string sizes;
+    for (string_view column : columns) {
+        putField(sizes, (uint64_t)column.size());
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(sizes.data(), 1, sizes.size(), file) == sizes.size();
+    for (string_view column : columns) {
+        size_t paddingSize = (8 - column.size() % 8) % 8;
+        ok = ok && fwrite(column.data(), 1, column.size(), file) == column.size() &&
+             fwrite(padding, 1, paddingSize, file) == paddingSize;
+    }
+    failed = failed || !ok;
+}
+
+void DatasetWriter::flushAccounts() {
+    if (!accountNumbers.empty()) {
+        writeGroup(DatasetTable::Accounts, accountNumbers.size(),
+                   {columnBytes(accountNumbers), columnBytes(balances), columnBytes(loanAmounts), columnBytes(monthsPaid),
+                    columnBytes(totalMonths), columnBytes(loanTakers), columnBytes(nameEnds), string_view(names),
+                    columnBytes(typeEnds), string_view(types)});
+        accountNumbers.clear();
+        balances.clear();
+        loanAmounts.clear();
+        monthsPaid.clear();
+        totalMonths.clear();
+        loanTakers.clear();
+        nameEnds.clear();
+        names.clear();
+        typeEnds.clear();
+        types.clear();
+    }
+}
+
+void DatasetWriter::flushTransactions() {
+    if (!entryAccounts.empty()) {
+        writeGroup(DatasetTable::Transactions, entryAccounts.size(),
+                   {columnBytes(entryAccounts), columnBytes(entryTypes), columnBytes(entryAmounts)});
+        entryAccounts.clear();
+        entryTypes.clear();
+        entryAmounts.clear();
+    }
+}
+
+void DatasetWriter::addAccount(const AccountRow& account) {
+    accountNumbers.push_back(account.accountNumber);
+    balances.push_back(account.balance.minorUnits());
+    loanAmounts.push_back(account.loanAmount.minorUnits());
+    monthsPaid.push_back(account.monthsPaid);
+    totalMonths.push_back(account.totalMonths);
+    loanTakers.push_back(account.isLoanTaker);
+    names += account.name;
+    nameEnds.push_back((uint32_t)names.size());
+    types += account.type;
+    typeEnds.push_back((uint32_t)types.size());
+    ++rows;
+    // String offsets are 32-bit, so a group also ends once its strings grow large
+    if (accountNumbers.size() == GroupRows || names.size() + types.size() >= (1u << 30)) {
+        flushAccounts();
+    }
+}
+
+void DatasetWriter::addTransaction(int accountNumber, TransactionType type, Money amount) {
+    entryAccounts.push_back(accountNumber);
+    entryTypes.push_back((uint8_t)type);
+    entryAmounts.push_back(amount.minorUnits());
+    ++rows;
+    if (entryAccounts.size() == GroupRows) {
+        flushTransactions();
+    }
+}
+
+// Writes the remaining rows and closes the file; false if any write failed
+bool DatasetWriter::close() {
+    if (file == nullptr) {
+        return false;
+    }
+    flushAccounts();
+    flushTransactions();
+    failed = fclose(file) != 0 || failed;
+    file = nullptr;
+    return !failed;
+}
+
+string_view DatasetGroup::text(size_t endsColumn, uint32_t row) const {
+    span<const uint32_t> ends = column<uint32_t>(endsColumn);
+    uint32_t begin = row == 0 ? 0 : ends[row - 1];
+    return string_view(columns[endsColumn + 1].data() + begin, ends[row] - begin);
+}
+
+DatasetReader::DatasetReader(const string& path) : file(path), rows(0), valid(false) {
+    const char* cursor = file.data();
+    const char* end = cursor + file.size();
+    if (file.size() < 2 * sizeof(uint32_t) || getField<uint32_t>(cursor) != datasetMagic || getField<uint32_t>(cursor) != 1) {
+        return;
+    }
+    while (cursor != end) {
+        if ((size_t)(end - cursor) < sizeof(DatasetGroupHeader)) {
+            return;
+        }
+        DatasetGroupHeader header = getField<DatasetGroupHeader>(cursor);
+        span<const uint8_t> schema = datasetSchema(header.table);
+        if (schema.empty() || header.columnCount != schema.size() || (size_t)(end - cursor) < schema.size() * sizeof(uint64_t)) {
+            return;
+        }
+        const char* sizes = cursor;
+        cursor += schema.size() * sizeof(uint64_t);
+        DatasetGroup group = {header.table, header.rowCount, {}};
+        for (uint8_t width : schema) {
+            uint64_t size = getField<uint64_t>(sizes);
+            uint64_t paddedSize = (size + 7) & ~(uint64_t)7;
+            if (paddedSize < size || paddedSize > (uint64_t)(end - cursor)) {
+                return;
+            }
+            if (width != 0 && size != (uint64_t)group.rowCount * width) {
+                return;
+            }
+            group.columns.emplace_back(cursor, size);
+            cursor += paddedSize;
+            if (width == 0) {
+                // String ends must be ascending and stay inside the bytes column
+                uint32_t previous = 0;
+                for (uint32_t stringEnd : group.column<uint32_t>(group.columns.size() - 2)) {
+                    if (stringEnd < previous || stringEnd > size) {
+                        return;
+                    }
+                    previous = stringEnd;
+                }
+            }
+        }
+        rows += group.rowCount;
+        groups.push_back(move(group));
+    }
+    valid = true;
+}
+
+WriteAheadLog::WriteAheadLog(const string& path, uint64_t nextLsn, size_t groupSize)
+    : path(path), pendingRecords(0), groupSize(max<size_t>(groupSize, 1)), nextLsn(nextLsn) {
+    file = fopen(path.c_str(), "ab");
+}
+
+WriteAheadLog::~WriteAheadLog() {
+    if (file) {
+        commit();
+        fclose(file);
+    }
+}
+
+// Caller holds lock
+void WriteAheadLog::writePending() {
+    if (file && !pending.empty()) {
+        fwrite(pending.data(), 1, pending.size(), file);
+        syncFile(file);
+    }
+    pending.clear();
+    pendingRecords = 0;
+}
+
+uint64_t WriteAheadLog::append(string_view payload) {
+    lock_guard<mutex> guard(lock);
+    uint64_t lsn = nextLsn++;
+    // Built in place in the pending buffer, which keeps its capacity between groups
+    putField(pending, (uint32_t)payload.size());
+    size_t checksumAt = pending.size();
+    putField(pending, (uint32_t)0);
+    putField(pending, lsn);
+    pending += payload;
+    uint32_t sum = checksum(pending.data() + checksumAt + 4, pending.size() - checksumAt - 4);
+    memcpy(&pending[checksumAt], &sum, sizeof(sum));
+    if (++pendingRecords >= groupSize) {
+        writePending();
+    }
+    return lsn;
+}
+
+void WriteAheadLog::commit() {
+    lock_guard<mutex> guard(lock);
+    writePending();
+}
+
+// Empties the log once a snapshot covers it; LSNs keep counting up
+void WriteAheadLog::reset() {
+    lock_guard<mutex> guard(lock);
+    writePending();
+    if (file) {
+        fclose(file);
+    }
+    file = fopen(path.c_str(), "wb");
+    if (file) {
+        syncFile(file); // the truncation must be durable before records land after it
+    }
+}
+
+uint64_t WriteAheadLog::lastLsn() {
+    lock_guard<mutex> guard(lock);
+    return nextLsn - 1;
+}
+
+// Applies every intact record above afterLsn and cuts off a torn tail left by a crash.
+// Returns the highest LSN seen.
+uint64_t WriteAheadLog::replay(const string& path, uint64_t afterLsn, const function<void(const char*, size_t)>& apply) {
+    uint64_t lastLsn = afterLsn;
+    size_t goodBytes = 0;
+    {
+        MappedFile log(path);
+        const char* cursor = log.data();
+        const char* end = log.data() + log.size();
+        while (end - cursor >= 16) {
+            const char* record = cursor;
+            uint32_t size = getField<uint32_t>(cursor);
+            uint32_t sum = getField<uint32_t>(cursor);
+            if ((size_t)(end - cursor) < 8 + (size_t)size || checksum(cursor, 8 + size) != sum) {
+                cursor = record;
+                break;
+            }
+            uint64_t lsn = getField<uint64_t>(cursor);
+            if (lsn > afterLsn) {
+                apply(cursor, size);
+                lastLsn = lsn;
+            }
+            cursor += size;
+        }
+        goodBytes = cursor - log.data();
+        if (goodBytes == log.size()) {
+            return lastLsn;
+        }
+    }
+    filesystem::resize_file(path, goodBytes);
+    return lastLsn;
+}
+
+// A negative amount, or one the balance cannot hold, is refused before anything changes
+OpStatus Account::deposit(Money amount, EventSink& sink) {
+    if (amount < Money() || !balance.canAdd(amount)) {
+        sink.onEvent({EventType::Deposit, OpStatus::InvalidAmount, accountNumber, 0, amount, balance});
+        return OpStatus::InvalidAmount;
+    }
+    balance += amount;
+    transactions.append(TransactionType::Deposit, amount);
+    sink.onEvent({EventType::Deposit, OpStatus::Success, accountNumber, 0, amount, balance});
+    return OpStatus::Success;
+}
+OpStatus Account::withdraw(Money amount, EventSink& sink) {
+    if (amount < Money()) {
+        sink.onEvent({EventType::Withdrawal, OpStatus::InvalidAmount, accountNumber, 0, amount, balance});
+        return OpStatus::InvalidAmount;
+    }
+    if (balance >= amount) {
+        balance -= amount;
+        transactions.append(TransactionType::Withdrawal, amount);
+        sink.onEvent({EventType::Withdrawal, OpStatus::Success, accountNumber, 0, amount, balance});
+        return OpStatus::Success;
+    }
+    sink.onEvent({EventType::Withdrawal, OpStatus::InsufficientBalance, accountNumber, 0, amount, balance});
+    return OpStatus::InsufficientBalance;
+}
+void Account::displayInfo() {
+    cout << "Account Holder: " << name << endl;
+    cout << "Account Number: " << accountNumber << endl;
+    cout << "Account Type: " << accountType << endl;
+    cout << "Balance: " << balance << endl;
+}
+// A loan above a hundredth of the Money range is refused, so its instalments always fit
+OpStatus Account::applyLoan(Money amount, EventSink& sink) {
+    if (amount < Money() || amount > Money::fromCents(INT64_MAX / 100)) {
+        sink.onEvent({EventType::LoanApproved, OpStatus::InvalidAmount, accountNumber, 0, amount, balance});
+        return OpStatus::InvalidAmount;
+    }
+    if (!isLoanTaker && balance >= amount) {
+        balance -= amount;
+        isLoanTaker = true;
+        loanAmount = amount;
+        transactions.append(TransactionType::Loan, amount);
+        sink.onEvent({EventType::LoanApproved, OpStatus::Success, accountNumber, 0, amount, balance});
+        return OpStatus::Success;
+    }
+    sink.onEvent({EventType::LoanApproved, OpStatus::NotEligible, accountNumber, 0, amount, balance});
+    return OpStatus::NotEligible;
+}
+OpStatus Account::payLoan(EventSink& sink) {
+    Money monthlyPayment = getMonthlyPayment();
+    OpStatus status;
+    if (monthsPaid < totalMonths) {
+        if (balance >= monthlyPayment) {
+            balance -= monthlyPayment;
+            transactions.append(TransactionType::LoanPayment, monthlyPayment);
+            monthsPaid++;
+            status = OpStatus::Success;
+}
+        else
+            {
+            status = OpStatus::InsufficientBalance;
+}
+}   else
+{
+        status = OpStatus::LoanPaidOff;
+}
+    sink.onEvent({EventType::LoanPayment, status, accountNumber, 0, monthlyPayment, balance});
+    return status;
+}
+int Account::getAccountNumber() {
+    return accountNumber;
+}
+Money Account::getBalance() {
+    return balance;
+}
+bool Account::makeLoanPayment() {
+    if (isLoanTaker) {
+        Money monthlyPayment = getMonthlyPayment();
+        if (monthsPaid < totalMonths) {
+            if (balance >= monthlyPayment) {
+                balance -= monthlyPayment;
+                monthsPaid++;
+                return true;
+}
+}
+}
+    return false;
+}
+// 5% of the loan each month, rounded to the cent
+Money Account::getMonthlyPayment() {
+    return loanAmount.percent(5);
+}
+Money Account::getRemainingLoan() {
+    Money remainingAmount = loanAmount - getMonthlyPayment() * monthsPaid;
+    return remainingAmount > Money() ? remainingAmount : Money();
+}
+
+bool Account::getIsLoanTaker() {
+    return isLoanTaker;
+}
+
+const string& Account::getName() const {
+    return name;
+}
+const string& Account::getAccountType() const {
+    return accountType;
+}
+
+int Account::getMonthsPaid() {
+    return monthsPaid;
 }
 
 int Account::getTotalMonths() {
     return totalMonths;
 }
 
-void Bank::addAccount(const string& name, int number, const string& type, double initialBalance) {
-    Account account(name, number, type, initialBalance);
-    accounts.push_back(account);
-    cout << "Account created successfully." << endl;
+const char* transactionTypeName(TransactionType type) {
+    switch (type) {
+        case TransactionType::Deposit:
+            return "Deposit";
+        case TransactionType::Withdrawal:
+            return "Withdrawal";
+        case TransactionType::Transfer:
+            return "Transfer";
+        case TransactionType::Loan:
+            return "Loan";
+        case TransactionType::LoanPayment:
+            return "Loan Payment";
+    }
+    return "Unknown";
+}
+
+void putVarint(string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back((char)(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((char)value);
+}
+
+uint64_t getVarint(const char*& in, const char* end) {
+    uint64_t value = 0;
+    for (int shift = 0; in < end && shift < 64; shift += 7) {
+        uint8_t byte = (uint8_t)*in++;
+        value |= (uint64_t)(byte & 0x7f) << shift;
+        if (byte < 0x80) {
+            break;
+        }
+    }
+    return value;
+}
+
+bool seekFile(FILE* file, uint64_t offset) {
+#ifdef _WIN32
+    return _fseeki64(file, (__int64)offset, SEEK_SET) == 0;
+#else
+    return fseeko(file, (off_t)offset, SEEK_SET) == 0;
+#endif
+}
+
+IdService::IdService(int first) : slot(serviceCount++), next(first), epoch(1) {
+    if (slot >= MaxServices) {
+        throw logic_error("too many IdService instances");
+    }
+}
+
+int IdService::allocate() {
+    Block& block = blocks[slot];
+    uint32_t current = epoch.load(memory_order_acquire);
+    if (block.next == block.end || block.epoch != current) {
+        block.next = next.fetch_add(BlockSize, memory_order_relaxed);
+        block.end = block.next + BlockSize;
+        block.epoch = current;
+    }
+    return block.next++;
+}
+
+// Takes count consecutive ids past any block handed out so far and returns the first
+int IdService::reserve(int count) {
+    return next.fetch_add(count, memory_order_relaxed);
+}
+
+// Makes every later id greater than id
+void IdService::advancePast(int id) {
+    int current = next.load(memory_order_relaxed);
+    while (current <= id) {
+        if (next.compare_exchange_weak(current, id + 1, memory_order_relaxed)) {
+            epoch.fetch_add(1, memory_order_release);
+            return;
+        }
+    }
+}
+
+HistoryStore::HistoryStore() : file(tmpfile()), fileSize(0), atEnd(true) {}
+
+HistoryStore::~HistoryStore() {
+    if (file) {
+        fclose(file);
+    }
+}
+
+// Switches to the file at path, keeping only its first validSize bytes
+bool HistoryStore::open(const string& path, uint64_t validSize) {
+    lock_guard<mutex> guard(lock);
+    if (file) {
+        fclose(file);
+    }
+    error_code error;
+    uint64_t existing = filesystem::file_size(path, error);
+    if (error) {
+        file = fopen(path.c_str(), "w+b");
+        fileSize = 0;
+    } else {
+        fileSize = min(existing, validSize);
+        if (existing != fileSize) {
+            filesystem::resize_file(path, fileSize);
+        }
+        file = fopen(path.c_str(), "r+b");
+    }
+    atEnd = false;
+    return file != nullptr;
+}
+
+// Appends one block that links back to head and moves head to it. Returns false, leaving head
+// alone, if the store cannot write the block.
+bool HistoryStore::spill(int64_t& head, const Transaction* entries, size_t count) {
+    lock_guard<mutex> guard(lock);
+    block.clear();
+    putField(block, head);
+    putField(block, entries[0].getSequence());
+    putField(block, (int32_t)entries[0].getId());
+    putField(block, (uint8_t)count);
+    putField(block, (uint16_t)0);
+    size_t headerSize = block.size();
+    int64_t previousId = entries[0].getId();
+    for (size_t i = 0; i < count; ++i) {
+        int64_t idDelta = entries[i].getId() - previousId;
+        int64_t cents = entries[i].getAmount().minorUnits();
+        previousId = entries[i].getId();
+        block.push_back((char)entries[i].getType());
+        putVarint(block, ((uint64_t)idDelta << 1) ^ (uint64_t)(idDelta >> 63));
+        putVarint(block, ((uint64_t)cents << 1) ^ (uint64_t)(cents >> 63));
+    }
+    uint16_t payloadSize = (uint16_t)(block.size() - headerSize);
+    memcpy(&block[headerSize - sizeof(payloadSize)], &payloadSize, sizeof(payloadSize));
+
+    // Seeking flushes the stdio buffer, so it only happens after a load moved the position
+    if (!file || (!atEnd && !seekFile(file, fileSize)) || fwrite(block.data(), 1, block.size(), file) != block.size()) {
+        atEnd = false; // a partial block is overwritten by the next attempt
+        return false;
+    }
+    atEnd = true;
+    head = (int64_t)fileSize;
+    fileSize += block.size();
+    return true;
+}
+
+// Appends the block's entries, oldest first, and returns the offset of the block before it
+int64_t HistoryStore::load(int64_t offset, vector<Transaction>& entries) {
+    lock_guard<mutex> guard(lock);
+    char header[19];
+    atEnd = false;
+    if (!file || !seekFile(file, offset) || fread(header, 1, sizeof(header), file) != sizeof(header)) {
+        return -1;
+    }
+    const char* cursor = header;
+    int64_t previous = getField<int64_t>(cursor);
+    uint32_t firstSequence = getField<uint32_t>(cursor);
+    int64_t id = getField<int32_t>(cursor);
+    uint8_t count = getField<uint8_t>(cursor);
+    uint16_t size = getField<uint16_t>(cursor);
+    string payload(size, '\0');
+    if (fread(payload.data(), 1, size, file) != size) {
+        return -1;
+    }
+    const char* in = payload.data();
+    const char* end = in + size;
+    for (uint8_t i = 0; i < count && in < end; ++i) {
+        TransactionType type = (TransactionType)*in++;
+        uint64_t zigzag = getVarint(in, end);
+        id += (int64_t)(zigzag >> 1) ^ -(int64_t)(zigzag & 1);
+        zigzag = getVarint(in, end);
+        int64_t cents = (int64_t)(zigzag >> 1) ^ -(int64_t)(zigzag & 1);
+        entries.emplace_back((int)id, firstSequence + i, type, Money::fromCents(cents));
+    }
+    return previous;
+}
+
+// Makes every spilled block durable and returns the number of bytes they occupy
+uint64_t HistoryStore::flush() {
+    lock_guard<mutex> guard(lock);
+    if (file) {
+        syncFile(file);
+    }
+    return fileSize;
+}
+
+// Once the ring is full, its oldest SpillBatch entries go to the store as one block
+void TransactionHistory::append(TransactionType type, Money amount) {
+    if (inlineCount == RecentCapacity) {
+        spillOldest();
+    }
+    ++total;
+    recent[(first + inlineCount) % RecentCapacity] = Transaction(total, type, amount);
+    ++inlineCount;
+}
+
+// Gives an entry back the id it was logged with. back counts from the newest entry; the newest
+// RecentCapacity - SpillBatch + 1 entries are always inline.
+void TransactionHistory::restoreId(int id, size_t back) {
+    Transaction& entry = recent[(first + inlineCount + RecentCapacity - 1 - back) % RecentCapacity];
+    entry = Transaction(id, entry.getSequence(), entry.getType(), entry.getAmount());
+}
+
+// Moves the oldest inline batch to the store. If any batch is already waiting in memory, the new
+// one queues behind it and the waiting ones are retried first, so blocks stay in id order.
+void TransactionHistory::spillOldest() {
+    Transaction batch[SpillBatch];
+    for (size_t i = 0; i < SpillBatch; ++i) {
+        batch[i] = recent[(first + i) % RecentCapacity];
+    }
+    first = (first + SpillBatch) % RecentCapacity;
+    inlineCount -= SpillBatch;
+    if (!unspilled) {
+        if (store->spill(spilledHead, batch, SpillBatch)) {
+            return;
+        }
+        unspilled = make_unique<vector<Transaction>>();
+    }
+    unspilled->insert(unspilled->end(), batch, batch + SpillBatch);
+    size_t written = 0;
+    while (written < unspilled->size() && store->spill(spilledHead, unspilled->data() + written, SpillBatch)) {
+        written += SpillBatch;
+    }
+    unspilled->erase(unspilled->begin(), unspilled->begin() + written);
+    if (unspilled->empty()) {
+        unspilled.reset();
+    }
+}
+
+// Pages every spilled block back in, then adds the entries held in memory; oldest first
+vector<Transaction> TransactionHistory::readAll() const {
+    vector<vector<Transaction>> blocks;
+    for (int64_t block = spilledHead; block >= 0;) {
+        blocks.emplace_back();
+        block = store->load(block, blocks.back());
+    }
+    vector<Transaction> entries;
+    entries.reserve(total);
+    for (auto block = blocks.rbegin(); block != blocks.rend(); ++block) {
+        entries.insert(entries.end(), block->begin(), block->end());
+    }
+    if (unspilled) {
+        entries.insert(entries.end(), unspilled->begin(), unspilled->end());
+    }
+    for (size_t i = 0; i < inlineCount; ++i) {
+        entries.push_back(recent[(first + i) % RecentCapacity]);
+    }
+    return entries;
+}
+
+AccountTable::~AccountTable() {
+    for (uint32_t slot = 0; slot < slotCount(); ++slot) {
+        if (isLive(slot)) {
+            slotAddress(slot)->~Account();
+        }
+    }
+}
+
+void AccountTable::erase(AccountHandle handle) {
+    if (Account* account = get(handle)) {
+        account->~Account();
+        ++generations[handle.slot];
+        freeSlots.push_back(handle.slot);
+        --liveCount;
+    }
+}
+
+void AccountColumns::reserve(size_t rows) {
+    accountNumbers.reserve(rows);
+    balances.reserve(rows);
+    loanAmounts.reserve(rows);
+    remainingLoans.reserve(rows);
+    monthsPaid.reserve(rows);
+    loanTakers.reserve(rows);
+}
+
+void AccountColumns::append(int accountNumber, Money balance) {
+    accountNumbers.push_back(accountNumber);
+    balances.push_back(balance.minorUnits());
+    loanAmounts.push_back(0);
+    remainingLoans.push_back(0);
+    monthsPaid.push_back(0);
+    loanTakers.push_back(0);
+}
+
+void AccountColumns::update(size_t row, Money balance, bool isLoanTaker, Money loanAmount, Money remainingLoan, int paid) {
+    balances[row] = balance.minorUnits();
+    loanTakers[row] = isLoanTaker;
+    loanAmounts[row] = loanAmount.minorUnits();
+    remainingLoans[row] = remainingLoan.minorUnits();
+    monthsPaid[row] = paid;
+}
+
+// Summed as raw cents: every balance is a valid Money, and 2^63 cents is far beyond any real bank
+Money AccountColumns::totalBalance() const {
+    const int64_t* balance = balances.data();
+    size_t rows = balances.size();
+    int64_t total = 0;
+    for (size_t i = 0; i < rows; ++i) {
+        total += balance[i];
+    }
+    return Money::fromCents(total);
+}
+
+size_t AccountColumns::countBelow(Money threshold) const {
+    const int64_t* balance = balances.data();
+    size_t rows = balances.size();
+    int64_t limit = threshold.minorUnits();
+    size_t count = 0;
+    for (size_t i = 0; i < rows; ++i) {
+        count += balance[i] < limit;
+    }
+    return count;
+}
+
+// Fills rows with the row index of every account whose balance is below threshold.
+// The matches are counted first to size rows exactly; then each index is written
+// unconditionally and kept only if it matches, so the loop has no branch.
+size_t AccountColumns::selectBelow(Money threshold, vector<uint32_t>& rows) const {
+    const int64_t* balance = balances.data();
+    size_t count = balances.size();
+    int64_t limit = threshold.minorUnits();
+    rows.resize(countBelow(threshold) + 1);
+    uint32_t* out = rows.data();
+    size_t found = 0;
+    for (size_t i = 0; i < count; ++i) {
+        out[found] = (uint32_t)i;
+        found += balance[i] < limit;
+    }
+    rows.pop_back();
+    return found;
+}
+
+size_t AccountColumns::selectLoanTakers(vector<uint32_t>& rows) const {
+    const uint8_t* flag = loanTakers.data();
+    size_t count = loanTakers.size();
+    size_t total = 0;
+    for (size_t i = 0; i < count; ++i) {
+        total += flag[i];
+    }
+    rows.resize(total + 1);
+    uint32_t* out = rows.data();
+    size_t found = 0;
+    for (size_t i = 0; i < count; ++i) {
+        out[found] = (uint32_t)i;
+        found += flag[i];
+    }
+    rows.pop_back();
+    return found;
+}
+
+void Bank::addAccount(string name, int number, string type, Money initialBalance) {
+    Account& account = accounts[accounts.emplace(move(name), number, move(type), initialBalance, history).slot];
+    appendRow(account);
+    if (wal) {
+        string& record = recordBuffer();
+        putField(record, LogRecordType::AddAccount);
+        putField(record, (int32_t)number);
+        putField(record, initialBalance.minorUnits());
+        putString(record, account.name);
+        putString(record, account.accountType);
+        wal->append(record);
+    }
+    sink->onEvent({EventType::AccountCreated, OpStatus::Success, number, 0, initialBalance, initialBalance});
+}
+
+Account* Bank::findAccount(int accountNumber) {
+    BANK_METRIC_SCOPE(Metric::Lookup);
+    auto found = rowsByNumber.find(accountNumber);
+    return found == rowsByNumber.end() ? nullptr : &accounts[found->second];
+}
+
+// A handle stays valid across later insertions, and resolves to nullptr once its account is gone
+AccountHandle Bank::findHandle(int accountNumber) {
+    auto found = rowsByNumber.find(accountNumber);
+    return found == rowsByNumber.end() ? AccountHandle() : accounts.handleAt(found->second);
+}
+
+OpStatus Bank::transfer(Account& fromAccount, Account& toAccount, Money amount) {
+    BANK_METRIC_SCOPE(Metric::Transfer);
+    // Checked up front, so the withdrawal never runs for a deposit that would be refused
+    OpStatus status = toAccount.getBalance().canAdd(amount) ? fromAccount.withdraw(amount, *sink) : OpStatus::InvalidAmount;
+    if (status == OpStatus::Success) {
+        toAccount.deposit(amount, *sink);
+        TransactionHistory& fromHistory = fromAccount.getTransactions();
+        TransactionHistory& toHistory = toAccount.getTransactions();
+        fromHistory.append(TransactionType::Transfer, amount);
+        toHistory.append(TransactionType::Transfer, amount);
+        // Withdrawal, deposit, then the two transfer entries, all four in one history for a self-transfer
+        bool sameAccount = &fromAccount == &toAccount;
+        logChange(LogRecordType::Transfer, fromAccount.getAccountNumber(), amount, toAccount.getAccountNumber(),
+                  {fromHistory.newestId(sameAccount ? 3 : 1), toHistory.newestId(sameAccount ? 2 : 1),
+                   fromHistory.newestId(sameAccount ? 1 : 0), toHistory.newestId()});
+        refreshRow(fromAccount);
+        refreshRow(toAccount);
+    }
+    sink->onEvent({EventType::Transfer, status, fromAccount.getAccountNumber(), toAccount.getAccountNumber(), amount, Money()});
+    return status;
+}
+
+OpStatus Bank::deposit(Account& account, Money amount) {
+    BANK_METRIC_SCOPE(Metric::Deposit);
+    OpStatus status = account.deposit(amount, *sink);
+    if (status == OpStatus::Success) {
+        logChange(LogRecordType::Deposit, account.getAccountNumber(), amount, 0, {account.getTransactions().newestId()});
+        refreshRow(account);
+    }
+    return status;
+}
+
+OpStatus Bank::withdraw(Account& account, Money amount) {
+    BANK_METRIC_SCOPE(Metric::Withdraw);
+    OpStatus status = account.withdraw(amount, *sink);
+    if (status == OpStatus::Success) {
+        logChange(LogRecordType::Withdrawal, account.getAccountNumber(), amount, 0, {account.getTransactions().newestId()});
+        refreshRow(account);
+    }
+    return status;
+}
+
+OpStatus Bank::applyLoan(Account& account, Money amount) {
+    OpStatus status = account.applyLoan(amount, *sink);
+    if (status == OpStatus::Success) {
+        logChange(LogRecordType::ApplyLoan, account.getAccountNumber(), amount, 0, {account.getTransactions().newestId()});
+        refreshRow(account);
+    }
+    return status;
+}
+
+OpStatus Bank::payLoan(Account& account) {
+    BANK_METRIC_SCOPE(Metric::LoanPayment);
+    OpStatus status = account.payLoan(*sink);
+    if (status == OpStatus::Success) {
+        logChange(LogRecordType::PayLoan, account.getAccountNumber(), Money(), 0, {account.getTransactions().newestId()});
+        refreshRow(account);
+    }
+    return status;
+}
+
+bool Bank::makeLoanPayment(Account& account) {
+    BANK_METRIC_SCOPE(Metric::LoanPayment);
+    bool paid = account.makeLoanPayment();
+    if (paid) {
+        logChange(LogRecordType::MakeLoanPayment, account.getAccountNumber(), Money(), 0, {account.getTransactions().newestId()});
+        refreshRow(account);
+    }
+    return paid;
+}
+
+void Bank::appendRow(Account& account) {
+    uint32_t row = (uint32_t)columns.size();
+    account.row = row;
+    columns.append(account.accountNumber, Money());
+    rowsByNumber.emplace(account.accountNumber, row);
+    ++accountsByType[account.accountType];
+    refreshRow(account);
+}
+
+// Copies the account into its column row and folds the difference into the running totals.
+// Safe to call for different accounts at once (transfer engine, month-end shards); a loan
+// approval, which grows loanTakerRows, is not.
+void Bank::refreshRow(Account& account) {
+    size_t row = account.row;
+    Money remainingLoan = account.isLoanTaker ? account.getRemainingLoan() : Money();
+    totalBalanceCents.fetch_add((account.balance - columns.balanceAt(row)).minorUnits(), memory_order_relaxed);
+    outstandingLoanCents.fetch_add((remainingLoan - columns.remainingLoanAt(row)).minorUnits(), memory_order_relaxed);
+    if (account.isLoanTaker && !columns.isLoanTakerAt(row)) {
+        loanTakerRows.push_back((uint32_t)row);
+    }
+    columns.update(row, account.balance, account.isLoanTaker, account.loanAmount, remainingLoan, account.monthsPaid);
+}
+
+size_t Bank::accountsOfType(const string& type) const {
+    auto found = accountsByType.find(type);
+    return found == accountsByType.end() ? 0 : found->second;
+}
+
+// Charges this month's instalment to every loan taker at once. The loan takers are split
+// into contiguous shards processed on their own threads; an account belongs to exactly one
+// shard, and the shard results are merged in order, so the report does not depend on the
+// shard count. Logged as a single record: replaying it against the same state repeats it.
+// No per-account events are sent. Must not run alongside other operations on this bank.
+MonthEndReport Bank::runMonthEnd(unsigned shardCount) {
+    return runMonthEnd(shardCount, 0);
+}
+
+// The instalment charged to the i-th loan taker gets id firstId + i, so the log only needs
+// firstId to restore them all. Zero reserves a fresh range.
+MonthEndReport Bank::runMonthEnd(unsigned shardCount, int firstId) {
+    vector<uint32_t> rows;
+    columns.selectLoanTakers(rows);
+    if (firstId == 0) {
+        firstId = Transaction::ids.reserve((int)rows.size());
+    }
+    if (shardCount == 0) {
+        shardCount = max(1u, thread::hardware_concurrency());
+    }
+    shardCount = (unsigned)min<size_t>(shardCount, max<size_t>(1, rows.size() / 1024));
+
+    vector<MonthEndReport> shards(shardCount);
+    auto runShard = [&](unsigned shard) {
+        MonthEndReport& report = shards[shard];
+        size_t begin = rows.size() * shard / shardCount;
+        size_t end = rows.size() * (shard + 1) / shardCount;
+        for (size_t i = begin; i < end; ++i) {
+            Account& account = accounts[rows[i]];
+            Money due = account.getMonthlyPayment();
+            OpStatus status = account.payLoan(nullSink);
+            if (status == OpStatus::Success) {
+                account.transactions.restoreId(firstId + (int)i);
+                ++report.charged;
+                report.collected += due;
+                refreshRow(account);
+            } else if (status == OpStatus::LoanPaidOff) {
+                ++report.paidOff;
+            } else {
+                report.shortfalls.push_back({account.accountNumber, due, account.balance});
+            }
+        }
+    };
+    vector<thread> workers;
+    for (unsigned shard = 1; shard < shardCount; ++shard) {
+        workers.emplace_back(runShard, shard);
+    }
+    runShard(0);
+    for (thread& worker : workers) {
+        worker.join();
+    }
+
+    MonthEndReport total;
+    total.loanTakers = rows.size();
+    for (MonthEndReport& shard : shards) {
+        total.charged += shard.charged;
+        total.paidOff += shard.paidOff;
+        total.collected += shard.collected;
+        total.shortfalls.insert(total.shortfalls.end(), shard.shortfalls.begin(), shard.shortfalls.end());
+    }
+    logChange(LogRecordType::MonthEnd, 0, total.collected, 0, {firstId});
+    return total;
+}
+
+void Bank::logChange(LogRecordType type, int accountNumber, Money amount, int counterparty, initializer_list<int> ids) {
+    if (wal) {
+        string& record = recordBuffer();
+        putField(record, type);
+        putField(record, (int32_t)accountNumber);
+        putField(record, amount.minorUnits());
+        putField(record, (int32_t)counterparty);
+        putField(record, (uint8_t)ids.size());
+        for (int id : ids) {
+            putField(record, (int32_t)id);
+        }
+        wal->append(record);
+    }
+}
+
+// Re-runs one logged change during recovery; the log is detached, so nothing is logged twice.
+// The entries it adds get back their logged ids. Returns the highest id restored, or 0.
+int Bank::applyLogRecord(const char* data, size_t size) {
+    const char* end = data + size;
+    LogRecordType type = getField<LogRecordType>(data);
+    int accountNumber = getField<int32_t>(data);
+    Money amount = Money::fromCents(getField<int64_t>(data));
+    if (type == LogRecordType::AddAccount) {
+        string name = getString(data);
+        addAccount(move(name), accountNumber, getString(data), amount);
+        return 0;
+    }
+    int counterparty = getField<int32_t>(data);
+    int ids[4] = {};
+    uint8_t idCount = data < end ? getField<uint8_t>(data) : 0;
+    if ((size_t)(end - data) < idCount * sizeof(int32_t) || idCount > std::size(ids)) {
+        idCount = 0;
+    }
+    for (uint8_t i = 0; i < idCount; ++i) {
+        ids[i] = getField<int32_t>(data);
+    }
+    if (type == LogRecordType::MonthEnd) {
+        MonthEndReport report = runMonthEnd(0, ids[0]);
+        return idCount == 1 && report.loanTakers > 0 ? ids[0] + (int)report.loanTakers - 1 : 0;
+    }
+    Account* account = findAccount(accountNumber);
+    if (account == nullptr) {
+        return 0;
+    }
+    OpStatus status = OpStatus::AccountNotFound;
+    Account* toAccount = nullptr;
+    switch (type) {
+        case LogRecordType::Deposit:
+            status = deposit(*account, amount);
+            break;
+        case LogRecordType::Withdrawal:
+            status = withdraw(*account, amount);
+            break;
+        case LogRecordType::Transfer:
+            if ((toAccount = findAccount(counterparty))) {
+                status = transfer(*account, *toAccount, amount);
+            }
+            break;
+        case LogRecordType::ApplyLoan:
+            status = applyLoan(*account, amount);
+            break;
+        case LogRecordType::PayLoan:
+            status = payLoan(*account);
+            break;
+        case LogRecordType::MakeLoanPayment:
+            status = makeLoanPayment(*account) ? OpStatus::Success : OpStatus::InsufficientBalance;
+            break;
+        default:
+            break;
+    }
+    if (status != OpStatus::Success) {
+        return 0;
+    }
+    if (type == LogRecordType::Transfer && idCount == 4) {
+        bool sameAccount = account == toAccount;
+        account->transactions.restoreId(ids[0], sameAccount ? 3 : 1);
+        toAccount->transactions.restoreId(ids[1], sameAccount ? 2 : 1);
+        account->transactions.restoreId(ids[2], sameAccount ? 1 : 0);
+        toAccount->transactions.restoreId(ids[3]);
+    } else if (type != LogRecordType::Transfer && idCount == 1) {
+        account->transactions.restoreId(ids[0]);
+    }
+    return *max_element(ids, ids + 4);
+}
+
+// Walks count snapshot accounts without restoring them; false if any of them runs past end
+bool snapshotAccountsFit(const char* cursor, const char* end, uint32_t count) {
+    const size_t entrySize = sizeof(int32_t) + sizeof(uint32_t) + sizeof(TransactionType) + sizeof(int64_t);
+    auto take = [&](size_t size) {
+        if ((size_t)(end - cursor) < size) {
+            return false;
+        }
+        cursor += size;
+        return true;
+    };
+    auto takeString = [&]() {
+        const char* length = cursor;
+        return take(sizeof(uint32_t)) && take(getField<uint32_t>(length));
+    };
+    for (uint32_t i = 0; i < count; ++i) {
+        if (!take(sizeof(int32_t) + sizeof(int64_t)) || !takeString() || !takeString() ||
+            !take(sizeof(bool) + sizeof(int64_t) + 2 * sizeof(int32_t) + sizeof(uint32_t) + sizeof(int64_t))) {
+            return false;
+        }
+        const char* field = cursor;
+        if (!take(sizeof(uint32_t)) || !take(getField<uint32_t>(field) * entrySize)) {
+            return false;
+        }
+        field = cursor;
+        if (!take(sizeof(uint8_t))) {
+            return false;
+        }
+        uint8_t inlineCount = getField<uint8_t>(field);
+        if (inlineCount > TransactionHistory::RecentCapacity || !take(inlineCount * entrySize)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Snapshot: magic, LSN, valid size of the history file, the next transaction id, account count,
+// checksum of those header fields, then per account its fields, history counters and inline
+// entries; spilled entries stay in the history file
+uint64_t Bank::loadSnapshot(const string& path, uint64_t& historySize) {
+    const size_t headerSize = 28;
+    MappedFile snapshot(path);
+    historySize = 0;
+    if (snapshot.size() < headerSize + sizeof(uint32_t)) {
+        return 0;
+    }
+    const char* cursor = snapshot.data();
+    if (getField<uint32_t>(cursor) != snapshotMagic) {
+        return 0;
+    }
+    uint64_t lsn = getField<uint64_t>(cursor);
+    uint64_t validHistorySize = getField<uint64_t>(cursor);
+    int nextTransactionId = getField<int32_t>(cursor);
+    uint32_t count = getField<uint32_t>(cursor);
+    // The whole file is checked before anything is restored, so a truncated or corrupt one is
+    // rejected as a whole
+    if (getField<uint32_t>(cursor) != checksum(snapshot.data(), headerSize) ||
+        !snapshotAccountsFit(cursor, snapshot.data() + snapshot.size(), count)) {
+        return 0;
+    }
+    historySize = validHistorySize;
+    Transaction::ids.advancePast(nextTransactionId - 1);
+    reserve(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        int number = getField<int32_t>(cursor);
+        Money balance = Money::fromCents(getField<int64_t>(cursor));
+        string name = getString(cursor);
+        string type = getString(cursor);
+        Account& account = accounts[accounts.emplace(move(name), number, move(type), balance, history).slot];
+        account.isLoanTaker = getField<bool>(cursor);
+        account.loanAmount = Money::fromCents(getField<int64_t>(cursor));
+        account.monthsPaid = getField<int32_t>(cursor);
+        account.totalMonths = getField<int32_t>(cursor);
+        appendRow(account);
+        TransactionHistory& transactions = account.transactions;
+        transactions.total = getField<uint32_t>(cursor);
+        transactions.spilledHead = getField<int64_t>(cursor);
+        uint32_t unspilledCount = getField<uint32_t>(cursor);
+        for (uint32_t j = 0; j < unspilledCount; ++j) {
+            if (!transactions.unspilled) {
+                transactions.unspilled = make_unique<vector<Transaction>>();
+            }
+            int id = getField<int32_t>(cursor);
+            uint32_t sequence = getField<uint32_t>(cursor);
+            TransactionType type = getField<TransactionType>(cursor);
+            transactions.unspilled->emplace_back(id, sequence, type, Money::fromCents(getField<int64_t>(cursor)));
+        }
+        transactions.inlineCount = getField<uint8_t>(cursor);
+        for (uint8_t j = 0; j < transactions.inlineCount; ++j) {
+            int id = getField<int32_t>(cursor);
+            uint32_t sequence = getField<uint32_t>(cursor);
+            TransactionType type = getField<TransactionType>(cursor);
+            transactions.recent[j] = Transaction(id, sequence, type, Money::fromCents(getField<int64_t>(cursor)));
+        }
+    }
+    return lsn;
+}
+
+// Written to a temporary file and renamed into place, so a crash leaves the old snapshot intact
+void Bank::writeSnapshot(const string& path, uint64_t lsn) {
+    string data;
+    putField(data, snapshotMagic);
+    putField(data, lsn);
+    putField(data, history.flush());
+    putField(data, (int32_t)Transaction::ids.upperBound());
+    putField(data, (uint32_t)accounts.size());
+    putField(data, checksum(data.data(), data.size()));
+    for (Account& account : accounts) {
+        putField(data, (int32_t)account.accountNumber);
+        putField(data, account.balance.minorUnits());
+        putString(data, account.name);
+        putString(data, account.accountType);
+        putField(data, account.isLoanTaker);
+        putField(data, account.loanAmount.minorUnits());
+        putField(data, (int32_t)account.monthsPaid);
+        putField(data, (int32_t)account.totalMonths);
+        TransactionHistory& transactions = account.transactions;
+        putField(data, transactions.total);
+        putField(data, transactions.spilledHead);
+        putField(data, (uint32_t)(transactions.unspilled ? transactions.unspilled->size() : 0));
+        if (transactions.unspilled) {
+            for (const Transaction& transaction : *transactions.unspilled) {
+                putField(data, (int32_t)transaction.getId());
+                putField(data, transaction.getSequence());
+                putField(data, transaction.getType());
+                putField(data, transaction.getAmount().minorUnits());
+            }
+        }
+        putField(data, transactions.inlineCount);
+        for (size_t j = 0; j < transactions.inlineCount; ++j) {
+            const Transaction& transaction = transactions.recent[(transactions.first + j) % TransactionHistory::RecentCapacity];
+            putField(data, (int32_t)transaction.getId());
+            putField(data, transaction.getSequence());
+            putField(data, transaction.getType());
+            putField(data, transaction.getAmount().minorUnits());
+        }
+    }
+    string temporaryPath = path + ".tmp";
+    FILE* file = fopen(temporaryPath.c_str(), "wb");
+    if (file) {
+        fwrite(data.data(), 1, data.size(), file);
+        syncFile(file);
+        fclose(file);
+        filesystem::rename(temporaryPath, path);
+        syncDirectory(path);
+    }
+}
+
+// Restores <basePath>.snap plus the tail of <basePath>.wal, then logs every change from here on.
+// Spilled history lives in <basePath>.hist; anything past the snapshot's view of it is cut
+// off and rebuilt by the log replay. Call once, before any account is added.
+bool Bank::openStorage(const string& basePath, size_t groupSize) {
+    storagePath = basePath;
+    EventSink* userSink = sink;
+    sink = &nullSink;
+    uint64_t historySize;
+    checkpointLsn = loadSnapshot(basePath + ".snap", historySize);
+    history.open(basePath + ".hist", historySize);
+    // Ids are only pushed past once the whole tail is replayed, as each push drops the id blocks taken so far
+    int lastId = 0;
+    uint64_t lastLsn = WriteAheadLog::replay(basePath + ".wal", checkpointLsn, [this, &lastId](const char* data, size_t size) {
+        lastId = max(lastId, applyLogRecord(data, size));
+    });
+    Transaction::ids.advancePast(lastId);
+    sink = userSink;
+    wal.reset(new WriteAheadLog(basePath + ".wal", lastLsn + 1, groupSize));
+    return wal->isOpen();
+}
+
+// Makes all logged changes durable and checkpoints once the log has grown long enough.
+// Must not run while a ConcurrentTransferEngine is transferring.
+void Bank::sync() {
+    if (wal) {
+        wal->commit();
+        if (wal->lastLsn() - checkpointLsn >= checkpointInterval) {
+            checkpoint();
+        }
+    }
+}
+
+void Bank::checkpoint() {
+    if (wal) {
+        wal->commit();
+        uint64_t lsn = wal->lastLsn();
+        writeSnapshot(storagePath + ".snap", lsn);
+        wal->reset();
+        checkpointLsn = lsn;
+    }
+}
+
+// Writes every account and its full transaction history to a dataset file. Returns the number
+// of rows written, or 0 if writing failed.
+uint64_t Bank::exportDataset(const string& path) {
+    DatasetWriter writer(path);
+    if (!writer.isOpen()) {
+        return 0;
+    }
+    for (Account& account : accounts) {
+        writer.addAccount({account.accountNumber, account.name, account.accountType, account.balance, account.isLoanTaker,
+                           account.loanAmount, account.monthsPaid, account.totalMonths});
+    }
+    for (Account& account : accounts) {
+        for (const Transaction& transaction : account.transactions.readAll()) {
+            writer.addTransaction(account.accountNumber, transaction.getType(), transaction.getAmount());
+        }
+    }
+    uint64_t rows = writer.rowCount();
+    return writer.close() ? rows : 0;
+}
+
+// Loads a dataset into this empty bank, bypassing the log; a checkpoint follows so the loaded
+// state is durable. Returns the number of rows loaded, or 0 if the bank is not empty.
+// Transactions of accounts that are not in the dataset are skipped.
+uint64_t Bank::importDataset(const DatasetReader& dataset) {
+    if (!dataset.isValid() || !accounts.empty()) {
+        return 0;
+    }
+    size_t accountRows = 0;
+    for (const DatasetGroup& group : dataset.getGroups()) {
+        accountRows += group.table == DatasetTable::Accounts ? group.rowCount : 0;
+    }
+    reserve(accountRows);
+
+    // Accounts first, so every transaction finds its account whatever the group order in the file
+    uint64_t loaded = 0;
+    for (const DatasetGroup& group : dataset.getGroups()) {
+        if (group.table == DatasetTable::Accounts) {
+            span<const int32_t> numbers = group.column<int32_t>(0);
+            span<const int64_t> balances = group.column<int64_t>(1);
+            span<const int64_t> loanAmounts = group.column<int64_t>(2);
+            span<const int32_t> monthsPaid = group.column<int32_t>(3);
+            span<const int32_t> totalMonths = group.column<int32_t>(4);
+            span<const uint8_t> loanTakers = group.column<uint8_t>(5);
+            for (uint32_t row = 0; row < group.rowCount; ++row) {
+                // A repeated account number would add an account findAccount never returns; the first row keeps it
+                if (rowsByNumber.count(numbers[row])) {
+                    continue;
+                }
+                AccountHandle handle = accounts.emplace(string(group.text(6, row)), numbers[row], string(group.text(8, row)),
+                                                        Money::fromCents(balances[row]), history);
+                Account& account = accounts[handle.slot];
+                account.isLoanTaker = loanTakers[row] != 0;
+                account.loanAmount = Money::fromCents(loanAmounts[row]);
+                account.monthsPaid = monthsPaid[row];
+                account.totalMonths = totalMonths[row];
+                appendRow(account);
+                ++loaded;
+            }
+        }
+    }
+    for (const DatasetGroup& group : dataset.getGroups()) {
+        if (group.table == DatasetTable::Transactions) {
+            span<const int32_t> numbers = group.column<int32_t>(0);
+            span<const uint8_t> types = group.column<uint8_t>(1);
+            span<const int64_t> amounts = group.column<int64_t>(2);
+            Account* account = nullptr;
+            for (uint32_t row = 0; row < group.rowCount; ++row) {
+                // A history is usually stored as one run of rows, so the last lookup is reused
+                if (account == nullptr || account->accountNumber != numbers[row]) {
+                    account = findAccount(numbers[row]);
+                }
+                if (account) {
+                    account->transactions.append((TransactionType)types[row], Money::fromCents(amounts[row]));
+                    ++loaded;
+                }
+            }
+        }
+    }
+    checkpoint();
+    return loaded;
+}
+
+void Bank::displayAllAccounts() {
+    cout << "---- Account List ----" << endl;
+    for (Account& account : accounts) {
+        account.displayInfo();
+        cout << "----------------------" << endl;
+    }
+    displaySummary();
+}
+
+void Bank::displaySummary() {
+    cout << "Accounts: " << accounts.size();
+    for (auto& [type, count] : accountsByType) {
+        cout << ", " << type << ": " << count;
+    }
+    cout << endl;
+    cout << "Total Balance: " << totalBalance() << endl;
+    cout << "Loan Takers: " << loanTakerRows.size() << ", Outstanding Loans: " << outstandingLoans() << endl;
+}
+
+void Bank::displayAccountDetails(int accountNumber) {
+    Account* account = findAccount(accountNumber);
+    if (account) {
+        cout << "---- Account Details ----" << endl;
+        account->displayInfo();
+        cout << "Account Number: " << account->getAccountNumber() << endl;
+        if (account->getIsLoanTaker()) {
+            cout << "Loan Taken: " << account->getRemainingLoan() << endl;
+            cout << "Months Paid: " << account->getMonthsPaid() << "/" << account->getTotalMonths() << endl;
+        }
+        vector<Transaction> transactions = account->getTransactions().readAll();
+        if (!transactions.empty()) {
+            cout << "Transactions:" << endl;
+            for (const Transaction& transaction : transactions) {
+                cout << "  " << transaction.getSequence() << ". " << transactionTypeName(transaction.getType()) << ": "
+                     << transaction.getAmount() << " (id " << transaction.getId() << ")" << endl;
+            }
+        }
+        cout << "-------------------------" << endl;
+    } else {
+        cout << "Account not found." << endl;
+    }
+}
+
+void Bank::displayLoanTakers() {
+    cout << "---- Loan Takers ----" << endl;
+    for (uint32_t row : loanTakerRows) {
+        Account& account = accounts[row];
+        cout << "Name: " << account.getName() << endl;
+        cout << "Loan Taken: " << account.getRemainingLoan() << endl;
+        cout << "Months Paid: " << account.getMonthsPaid() << "/" << account.getTotalMonths() << endl;
+        cout << "----------------------" << endl;
+    }
+    if (loanTakerRows.empty()) {
+        cout << "Nobody has taken a loan yet. You are welcome to take a loan from us." << endl;
+    }
+}
+
+ConcurrentTransferEngine::ConcurrentTransferEngine(Bank& bank) : bank(bank) {
+    accountLocks.reset(new mutex[bank.accounts.size()]);
+    slots.reserve(bank.accounts.size());
+    lockOrder.reserve(bank.accounts.size());
+    size_t next = 0;
+    for (Account& account : bank.accounts) {
+        int number = account.getAccountNumber();
+        slots[number] = {&account, &accountLocks[next++]};
+        lockOrder.push_back(number);
+    }
+    sort(lockOrder.begin(), lockOrder.end());
+    expectedTotal = totalBalance();
+}
+
+OpStatus ConcurrentTransferEngine::transfer(int fromAccountNumber, int toAccountNumber, Money amount) {
+    auto from = slots.find(fromAccountNumber);
+    auto to = slots.find(toAccountNumber);
+    if (from == slots.end() || to == slots.end()) {
+        return OpStatus::AccountNotFound;
+    }
+
+    // The lower account number is always locked first, so no two transfers wait on each other in a cycle
+    mutex* first = fromAccountNumber < toAccountNumber ? from->second.lock : to->second.lock;
+    mutex* second = fromAccountNumber < toAccountNumber ? to->second.lock : from->second.lock;
+    unique_lock<mutex> firstGuard(*first);
+    unique_lock<mutex> secondGuard;
+    if (second != first) {
+        secondGuard = unique_lock<mutex>(*second);
+    }
+    return bank.transfer(*from->second.account, *to->second.account, amount);
+}
+
+Money ConcurrentTransferEngine::totalBalance() {
+    vector<unique_lock<mutex>> guards;
+    guards.reserve(lockOrder.size());
+    for (int number : lockOrder) {
+        guards.emplace_back(*slots[number].lock);
+    }
+    Money total;
+    for (int number : lockOrder) {
+        total += slots[number].account->getBalance();
+    }
+    return total;
+}
+
+bool ConcurrentTransferEngine::checkConservation() {
+    return totalBalance() == expectedTotal;
+}
+
+class BankManagementSystem {
+private:
+    Bank bank;
+    ConsoleSink console;
+
+public:
+    BankManagementSystem() {
+        bank.setEventSink(&console);
+        if (!bank.openStorage("agrani_bank")) {
+            cout << "Warning: could not open agrani_bank.wal; changes will not be saved." << endl;
+        } else if (bank.accountCount() > 0) {
+            cout << "Restored " << bank.accountCount() << " accounts." << endl;
+        }
+    }
+    void run();
+};
+
+void BankManagementSystem::run() {
+    int choice;
+    do {
+        cout << "\n---- Agrani Bank Limited ----" << endl;
+        cout << "1. Create Account" << endl;
+        cout << "2. Deposit" << endl;
+        cout << "3. Withdraw" << endl;
+        cout << "4. Transfer" << endl;
+        cout << "5. Apply Loan" << endl;
+        cout << "6. Pay Loan" << endl;
+        cout << "7. Display All Accounts" << endl;
+        cout << "8. Display Account Details" << endl;
+        cout << "9. Display Loan Takers and Loan Status" << endl;
+        cout << "10. Make Loan Payment" << endl;
+        cout << "11. Run Month-End Loan Processing" << endl;
+        cout << "12. Exit" << endl;
+        cout << "Enter your choice: ";
+        cin >> choice;
+
+        switch (choice) {
+            case 1: {
+                string name, type;
+                int number;
+                Money initialBalance;
+                cout << "Enter account holder's name: ";
+                cin.ignore();
+                getline(cin, name);
+                cout << "Enter account number: ";
+                cin >> number;
+                cout << "Enter account type (e.g., Savings, Checking): ";
+                cin.ignore();
+                getline(cin, type);
+                cout << "Enter initial balance: ";
+                cin >> initialBalance;
+                bank.addAccount(move(name), number, move(type), initialBalance);
+                break;
+            }
+            case 2: {
+                int accountNumber;
+                Money amount;
+                cout << "Enter account number: ";
+                cin >> accountNumber;
+                Account* account = bank.findAccount(accountNumber);
+                if (account) {
+                    cout << "Enter deposit amount: ";
+                    cin >> amount;
+                    bank.deposit(*account, amount);
+                } else {
+                    cout << "Account not found." << endl;
+                }
+                break;
+            }
+            case 3: {
+                int accountNumber;
+                Money amount;
+                cout << "Enter account number: ";
+                cin >> accountNumber;
+                Account* account = bank.findAccount(accountNumber);
+                if (account) {
+                    cout << "Enter withdrawal amount: ";
+                    cin >> amount;
+                    bank.withdraw(*account, amount);
+                } else {
+                    cout << "Account not found." << endl;
+                }
+                break;
+            }
+            case 4: {
+                int fromAccountNumber, toAccountNumber;
+                Money amount;
+                cout << "Enter source account number: ";
+                cin >> fromAccountNumber;
+                AccountHandle fromHandle = bank.findHandle(fromAccountNumber);
+                cout << "Enter target account number: ";
+                cin >> toAccountNumber;
+                AccountHandle toHandle = bank.findHandle(toAccountNumber);
+                if (bank.getAccount(fromHandle) && bank.getAccount(toHandle)) {
+                    cout << "Enter transfer amount: ";
+                    cin >> amount;
+                    bank.transfer(*bank.getAccount(fromHandle), *bank.getAccount(toHandle), amount);
+                } else {
+                    cout << "One or both accounts not found." << endl;
+                }
+                break;
+            }
+            case 5: {
+                int accountNumber;
+                Money loanAmount;
+                cout << "Enter account number: ";
+                cin >> accountNumber;
+                Account* account = bank.findAccount(accountNumber);
+                if (account) {
+                    cout << "Enter loan amount: ";
+                    cin >> loanAmount;
+                    bank.applyLoan(*account, loanAmount);
+                } else {
+                    cout << "Account not found." << endl;
+                }
+                break;
+            }
+            case 6: {
+                int accountNumber;
+                cout << "Enter account number: ";
+                cin >> accountNumber;
+                Account* account = bank.findAccount(accountNumber);
+                if (account) {
+                    bank.payLoan(*account);
+                } else {
+                    cout << "Account not found." << endl;
+                }
+                break;
+            }
+            case 7:
+                bank.displayAllAccounts();
+                break;
+            case 8: {
+                int accountNumber;
+                cout << "Enter account number: ";
+                cin >> accountNumber;
+                bank.displayAccountDetails(accountNumber);
+                break;
+            }
+            case 9:
+                bank.displayLoanTakers();
+                break;
+            case 10: {
+                int accountNumber;
+                cout << "Enter account number: ";
+                cin >> accountNumber;
+                Account* account = bank.findAccount(accountNumber);
+                if (account && account->getIsLoanTaker()) {
+                    bank.makeLoanPayment(*account);
+                    cout << "Loan payment successful." << endl;
+                } else {
+                    cout << "Account not found or is not a loan taker." << endl;
+                }
+                break;
+            }
+            case 11: {
+                MonthEndReport report = bank.runMonthEnd();
+                cout << "Charged " << report.charged << " of " << report.loanTakers << " loan takers, collected "
+                     << report.collected << "." << endl;
+                if (report.paidOff > 0) {
+                    cout << report.paidOff << " loans are already paid off." << endl;
+                }
+                for (const LoanShortfall& shortfall : report.shortfalls) {
+                    cout << "Shortfall: account " << shortfall.accountNumber << " owes " << shortfall.due
+                         << " but has " << shortfall.balance << endl;
+                }
+                break;
+            }
+            case 12:
+                cout << "Thanks for being with us!" << endl;
+                break;
+            default:
+                cout << "Invalid choice. Please try again." << endl;
+        }
+        bank.sync();
+
+    } while (choice != 12);
+}
+
+// Benchmarks
+// Every global operator new call, so the benchmarks can report allocation counts.
+// Kept out of line so GCC pairs each new with its delete instead of seeing raw malloc/free.
+atomic<size_t> heapAllocations(0);
+
+[[gnu::noinline]] void* operator new(size_t size) {
+    heapAllocations.fetch_add(1, memory_order_relaxed);
+    if (void* memory = malloc(size ? size : 1)) {
+        return memory;
+    }
+    throw bad_alloc();
+}
+
+[[gnu::noinline]] void operator delete(void* memory) noexcept {
+    free(memory);
+}
+
+[[gnu::noinline]] void operator delete(void* memory, size_t) noexcept {
+    free(memory);
+}
+
+class NullBuffer : public streambuf {
+protected:
+    int overflow(int c) override {
+        return c;
+    }
+    streamsize xsputn(const char*, streamsize count) override {
+        return count;
+    }
+};
+
+void runEventSinkBenchmark() {
+    const int accountCount = 10000;
+    const int opCount = 1000000;
+
+    // Console output goes to a discarding stream so only formatting cost is measured
+    NullBuffer nullBuffer;
+    ostream nullStream(&nullBuffer);
+    ConsoleSink consoleSink(nullStream);
+    BufferedBinarySink binarySink(nullStream);
+    NullSink nullSink;
+    pair<const char*, EventSink*> sinks[] = {{"Console sink", &consoleSink}, {"Binary sink", &binarySink}, {"Null sink", &nullSink}};
+
+    cout << "Event sink benchmark (" << opCount << " deposits/withdrawals, " << accountCount << " accounts)" << endl;
+    for (auto& entry : sinks) {
+        Bank bank;
+        bank.setEventSink(entry.second);
+        for (int i = 0; i < accountCount; ++i) {
+            bank.addAccount("customer", i + 1, "Savings", Money::fromMajor(1000));
+        }
+
+        EventSink& sink = bank.getEventSink();
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < opCount; ++i) {
+            Account* account = bank.findAccount(i % 64 + 1);
+            if (i % 2 == 0) {
+                account->deposit(Money::fromMajor(5), sink);
+            } else {
+                account->withdraw(Money::fromMajor(5), sink);
+            }
+        }
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+        cout << entry.first << ", Ops/sec: " << (long long)(opCount / elapsed.count()) << endl;
+    }
+}
+
+double runConcurrentTransfers(ConcurrentTransferEngine& engine, int accountCount, int threadCount, int transfersPerThread) {
+    vector<thread> workers;
+    auto start = chrono::steady_clock::now();
+    for (int t = 0; t < threadCount; ++t) {
+        workers.emplace_back([&, t]() {
+            mt19937 rng(100 + t);
+            uniform_int_distribution<int> pick(1, accountCount);
+            uniform_int_distribution<int> amount(1, 50);
+            for (int i = 0; i < transfersPerThread; ++i) {
+                engine.transfer(pick(rng), pick(rng), Money::fromMajor(amount(rng)));
+            }
+        });
+    }
+    for (thread& worker : workers) {
+        worker.join();
+    }
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    return threadCount * transfersPerThread / elapsed.count();
+}
+
+void runConcurrentBenchmark() {
+    const int accountCount = 200000;
+    const int transfersPerThread = 100000;
+    int maxThreads = max(4u, thread::hardware_concurrency());
+
+    Bank bank;
+    for (int i = 0; i < accountCount; ++i) {
+        bank.addAccount("customer", i + 1, "Savings", Money::fromMajor(1000));
+    }
+    ConcurrentTransferEngine engine(bank);
+    cout << "Concurrent transfer benchmark (" << transfersPerThread << " transfers per thread, " << accountCount << " accounts)" << endl;
+    for (int threadCount = 1; threadCount <= maxThreads; threadCount *= 2) {
+        double rate = runConcurrentTransfers(engine, accountCount, threadCount, transfersPerThread);
+        cout << "Threads: " << threadCount << ", Transfers/sec: " << (long long)rate << endl;
+    }
+    cout << "Money conserved: " << (engine.checkConservation() ? "yes" : "NO") << endl;
+
+    // Stress: all threads hammer the same eight accounts
+    Bank hotBank;
+    for (int i = 0; i < 8; ++i) {
+        hotBank.addAccount("customer", i + 1, "Savings", Money::fromMajor(1000));
+    }
+    ConcurrentTransferEngine hotEngine(hotBank);
+    runConcurrentTransfers(hotEngine, 8, maxThreads * 2, transfersPerThread);
+    cout << "Stress test (" << maxThreads * 2 << " threads, 8 accounts), money conserved: "
+         << (hotEngine.checkConservation() ? "yes" : "NO") << endl;
+}
+
+void runDurabilityBenchmark() {
+    const int accountCount = 100000;
+    const int opCount = 20000;
+    string basePath = (filesystem::temp_directory_path() / "agrani_bank_bench").string();
+    auto removeFiles = [&]() {
+        filesystem::remove(basePath + ".wal");
+        filesystem::remove(basePath + ".snap");
+    };
+
+    cout << "Durability benchmark (" << opCount << " deposits, 1000 accounts)" << endl;
+    size_t groupSizes[] = {0, 1, 16, 256};
+    for (size_t groupSize : groupSizes) {
+        removeFiles();
+        Bank bank;
+        if (groupSize > 0) {
+            bank.openStorage(basePath, groupSize);
+        }
+        for (int i = 0; i < 1000; ++i) {
+            bank.addAccount("customer", i + 1, "Savings", Money::fromMajor(1000));
+        }
+        bank.sync();
+
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < opCount; ++i) {
+            bank.deposit(*bank.findAccount(i % 1000 + 1), Money::fromMajor(1));
+        }
+        bank.sync();
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+        cout << (groupSize == 0 ? string("No log") : "Group size " + to_string(groupSize))
+             << ", Ops/sec: " << (long long)(opCount / elapsed.count()) << endl;
+    }
+
+    for (int useSnapshot = 1; useSnapshot >= 0; --useSnapshot) {
+        removeFiles();
+        {
+            Bank bank;
+            bank.openStorage(basePath, 4096);
+            bank.setCheckpointInterval(UINT64_MAX);
+            for (int i = 0; i < accountCount; ++i) {
+                bank.addAccount("customer", i + 1, "Savings", Money::fromMajor(1000));
+            }
+            if (useSnapshot) {
+                bank.checkpoint();
+            }
+            for (int i = 0; i < opCount; ++i) {
+                bank.deposit(*bank.findAccount(i % 100 + 1), Money::fromMajor(1));
+            }
+        }
+        auto start = chrono::steady_clock::now();
+        Bank restored;
+        restored.setCheckpointInterval(UINT64_MAX);
+        restored.openStorage(basePath);
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+        cout << (useSnapshot ? "Startup from snapshot + log tail" : "Startup from full log replay") << " ("
+             << restored.accountCount() << " accounts): " << (long long)(elapsed.count() * 1000) << " ms" << endl;
+    }
+    removeFiles();
+}
+
+// Bulk sums and a month of interest over the same balances, as double and as Money
+void runMoneyBenchmark() {
+    const int count = 10000000;
+    vector<double> doubleBalances(count);
+    vector<Money> moneyBalances(count);
+    mt19937 rng(3);
+    uniform_int_distribution<int64_t> cents(0, 100000000);
+    for (int i = 0; i < count; ++i) {
+        moneyBalances[i] = Money::fromCents(cents(rng));
+        doubleBalances[i] = moneyBalances[i].toDouble();
+    }
+
+    cout << "Money benchmark (" << count << " balances)" << endl;
+    auto start = chrono::steady_clock::now();
+    double doubleTotal = 0;
+    for (double balance : doubleBalances) {
+        doubleTotal += balance;
+    }
+    chrono::duration<double> doubleSum = chrono::steady_clock::now() - start;
+
+    start = chrono::steady_clock::now();
+    int64_t centsTotal = 0; // plain integer adds; a bank total of 10M accounts cannot overflow int64 cents
+    for (Money balance : moneyBalances) {
+        centsTotal += balance.minorUnits();
+    }
+    chrono::duration<double> moneySum = chrono::steady_clock::now() - start;
+
+    start = chrono::steady_clock::now();
+    for (double& balance : doubleBalances) {
+        balance -= balance * 0.05;
+    }
+    chrono::duration<double> doubleInterest = chrono::steady_clock::now() - start;
+
+    start = chrono::steady_clock::now();
+    for (Money& balance : moneyBalances) {
+        balance -= balance.percent(5);
+    }
+    chrono::duration<double> moneyInterest = chrono::steady_clock::now() - start;
+
+    double doubleAfter = 0;
+    int64_t centsAfter = 0;
+    for (int i = 0; i < count; ++i) {
+        doubleAfter += doubleBalances[i];
+        centsAfter += moneyBalances[i].minorUnits();
+    }
+    cout.precision(17);
+    cout << "Sum, double: " << (long long)(doubleSum.count() * 1000) << " ms (" << doubleTotal << ")" << endl;
+    cout << "Sum, Money: " << (long long)(moneySum.count() * 1000) << " ms (" << Money::fromCents(centsTotal) << ")" << endl;
+    cout << "Interest run, double: " << (long long)(doubleInterest.count() * 1000) << " ms (total " << doubleAfter << ")" << endl;
+    cout << "Interest run, Money: " << (long long)(moneyInterest.count() * 1000) << " ms (total " << Money::fromCents(centsAfter) << ")" << endl;
+    cout.precision(6);
+
+    // Ten million ten-cent deposits should come to exactly one million
+    double doubleDimes = 0;
+    Money moneyDimes;
+    for (int i = 0; i < count; ++i) {
+        doubleDimes += 0.10;
+        moneyDimes += Money::fromCents(10);
+    }
+    cout << "10M x 0.10, double: " << fixed << doubleDimes << ", Money: " << moneyDimes << endl;
+    cout.unsetf(ios::fixed);
+}
+
+// Scans balances and loan flags row by row over Account objects, then over the columns
+void runColumnScanBenchmark() {
+    const int objectCount = 1000000;
+    const int columnCount = 10000000;
+    const Money lowBalance = Money::fromMajor(100);
+    mt19937 rng(5);
+    uniform_int_distribution<int64_t> cents(0, 1000000);
+
+    Bank bank;
+    for (int i = 0; i < objectCount; ++i) {
+        bank.addAccount("customer", i + 1, "Savings", Money::fromCents(cents(rng)));
+        if (i % 10 == 0) {
+            bank.applyLoan(*bank.findAccount(i + 1), Money::fromCents(1));
+        }
+    }
+    cout << "Column scan benchmark" << endl;
+    auto start = chrono::steady_clock::now();
+    Money objectTotal;
+    size_t objectLow = 0;
+    size_t objectLoans = 0;
+    bank.forEachAccount([&](Account& account) {
+        objectTotal += account.getBalance();
+        objectLow += account.getBalance() < lowBalance;
+        objectLoans += account.getIsLoanTaker();
+    });
+    chrono::duration<double> objectScan = chrono::steady_clock::now() - start;
+    const AccountColumns& bankColumns = bank.getColumns();
+    vector<uint32_t> rows;
+    start = chrono::steady_clock::now();
+    Money columnTotal = bankColumns.totalBalance();
+    size_t columnLow = bankColumns.countBelow(lowBalance);
+    size_t columnLoans = bankColumns.selectLoanTakers(rows);
+    chrono::duration<double> columnScan = chrono::steady_clock::now() - start;
+    cout << "Account objects (" << objectCount << "): " << objectScan.count() * 1000 << " ms" << endl;
+    cout << "Columns (" << objectCount << "): " << columnScan.count() * 1000 << " ms, results "
+         << (objectTotal == columnTotal && objectLow == columnLow && objectLoans == columnLoans ? "match" : "DIFFER") << endl;
+
+    AccountColumns columns;
+    columns.reserve(columnCount);
+    for (int i = 0; i < columnCount; ++i) {
+        columns.append(i + 1, Money::fromCents(cents(rng)));
+        if (i % 10 == 0) {
+            columns.update(i, Money::fromCents(cents(rng)), true, Money::fromMajor(1000), Money::fromMajor(1000), 0);
+        }
+    }
+    start = chrono::steady_clock::now();
+    Money total = columns.totalBalance();
+    chrono::duration<double> totalTime = chrono::steady_clock::now() - start;
+    start = chrono::steady_clock::now();
+    size_t low = columns.countBelow(lowBalance);
+    chrono::duration<double> countTime = chrono::steady_clock::now() - start;
+    start = chrono::steady_clock::now();
+    columns.selectBelow(lowBalance, rows);
+    chrono::duration<double> selectTime = chrono::steady_clock::now() - start;
+    start = chrono::steady_clock::now();
+    size_t loans = columns.selectLoanTakers(rows);
+    chrono::duration<double> loanTime = chrono::steady_clock::now() - start;
+    cout << columnCount << " rows: total " << total << " in " << totalTime.count() * 1000 << " ms, "
+         << low << " low balances counted in " << countTime.count() * 1000 << " ms, selected in "
+         << selectTime.count() * 1000 << " ms, " << loans << " loan takers in " << loanTime.count() * 1000 << " ms" << endl;
+}
+
+// Accounts with balances between 100.00 and 5000.00; one in twenty takes a 100.00 loan
+void loadMonthEndBank(Bank& bank, int accountCount, unsigned seed) {
+    mt19937 rng(seed);
+    uniform_int_distribution<int64_t> cents(10000, 500000);
+    bank.reserve(accountCount);
+    for (int i = 0; i < accountCount; ++i) {
+        bank.addAccount("customer", i + 1, "Savings", Money::fromCents(cents(rng)));
+        if (rng() % 20 == 0) {
+            bank.applyLoan(*bank.findAccount(i + 1), Money::fromMajor(100));
+        }
+    }
+}
+
+bool sameReport(const MonthEndReport& a, const MonthEndReport& b) {
+    if (a.loanTakers != b.loanTakers || a.charged != b.charged || a.paidOff != b.paidOff ||
+        a.collected != b.collected || a.shortfalls.size() != b.shortfalls.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.shortfalls.size(); ++i) {
+        if (a.shortfalls[i].accountNumber != b.shortfalls[i].accountNumber || a.shortfalls[i].balance != b.shortfalls[i].balance) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Random operations, then the running totals against a full recount, and the cost of each
+void runAggregateBenchmark() {
+    const int accountCount = 1000000;
+    const int operationCount = 2000000;
+    Bank bank;
+    loadMonthEndBank(bank, accountCount, 23);
+    mt19937 rng(29);
+    for (int i = 0; i < operationCount; ++i) {
+        Account& account = *bank.findAccount(rng() % accountCount + 1);
+        switch (rng() % 5) {
+            case 0:
+                bank.deposit(account, Money::fromCents(rng() % 10000));
+                break;
+            case 1:
+                bank.withdraw(account, Money::fromCents(rng() % 10000));
+                break;
+            case 2:
+                bank.transfer(account, *bank.findAccount(rng() % accountCount + 1), Money::fromCents(rng() % 10000));
+                break;
+            case 3:
+                bank.applyLoan(account, Money::fromCents(rng() % 100000));
+                break;
+            default:
+                if (account.getIsLoanTaker()) {
+                    bank.payLoan(account);
+                }
+        }
+    }
+    bank.runMonthEnd();
+
+    cout << "Aggregate benchmark (" << accountCount << " accounts, " << operationCount << " operations)" << endl;
+    auto start = chrono::steady_clock::now();
+    Money balance;
+    Money outstanding;
+    size_t loanTakers = 0;
+    size_t savings = 0;
+    bank.forEachAccount([&](Account& account) {
+        balance += account.getBalance();
+        if (account.getIsLoanTaker()) {
+            outstanding += account.getRemainingLoan();
+            ++loanTakers;
+        }
+        savings += account.getAccountType() == "Savings";
+    });
+    chrono::duration<double> scanTime = chrono::steady_clock::now() - start;
+    start = chrono::steady_clock::now();
+    bool same = balance == bank.totalBalance() && outstanding == bank.outstandingLoans() &&
+                loanTakers == bank.loanTakerCount() && savings == bank.accountsOfType("Savings");
+    chrono::duration<double> queryTime = chrono::steady_clock::now() - start;
+    cout << "Full scan: " << scanTime.count() * 1000 << " ms, running totals: " << queryTime.count() * 1000
+         << " ms, totals " << (same ? "match" : "DIFFER") << endl;
+}
+
+// Bulk insert into a growing vector<Account> (the old Bank layout) and into AccountTable,
+// counting how often the first account moved
+void runAccountTableBenchmark() {
+    const int accountCount = 1000000;
+    HistoryStore history;
+    cout << "Account table benchmark (" << accountCount << " accounts)" << endl;
+
+    vector<Account> vectorAccounts;
+    const Account* first = nullptr;
+    int moves = 0;
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < accountCount; ++i) {
+        vectorAccounts.emplace_back("customer", i + 1, "Savings", Money::fromMajor(1000), history);
+        if (first != vectorAccounts.data()) {
+            moves += first != nullptr;
+            first = vectorAccounts.data();
+        }
+    }
+    chrono::duration<double> vectorTime = chrono::steady_clock::now() - start;
+    cout << "vector<Account>: " << (long long)(vectorTime.count() * 1000) << " ms, first account moved " << moves
+         << " times" << endl;
+
+    AccountTable table;
+    start = chrono::steady_clock::now();
+    AccountHandle firstHandle = table.emplace("customer", 1, "Savings", Money::fromMajor(1000), history);
+    const Account* firstAddress = table.get(firstHandle);
+    for (int i = 1; i < accountCount; ++i) {
+        table.emplace("customer", i + 1, "Savings", Money::fromMajor(1000), history);
+    }
+    chrono::duration<double> tableTime = chrono::steady_clock::now() - start;
+    cout << "AccountTable: " << (long long)(tableTime.count() * 1000) << " ms, first account moved "
+         << (table.get(firstHandle) == firstAddress ? 0 : 1) << " times" << endl;
+
+    table.erase(firstHandle);
+    AccountHandle reused = table.emplace("customer", 1, "Savings", Money(), history);
+    cout << "Stale handle after erase resolves to nothing: " << (table.get(firstHandle) == nullptr ? "yes" : "NO")
+         << ", slot reused: " << (reused.slot == firstHandle.slot ? "yes" : "NO") << endl;
+}
+
+// Heap allocations made by steady-state deposits, withdrawals and transfers, in memory and with
+// the write-ahead log open. A warm-up pass first sizes every reused buffer.
+void runAllocationBenchmark() {
+    const int accountCount = 1000;
+    const int operationCount = 100000;
+    string basePath = (filesystem::temp_directory_path() / "agrani_bank_alloc_bench").string();
+    auto removeFiles = [&basePath]() {
+        for (const char* suffix : {".wal", ".snap", ".hist"}) {
+            filesystem::remove(basePath + suffix);
+        }
+    };
+    cout << "Allocation check (" << operationCount << " deposits, withdrawals and transfers, " << accountCount
+         << " accounts)" << endl;
+    for (bool durable : {false, true}) {
+        removeFiles();
+        Bank bank;
+        if (durable) {
+            bank.openStorage(basePath);
+            bank.setCheckpointInterval(UINT64_MAX);
+        }
+        for (int i = 0; i < accountCount; ++i) {
+            bank.addAccount("customer", i + 1, "Savings", Money::fromMajor(1000));
+        }
+
+        size_t allocations = 0;
+        for (int pass = 0; pass < 2; ++pass) {
+            mt19937 rng(pass);
+            uniform_int_distribution<int> pick(1, accountCount);
+            size_t before = heapAllocations.load(memory_order_relaxed);
+            for (int i = 0; i < operationCount; ++i) {
+                Account* account = bank.findAccount(pick(rng));
+                switch (i % 3) {
+                    case 0:
+                        bank.deposit(*account, Money::fromMajor(2));
+                        break;
+                    case 1:
+                        bank.withdraw(*account, Money::fromMajor(1));
+                        break;
+                    default:
+                        bank.transfer(*account, *bank.findAccount(pick(rng)), Money::fromMajor(1));
+                        break;
+                }
+            }
+            allocations = heapAllocations.load(memory_order_relaxed) - before;
+        }
+        cout << (durable ? "With write-ahead log" : "In memory") << ", heap allocations after warm-up: " << allocations
+             << endl;
+    }
+    removeFiles();
+}
+
+void runHistoryBenchmark() {
+    const int accountCount = 100000;
+    const int perAccount = 200;
+    Bank bank;
+    bank.reserve(accountCount);
+    for (int i = 0; i < accountCount; ++i) {
+        bank.addAccount("History", i + 1, "Savings", Money::fromMajor(1000));
+    }
+    cout << "History benchmark (" << accountCount << " accounts x " << perAccount << " transactions)" << endl;
+    mt19937 rng(31);
+    auto start = chrono::steady_clock::now();
+    for (int round = 0; round < perAccount; ++round) {
+        bank.forEachAccount([&](Account& account) {
+            account.getTransactions().append(TransactionType::Deposit, Money::fromCents(rng() % 100000));
+        });
+    }
+    chrono::duration<double> appendTime = chrono::steady_clock::now() - start;
+    uint64_t spillBytes = bank.spilledHistoryBytes();
+    uint64_t spilled = (uint64_t)accountCount * (perAccount - TransactionHistory::RecentCapacity);
+    cout << "sizeof(Account): " << sizeof(Account) << " bytes with " << TransactionHistory::RecentCapacity
+         << " inline entries" << endl;
+    cout << "Append: " << (uint64_t)accountCount * perAccount / appendTime.count() << " entries/sec, spill file "
+         << (double)spillBytes / spilled << " bytes/entry vs " << sizeof(Transaction) << " in memory" << endl;
+
+    start = chrono::steady_clock::now();
+    bool ordered = true;
+    for (int i = 0; i < accountCount; i += 100) {
+        vector<Transaction> entries = bank.findAccount(i + 1)->getTransactions().readAll();
+        ordered = ordered && entries.size() == (size_t)perAccount;
+        for (size_t j = 0; ordered && j < entries.size(); ++j) {
+            ordered = entries[j].getSequence() == j + 1;
+        }
+    }
+    chrono::duration<double> readTime = chrono::steady_clock::now() - start;
+    cout << "Full history of " << accountCount / 100 << " accounts: " << readTime.count() * 1000 << " ms, entries "
+         << (ordered ? "complete and ordered" : "MISSING OR OUT OF ORDER") << endl;
+}
+
+void runMonthEndBenchmark() {
+    const int accountCount = 10000000;
+    cout << "Month-end benchmark" << endl;
+    {
+        Bank single;
+        Bank sharded;
+        loadMonthEndBank(single, 200000, 17);
+        loadMonthEndBank(sharded, 200000, 17);
+        bool same = true;
+        for (int month = 0; month < 13; ++month) {
+            same = same && sameReport(single.runMonthEnd(1), sharded.runMonthEnd(8));
+        }
+        cout << "1 shard vs 8 shards over 13 months: " << (same ? "identical" : "DIFFERENT") << endl;
+    }
+
+    Bank bank;
+    auto start = chrono::steady_clock::now();
+    loadMonthEndBank(bank, accountCount, 19);
+    chrono::duration<double> loadTime = chrono::steady_clock::now() - start;
+    cout << "Loaded " << accountCount << " accounts in " << (long long)(loadTime.count() * 1000) << " ms" << endl;
+    unsigned shardCounts[] = {1, 2, 4, 8};
+    for (unsigned shards : shardCounts) {
+        start = chrono::steady_clock::now();
+        MonthEndReport report = bank.runMonthEnd(shards);
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+        cout << "Shards: " << shards << ", " << report.loanTakers << " loan takers, " << report.charged << " charged, "
+             << report.shortfalls.size() << " shortfalls, collected " << report.collected << " in "
+             << (long long)(elapsed.count() * 1000) << " ms" << endl;
+    }
+}
+
+// Synthetic workloads. A seeded generator picks accounts by Zipf-distributed popularity, so a
+// few hot accounts (merchants, payroll) see most of the traffic, and mixes reads, writes and
+// loan activity. It is cheap enough per operation to drive the bank at full speed.
+
+// xoshiro256** seeded through splitmix64: small, fast, and the same sequence on every platform
+class WorkloadRandom {
+private:
+    uint64_t state[4];
+    static uint64_t rotl(uint64_t x, int k) {
+        return (x << k) | (x >> (64 - k));
+    }
+public:
+    explicit WorkloadRandom(uint64_t seed);
+    uint64_t next();
+    double nextDouble() {
+        return (next() >> 11) * 0x1.0p-53; // [0, 1)
+    }
+    uint32_t below(uint32_t bound) {
+        return (uint32_t)(((next() >> 32) * bound) >> 32);
+    }
+};
+
+// Draws ranks 1..n with P(k) proportional to 1/k^exponent, in constant time and memory, by
+// rejection-inversion (Hormann and Derflinger). An exponent of 0 is uniform.
+class ZipfSampler {
+private:
+    uint32_t n;
+    double exponent;
+    double hIntegralX1;
+    double hIntegralN;
+    double cutoff;
+    double h(double x) const {
+        return exp(-exponent * log(x));
+    }
+    double hIntegral(double x) const;
+    double hIntegralInverse(double x) const;
+public:
+    ZipfSampler(uint32_t n, double exponent);
+    uint32_t sample(WorkloadRandom& random) const;
+};
+
+struct WorkloadConfig {
+    int accountCount = 100000;
+    double skew = 0.99;      // Zipf exponent of account popularity
+    double readRatio = 0.5;  // share of operations that only read a balance
+    double loanRate = 0.02;  // share of operations that apply for or pay off a loan
+    uint64_t seed = 1;
+};
+
+enum class WorkloadKind : uint8_t {
+    Read,
+    Deposit,
+    Withdraw,
+    Transfer,
+    ApplyLoan,
+    PayLoan
+};
+const int workloadKindCount = 6;
+
+struct WorkloadOp {
+    WorkloadKind kind;
+    int account;
+    int toAccount;
+    Money amount;
+};
+
+// Produces operations over accounts numbered 1..accountCount. Loan operations are one
+// application to three instalments, and instalments go to accounts this generator applied
+// for. The other writes are 70% transfers and 15% each deposits and withdrawals. Transfer
+// sources and loan applicants are uniform and every other pick, including the transfer
+// destination, follows the Zipf popularity. Popularity ranks are shuffled over the accounts
+// so the hot accounts are not simply the oldest ones.
+class WorkloadGenerator {
+private:
+    WorkloadConfig config;
+    WorkloadRandom random;
+    ZipfSampler zipf;
+    vector<int> accountsByRank;
+    vector<int> borrowers;
+public:
+    explicit WorkloadGenerator(const WorkloadConfig& config);
+    void fill(span<WorkloadOp> ops);
+    int hotAccount() {
+        return accountsByRank[zipf.sample(random) - 1];
+    }
+    int anyAccount() {
+        return (int)random.below((uint32_t)accountsByRank.size()) + 1;
+    }
+};
+
+struct WorkloadResult {
+    uint64_t counts[workloadKindCount] = {};
+    uint64_t succeeded = 0;
+    double seconds = 0;
+};
+
+WorkloadRandom::WorkloadRandom(uint64_t seed) {
+    for (uint64_t& word : state) {
+        uint64_t z = (seed += 0x9e3779b97f4a7c15ull);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        word = z ^ (z >> 31);
+    }
+}
+
+uint64_t WorkloadRandom::next() {
+    uint64_t result = rotl(state[1] * 5, 7) * 9;
+    uint64_t t = state[1] << 17;
+    state[2] ^= state[0];
+    state[3] ^= state[1];
+    state[1] ^= state[2];
+    state[0] ^= state[3];
+    state[2] ^= t;
+    state[3] = rotl(state[3], 45);
+    return result;
 }
 
-Account* Bank::findAccount(int accountNumber) {
-    for (Account& account : accounts) {
-        if (account.getAccountNumber() == accountNumber) {
-            return &account;
+// log1p(x) / x and expm1(x) / x, with series near 0 where the division loses precision
+double zipfHelper1(double x) {
+    return fabs(x) > 1e-8 ? log1p(x) / x : 1 - x * (0.5 - x * (1.0 / 3 - 0.25 * x));
+}
+
+double zipfHelper2(double x) {
+    return fabs(x) > 1e-8 ? expm1(x) / x : 1 + x * 0.5 * (1 + x / 3 * (1 + 0.25 * x));
+}
+
+ZipfSampler::ZipfSampler(uint32_t n, double exponent) : n(max<uint32_t>(n, 1)), exponent(exponent) {
+    hIntegralX1 = hIntegral(1.5) - 1;
+    hIntegralN = hIntegral(this->n + 0.5);
+    cutoff = 2 - hIntegralInverse(hIntegral(2.5) - h(2));
+}
+
+double ZipfSampler::hIntegral(double x) const {
+    double logX = log(x);
+    return zipfHelper2((1 - exponent) * logX) * logX;
+}
+
+double ZipfSampler::hIntegralInverse(double x) const {
+    double t = max(x * (1 - exponent), -1.0);
+    return exp(zipfHelper1(t) * x);
+}
+
+uint32_t ZipfSampler::sample(WorkloadRandom& random) const {
+    while (true) {
+        double u = hIntegralN + random.nextDouble() * (hIntegralX1 - hIntegralN);
+        double x = hIntegralInverse(u);
+        uint32_t k = (uint32_t)clamp(x + 0.5, 1.0, (double)n);
+        // Most draws are accepted by the first test, which needs no further logarithms
+        if (k - x <= cutoff || u >= hIntegral(k + 0.5) - h(k)) {
+            return k;
         }
     }
-    return nullptr;
 }
 
-void Bank::transfer(Account& fromAccount, Account& toAccount, double amount) {
-    if (fromAccount.withdraw(amount)) {
-        toAccount.deposit(amount);
-        Transaction transaction(fromAccount.getTransactions().size() + 1, "Transfer", amount);
-        fromAccount.addTransaction(transaction);
-        transaction = Transaction(toAccount.getTransactions().size() + 1, "Transfer", amount);
-        toAccount.addTransaction(transaction);
-        cout << "Transfer successful." << endl;
-    } else {
-        cout << "Transfer failed." << endl;
+WorkloadGenerator::WorkloadGenerator(const WorkloadConfig& config)
+    : config(config), random(config.seed), zipf((uint32_t)config.accountCount, config.skew), accountsByRank(config.accountCount) {
+    for (int i = 0; i < config.accountCount; ++i) {
+        accountsByRank[i] = i + 1;
+    }
+    for (size_t i = accountsByRank.size(); i > 1; --i) {
+        swap(accountsByRank[i - 1], accountsByRank[random.below((uint32_t)i)]);
     }
 }
 
-void Bank::displayAllAccounts() {
-    cout << "---- Account List ----" << endl;
-    for (Account& account : accounts) {
-        account.displayInfo();
-        cout << "----------------------" << endl;
+void WorkloadGenerator::fill(span<WorkloadOp> ops) {
+    uint32_t loanThreshold = (uint32_t)(config.loanRate * 1000);
+    uint32_t readThreshold = loanThreshold + (uint32_t)(config.readRatio * 1000);
+    for (WorkloadOp& op : ops) {
+        uint32_t roll = random.below(1000);
+        op.amount = Money::fromCents(random.below(10000) + 1);
+        op.toAccount = 0;
+        if (roll < loanThreshold) {
+            bool apply = borrowers.empty() || random.below(4) == 0;
+            op.kind = apply ? WorkloadKind::ApplyLoan : WorkloadKind::PayLoan;
+            op.account = apply ? anyAccount() : borrowers[random.below((uint32_t)borrowers.size())];
+            if (apply) {
+                op.amount = Money::fromCents(op.amount.minorUnits() * 100);
+                borrowers.push_back(op.account);
+            }
+        } else if (roll < readThreshold) {
+            op.kind = WorkloadKind::Read;
+            op.account = hotAccount();
+        } else {
+            // Spread the write share 70/15/15 over transfers, deposits and withdrawals
+            uint32_t write = (roll - readThreshold) * 100 / (1000 - readThreshold);
+            op.kind = write < 70 ? WorkloadKind::Transfer : write < 85 ? WorkloadKind::Deposit : WorkloadKind::Withdraw;
+            op.account = op.kind == WorkloadKind::Transfer ? anyAccount() : hotAccount();
+            op.toAccount = op.kind == WorkloadKind::Transfer ? hotAccount() : 0;
+        }
     }
 }
 
-void Bank::displayAccountDetails(int accountNumber) {
-    Account* account = findAccount(accountNumber);
-    if (account) {
-        cout << "---- Account Details ----" << endl;
-        account->displayInfo();
-        cout << "Account Number: " << account->getAccountNumber() << endl;
-        if (account->getIsLoanTaker()) {
-            cout << "Loan Taken: " << account->getRemainingLoan() << endl;
-            cout << "Months Paid: " << account->getMonthsPaid() << "/" << account->getTotalMonths() << endl;
-        }
-        cout << "-------------------------" << endl;
-    } else {
-        cout << "Account not found." << endl;
+// Accounts 1..accountCount, alternately savings and current, balances between 100.00 and 5000.00
+void loadWorkloadPopulation(Bank& bank, const WorkloadConfig& config) {
+    WorkloadRandom random(config.seed ^ 0x5bd1e995);
+    bank.reserve(bank.accountCount() + config.accountCount);
+    for (int i = 1; i <= config.accountCount; ++i) {
+        bank.addAccount("customer", i, i % 2 ? "Savings" : "Current", Money::fromCents(10000 + random.below(490001)));
     }
 }
 
-void Bank::displayLoanTakers() {
-    bool loanTakerFound = false;
-    cout << "---- Loan Takers ----" << endl;
-    for (Account& account : accounts) {
-        if (account.getIsLoanTaker()) {
-            cout << "Name: " << account.getName() << endl;
-            cout << "Loan Taken: " << account.getRemainingLoan() << endl;
-            cout << "Months Paid: " << account.getMonthsPaid() << "/" << account.getTotalMonths() << endl;
-            cout << "----------------------" << endl;
-            loanTakerFound = true;
+// Generates and applies operations in batches, so the generator stays in cache between runs
+WorkloadResult runWorkload(Bank& bank, WorkloadGenerator& generator, uint64_t operations) {
+    WorkloadResult result;
+    WorkloadOp batch[1024];
+    auto start = chrono::steady_clock::now();
+    for (uint64_t done = 0; done < operations;) {
+        span<WorkloadOp> ops(batch, (size_t)min<uint64_t>(size(batch), operations - done));
+        generator.fill(ops);
+        for (const WorkloadOp& op : ops) {
+            Account* account = bank.findAccount(op.account);
+            OpStatus status = OpStatus::AccountNotFound;
+            if (account) {
+                switch (op.kind) {
+                    case WorkloadKind::Read:
+                        account->getBalance();
+                        status = OpStatus::Success;
+                        break;
+                    case WorkloadKind::Deposit:
+                        status = bank.deposit(*account, op.amount);
+                        break;
+                    case WorkloadKind::Withdraw:
+                        status = bank.withdraw(*account, op.amount);
+                        break;
+                    case WorkloadKind::Transfer: {
+                        Account* toAccount = bank.findAccount(op.toAccount);
+                        status = toAccount ? bank.transfer(*account, *toAccount, op.amount) : OpStatus::AccountNotFound;
+                        break;
+                    }
+                    case WorkloadKind::ApplyLoan:
+                        status = bank.applyLoan(*account, op.amount);
+                        break;
+                    case WorkloadKind::PayLoan:
+                        status = bank.payLoan(*account);
+                        break;
+                }
+            }
+            ++result.counts[(int)op.kind];
+            result.succeeded += status == OpStatus::Success;
         }
+        done += ops.size();
     }
-    if (!loanTakerFound) {
-        cout << "Nobody has taken a loan yet. You are welcome to take a loan from us." << endl;
-    }
+    result.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return result;
 }
 
-class BankManagementSystem {
-private:
+// Bank throughput as the access skew grows, and the generator's own rate
+void runWorkloadBenchmark() {
+    const uint64_t operationCount = 2000000;
+    WorkloadConfig config;
+    config.accountCount = 1000000;
     Bank bank;
+    loadWorkloadPopulation(bank, config);
+
+    cout << "Workload benchmark (" << config.accountCount << " accounts, " << operationCount << " operations, "
+         << config.readRatio * 100 << "% reads, " << config.loanRate * 100 << "% loan operations)" << endl;
+    double skews[] = {0, 0.8, 0.99, 1.2};
+    for (double skew : skews) {
+        config.skew = skew;
+        WorkloadGenerator generator(config);
+        ZipfSampler zipf(config.accountCount, skew);
+        WorkloadRandom random(config.seed);
+        size_t hot = 0;
+        for (int i = 0; i < 1000000; ++i) {
+            hot += zipf.sample(random) <= (uint32_t)config.accountCount / 100;
+        }
+
+        WorkloadOp batch[1024];
+        auto start = chrono::steady_clock::now();
+        for (uint64_t done = 0; done < operationCount; done += size(batch)) {
+            generator.fill(batch);
+        }
+        chrono::duration<double> generateTime = chrono::steady_clock::now() - start;
+        WorkloadResult result = runWorkload(bank, generator, operationCount);
+        cout << "Skew " << skew << ": top 1% of accounts get " << hot / 100 / 100.0 << "% of picks, generator "
+             << (long long)(operationCount / generateTime.count()) << " ops/sec, bank + generator "
+             << (long long)(operationCount / result.seconds) << " ops/sec" << endl;
+    }
+}
+
+// Headless command driver. A script is a text file with one command per line; amounts are whole
+// cents, and blank lines and lines starting with # are skipped:
+//   A <number> <balance> <type> <name>   add account (type is one word; the name is the rest)
+//   D <account> <amount>                 deposit
+//   W <account> <amount>                 withdraw
+//   T <from> <to> <amount>               transfer
+//   L <account> <amount>                 apply for a loan
+//   P <account>                          pay this month's loan instalment
+//   M                                    run month-end loan processing
+enum class ScriptOp : uint8_t {
+    AddAccount,
+    Deposit,
+    Withdraw,
+    Transfer,
+    ApplyLoan,
+    PayLoan,
+    MonthEnd
+};
+const int scriptOpCount = 7;
+const char* scriptOpNames[scriptOpCount] = {"Add account", "Deposit", "Withdraw", "Transfer", "Apply loan", "Pay loan", "Month-end"};
+
+struct ScriptCommand {
+    ScriptOp op;
+    int account;
+    int toAccount;
+    Money amount;
+    string type;
+    string name;
+};
 
+// Latency of every replayed command, by operation
+class ReplayStats {
+private:
+    vector<uint32_t> samples[scriptOpCount]; // nanoseconds
+    double elapsed = 0;                       // seconds
 public:
-    void run();
+    void record(ScriptOp op, int64_t nanoseconds) {
+        samples[(int)op].push_back((uint32_t)min<int64_t>(nanoseconds, UINT32_MAX));
+    }
+    void finish(double seconds) {
+        elapsed = seconds;
+    }
+    void print(ostream& out);
 };
 
-void BankManagementSystem::run() {
-    int choice;
-    do {
-        cout << "\n---- Agrani Bank Limited ----" << endl;
-        cout << "1. Create Account" << endl;
-        cout << "2. Deposit" << endl;
-        cout << "3. Withdraw" << endl;
-        cout << "4. Transfer" << endl;
-        cout << "5. Apply Loan" << endl;
-        cout << "6. Pay Loan" << endl;
-        cout << "7. Display All Accounts" << endl;
-        cout << "8. Display Account Details" << endl;
-        cout << "9. Display Loan Takers and Loan Status" << endl;
-        cout << "10. Make Loan Payment" << endl;
-        cout << "11. Exit" << endl;
-        cout << "Enter your choice: ";
-        cin >> choice;
+// Splits the next space-separated token off the front of line
+string_view nextToken(string_view& line) {
+    size_t start = line.find_first_not_of(' ');
+    line.remove_prefix(start == string_view::npos ? line.size() : start);
+    string_view token = line.substr(0, line.find(' '));
+    line.remove_prefix(token.size());
+    return token;
+}
 
-        switch (choice) {
-            case 1: {
-                string name, type;
-                int number;
-                double initialBalance;
-                cout << "Enter account holder's name: ";
-                cin.ignore();
-                getline(cin, name);
-                cout << "Enter account number: ";
-                cin >> number;
-                cout << "Enter account type (e.g., Savings, Checking): ";
-                cin.ignore();
-                getline(cin, type);
-                cout << "Enter initial balance: ";
-                cin >> initialBalance;
-                bank.addAccount(name, number, type, initialBalance);
+template <typename T>
+bool parseNumber(string_view token, T& value) {
+    auto [end, error] = from_chars(token.data(), token.data() + token.size(), value);
+    return error == errc() && end == token.data() + token.size() && !token.empty();
+}
+
+bool parseCommand(string_view line, ScriptCommand& command) {
+    string_view op = nextToken(line);
+    int64_t cents = 0;
+    bool ok = op.size() == 1;
+    switch (ok ? op[0] : 0) {
+        case 'A':
+            command.op = ScriptOp::AddAccount;
+            ok = parseNumber(nextToken(line), command.account) && parseNumber(nextToken(line), cents);
+            command.type = string(nextToken(line));
+            command.name = string(line.substr(min(line.find_first_not_of(' '), line.size())));
+            command.amount = Money::fromCents(cents);
+            return ok && !command.type.empty() && !command.name.empty();
+        case 'D':
+        case 'W':
+        case 'L':
+            command.op = op[0] == 'D' ? ScriptOp::Deposit : op[0] == 'W' ? ScriptOp::Withdraw : ScriptOp::ApplyLoan;
+            ok = parseNumber(nextToken(line), command.account) && parseNumber(nextToken(line), cents);
+            break;
+        case 'T':
+            command.op = ScriptOp::Transfer;
+            ok = parseNumber(nextToken(line), command.account) && parseNumber(nextToken(line), command.toAccount) &&
+                 parseNumber(nextToken(line), cents);
+            break;
+        case 'P':
+            command.op = ScriptOp::PayLoan;
+            ok = parseNumber(nextToken(line), command.account);
+            break;
+        case 'M':
+            command.op = ScriptOp::MonthEnd;
+            break;
+        default:
+            return false;
+    }
+    command.amount = Money::fromCents(cents);
+    return ok && nextToken(line).empty();
+}
+
+// Parses a whole script up front, so replay timings do not include parsing. On a bad line,
+// returns false with its number in errorLine.
+bool loadScript(const string& path, vector<ScriptCommand>& commands, size_t& errorLine) {
+    ifstream in(path);
+    string line;
+    errorLine = 0;
+    if (!in) {
+        return false;
+    }
+    while (getline(in, line)) {
+        ++errorLine;
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (line.find_first_not_of(' ') == string::npos || line[line.find_first_not_of(' ')] == '#') {
+            continue;
+        }
+        commands.emplace_back();
+        if (!parseCommand(line, commands.back())) {
+            return false;
+        }
+    }
+    errorLine = 0;
+    return !in.bad();
+}
+
+// Runs every command against the bank, timing each one. Commands naming an unknown account
+// are timed but do nothing.
+ReplayStats replayScript(Bank& bank, const vector<ScriptCommand>& commands) {
+    ReplayStats stats;
+    auto start = chrono::steady_clock::now();
+    auto previous = start;
+    for (const ScriptCommand& command : commands) {
+        Account* account = command.op == ScriptOp::AddAccount || command.op == ScriptOp::MonthEnd
+                               ? nullptr
+                               : bank.findAccount(command.account);
+        switch (command.op) {
+            case ScriptOp::AddAccount:
+                bank.addAccount(command.name, command.account, command.type, command.amount);
                 break;
-            }
-            case 2: {
-                int accountNumber;
-                double amount;
-                cout << "Enter account number: ";
-                cin >> accountNumber;
-                Account* account = bank.findAccount(accountNumber);
+            case ScriptOp::Deposit:
                 if (account) {
-                    cout << "Enter deposit amount: ";
-                    cin >> amount;
-                    account->deposit(amount);
-                } else {
-                    cout << "Account not found." << endl;
+                    bank.deposit(*account, command.amount);
                 }
                 break;
-            }
-            case 3: {
-                int accountNumber;
-                double amount;
-                cout << "Enter account number: ";
-                cin >> accountNumber;
-                Account* account = bank.findAccount(accountNumber);
+            case ScriptOp::Withdraw:
                 if (account) {
-                    cout << "Enter withdrawal amount: ";
-                    cin >> amount;
-                    account->withdraw(amount);
-                } else {
-                    cout << "Account not found." << endl;
+                    bank.withdraw(*account, command.amount);
                 }
                 break;
-            }
-            case 4: {
-                int fromAccountNumber, toAccountNumber;
-                double amount;
-                cout << "Enter source account number: ";
-                cin >> fromAccountNumber;
-                Account* fromAccount = bank.findAccount(fromAccountNumber);
-                cout << "Enter target account number: ";
-                cin >> toAccountNumber;
-                Account* toAccount = bank.findAccount(toAccountNumber);
-                if (fromAccount && toAccount) {
-                    cout << "Enter transfer amount: ";
-                    cin >> amount;
-                    bank.transfer(*fromAccount, *toAccount, amount);
-                } else {
-                    cout << "One or both accounts not found." << endl;
+            case ScriptOp::Transfer: {
+                Account* toAccount = bank.findAccount(command.toAccount);
+                if (account && toAccount) {
+                    bank.transfer(*account, *toAccount, command.amount);
                 }
                 break;
             }
-            case 5: {
-                int accountNumber;
-                double loanAmount;
-                cout << "Enter account number: ";
-                cin >> accountNumber;
-                Account* account = bank.findAccount(accountNumber);
+            case ScriptOp::ApplyLoan:
                 if (account) {
-                    cout << "Enter loan amount: ";
-                    cin >> loanAmount;
-                    account->applyLoan(loanAmount);
-                } else {
-                    cout << "Account not found." << endl;
+                    bank.applyLoan(*account, command.amount);
                 }
                 break;
-            }
-            case 6: {
-                int accountNumber;
-                cout << "Enter account number: ";
-                cin >> accountNumber;
-                Account* account = bank.findAccount(accountNumber);
+            case ScriptOp::PayLoan:
                 if (account) {
-                    account->payLoan();
-                } else {
-                    cout << "Account not found." << endl;
-                }
-                break;
-            }
-            case 7:
-                bank.displayAllAccounts();
-                break;
-            case 8: {
-                int accountNumber;
-                cout << "Enter account number: ";
-                cin >> accountNumber;
-                bank.displayAccountDetails(accountNumber);
-                break;
-            }
-            case 9:
-                bank.displayLoanTakers();
-                break;
-            case 10: {
-                int accountNumber;
-                cout << "Enter account number: ";
-                cin >> accountNumber;
-                Account* account = bank.findAccount(accountNumber);
-                if (account && account->getIsLoanTaker()) {
-                    account->makeLoanPayment();
-                    cout << "Loan payment successful." << endl;
-                } else {
-                    cout << "Account not found or is not a loan taker." << endl;
+                    bank.payLoan(*account);
                 }
                 break;
-            }
-            case 11:
-                cout << "Thanks for being with us!" << endl;
+            case ScriptOp::MonthEnd:
+                bank.runMonthEnd();
                 break;
-            default:
-                cout << "Invalid choice. Please try again." << endl;
         }
+        auto now = chrono::steady_clock::now();
+        stats.record(command.op, chrono::duration_cast<chrono::nanoseconds>(now - previous).count());
+        previous = now;
+    }
+    bank.sync();
+    stats.finish(chrono::duration<double>(chrono::steady_clock::now() - start).count());
+    return stats;
+}
+
+void ReplayStats::print(ostream& out) {
+    size_t total = 0;
+    for (const vector<uint32_t>& opSamples : samples) {
+        total += opSamples.size();
+    }
+    out << "Replayed " << total << " commands in " << (long long)(elapsed * 1000) << " ms ("
+        << (long long)(total / max(elapsed, 1e-9)) << " ops/sec)" << endl;
+    out << left << setw(14) << "Operation" << right << setw(10) << "Count" << setw(14) << "Ops/sec" << setw(10) << "p50 ns"
+        << setw(10) << "p99 ns" << setw(10) << "p999 ns" << endl;
+    for (int op = 0; op < scriptOpCount; ++op) {
+        vector<uint32_t>& opSamples = samples[op];
+        if (opSamples.empty()) {
+            continue;
+        }
+        sort(opSamples.begin(), opSamples.end());
+        uint64_t busy = 0;
+        for (uint32_t sample : opSamples) {
+            busy += sample;
+        }
+        // Nearest-rank percentile
+        auto percentile = [&](double fraction) {
+            return opSamples[(size_t)ceil(fraction * opSamples.size()) - 1];
+        };
+        out << left << setw(14) << scriptOpNames[op] << right << setw(10) << opSamples.size() << setw(14)
+            << (long long)(opSamples.size() * 1e9 / max<uint64_t>(busy, 1)) << setw(10) << percentile(0.5) << setw(10)
+            << percentile(0.99) << setw(10) << percentile(0.999) << endl;
+    }
+}
+
+// Writes a random script: accountCount accounts of 1000.00, then operationCount operations on
+// uniformly chosen accounts (deposits, withdrawals and transfers, with 2% loan applications
+// and 8% loan payments) and a month-end run after every 100000 of them
+bool writeScript(const string& path, int accountCount, int operationCount, unsigned seed) {
+    ofstream out(path);
+    mt19937 rng(seed);
+    for (int i = 1; i <= accountCount; ++i) {
+        out << "A " << i << " 100000 " << (i % 2 ? "Savings" : "Current") << " customer " << i << '\n';
+    }
+    uniform_int_distribution<int> pick(1, accountCount);
+    for (int i = 1; i <= operationCount; ++i) {
+        unsigned kind = rng() % 50;
+        int64_t cents = rng() % 10000 + 1;
+        if (kind < 1) {
+            out << "L " << pick(rng) << ' ' << cents * 100 << '\n';
+        } else if (kind < 5) {
+            out << "P " << pick(rng) << '\n';
+        } else if (kind < 15) {
+            out << "D " << pick(rng) << ' ' << cents << '\n';
+        } else if (kind < 25) {
+            out << "W " << pick(rng) << ' ' << cents << '\n';
+        } else {
+            int from = pick(rng);
+            out << "T " << from << ' ' << pick(rng) << ' ' << cents << '\n';
+        }
+        if (i % 100000 == 0) {
+            out << "M\n";
+        }
+    }
+    return bool(out.flush());
+}
+
+// Cost of an empty probe, then a workload with the metrics it records
+void runMetricsBenchmark() {
+    const int probeCount = 10000000;
+    cout << "Metrics benchmark (" << (BANK_METRICS ? "probes on" : "probes compiled out") << ", 1 in "
+         << Metrics::SamplePeriod << " operations timed)" << endl;
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < probeCount; ++i) {
+        BANK_METRIC_SCOPE(Metric::Lookup);
+        atomic_signal_fence(memory_order_seq_cst);
+    }
+    chrono::duration<double, nano> elapsed = chrono::steady_clock::now() - start;
+    cout << "Empty probe: " << elapsed.count() / probeCount << " ns" << endl;
+
+    WorkloadConfig config;
+    config.accountCount = 100000;
+    Bank bank;
+    loadWorkloadPopulation(bank, config);
+    WorkloadGenerator generator(config);
+    WorkloadResult result = runWorkload(bank, generator, 2000000);
+    cout << "Workload: " << (long long)(2000000 / result.seconds) << " ops/sec" << endl;
+    Metrics::global().report(cout, false);
+}
+
+// A generated script replayed through the command driver
+void runReplayBenchmark() {
+    const int accountCount = 100000;
+    const int operationCount = 1000000;
+    string path = (filesystem::temp_directory_path() / "agrani_bank_bench.script").string();
+    writeScript(path, accountCount, operationCount, 21);
+    vector<ScriptCommand> commands;
+    size_t errorLine;
+    loadScript(path, commands, errorLine);
+    cout << "Replay benchmark (" << accountCount << " accounts, " << operationCount << " operations)" << endl;
+    Bank bank;
+    replayScript(bank, commands).print(cout);
+    filesystem::remove(path);
+}
+
+// Streams a synthetic dataset straight to a file: savings and current accounts with random
+// balances, one in twenty repaying a loan, and four ledger entries per account. Returns the
+// rows written, or 0 on failure.
+uint64_t generateDataset(const string& path, int accountCount, unsigned seed) {
+    const int entriesPerAccount = 4;
+    DatasetWriter writer(path);
+    mt19937 rng(seed);
+    for (int i = 0; i < accountCount; ++i) {
+        bool isLoanTaker = rng() % 20 == 0;
+        string name = "customer " + to_string(i + 1);
+        writer.addAccount({i + 1, name, rng() % 2 ? "Savings" : "Current", Money::fromCents(rng() % 10000000), isLoanTaker,
+                           isLoanTaker ? Money::fromMajor(100 + rng() % 10000) : Money(), isLoanTaker ? (int)(rng() % 12) : 0, 12});
+    }
+    for (int i = 0; i < accountCount; ++i) {
+        for (int j = 0; j < entriesPerAccount; ++j) {
+            writer.addTransaction(i + 1, rng() % 2 ? TransactionType::Deposit : TransactionType::Withdrawal,
+                                  Money::fromCents(rng() % 100000 + 1));
+        }
+    }
+    uint64_t rows = writer.rowCount();
+    return writer.close() ? rows : 0;
+}
+
+// Bulk loading a columnar dataset against building the same bank account by account
+void runBulkLoadBenchmark() {
+    const int accountCount = 1000000;
+    string path = (filesystem::temp_directory_path() / "agrani_bank_bench.rcol").string();
+    string copyPath = path + ".copy";
+
+    cout << "Bulk load benchmark (" << accountCount << " accounts)" << endl;
+    auto start = chrono::steady_clock::now();
+    uint64_t rows = generateDataset(path, accountCount, 37);
+    chrono::duration<double> writeTime = chrono::steady_clock::now() - start;
+
+    start = chrono::steady_clock::now();
+    Bank bank;
+    uint64_t loaded = bank.importDataset(DatasetReader(path));
+    chrono::duration<double> loadTime = chrono::steady_clock::now() - start;
+
+    start = chrono::steady_clock::now();
+    {
+        Bank typedBank;
+        loadMonthEndBank(typedBank, accountCount, 37);
+    }
+    chrono::duration<double> typedTime = chrono::steady_clock::now() - start;
+
+    // Export and reload: the copy must hold the same rows and totals
+    bank.exportDataset(copyPath);
+    Bank copy;
+    uint64_t copied = copy.importDataset(DatasetReader(copyPath));
+    bool same = copied == loaded && filesystem::file_size(copyPath) == filesystem::file_size(path) &&
+                copy.totalBalance() == bank.totalBalance() && copy.outstandingLoans() == bank.outstandingLoans();
 
-    } while (choice != 11);
+    cout << "Write: " << (long long)(rows / writeTime.count()) << " rows/sec, " << filesystem::file_size(path) / rows
+         << " bytes/row" << endl;
+    cout << "Load: " << loaded << " rows, " << (long long)(loaded / loadTime.count()) << " rows/sec ("
+         << (long long)(loadTime.count() * 1000) << " ms), account-by-account (accounts only): "
+         << (long long)(typedTime.count() * 1000) << " ms, round trip " << (same ? "matches" : "DIFFERS") << endl;
+    filesystem::remove(path);
+    filesystem::remove(copyPath);
 }
 
-int main() {
+int main(int argc, char* argv[]) {
+    if (argc > 1 && string(argv[1]) == "--bench") {
+        runEventSinkBenchmark();
+        runConcurrentBenchmark();
+        runDurabilityBenchmark();
+        runMoneyBenchmark();
+        runColumnScanBenchmark();
+        runMonthEndBenchmark();
+        runAggregateBenchmark();
+        runHistoryBenchmark();
+        runAccountTableBenchmark();
+        runAllocationBenchmark();
+        runBulkLoadBenchmark();
+        runReplayBenchmark();
+        runWorkloadBenchmark();
+        runMetricsBenchmark();
+        return 0;
+    }
+    string command = argc > 2 ? argv[1] : "";
+    if (command == "--make-script" && argc > 4) {
+        return writeScript(argv[2], atoi(argv[3]), atoi(argv[4]), argc > 5 ? atoi(argv[5]) : 1) ? 0 : 1;
+    }
+    if (command == "--workload" && argc > 3) {
+        // --workload <accounts> <operations> [skew] [read ratio] [loan rate] [seed]
+        WorkloadConfig config;
+        config.accountCount = atoi(argv[2]);
+        config.skew = argc > 4 ? atof(argv[4]) : config.skew;
+        config.readRatio = argc > 5 ? atof(argv[5]) : config.readRatio;
+        config.loanRate = argc > 6 ? atof(argv[6]) : config.loanRate;
+        config.seed = argc > 7 ? strtoull(argv[7], nullptr, 10) : config.seed;
+        // Written so a NaN fails too
+        if (!(config.accountCount >= 1 && config.skew >= 0 && config.readRatio >= 0 && config.loanRate >= 0 &&
+              config.readRatio + config.loanRate <= 1)) {
+            cout << "Usage: --workload <accounts, at least 1> <operations> [skew, at least 0] [read ratio] [loan rate] [seed]"
+                 << endl;
+            cout << "The read ratio and loan rate are shares from 0 to 1, and together at most 1." << endl;
+            return 1;
+        }
+        Bank bank;
+        loadWorkloadPopulation(bank, config);
+        WorkloadGenerator generator(config);
+        WorkloadResult result = runWorkload(bank, generator, strtoull(argv[3], nullptr, 10));
+        const char* kindNames[workloadKindCount] = {"reads", "deposits", "withdrawals", "transfers", "loan applications",
+                                                    "loan payments"};
+        uint64_t total = 0;
+        for (int kind = 0; kind < workloadKindCount; ++kind) {
+            cout << result.counts[kind] << " " << kindNames[kind] << (kind + 1 < workloadKindCount ? ", " : "\n");
+            total += result.counts[kind];
+        }
+        cout << result.succeeded << " succeeded, " << (long long)(total / max(result.seconds, 1e-9)) << " ops/sec" << endl;
+        return 0;
+    }
+    if (command == "--replay") {
+        // Runs against an in-memory bank, or against the storage files at the optional base path
+        vector<ScriptCommand> commands;
+        size_t errorLine;
+        if (!loadScript(argv[2], commands, errorLine)) {
+            cout << "Could not read " << argv[2];
+            if (errorLine > 0) {
+                cout << ": bad command on line " << errorLine;
+            }
+            cout << endl;
+            return 1;
+        }
+        Bank bank;
+        if (argc > 3 && !bank.openStorage(argv[3])) {
+            cout << "Could not open " << argv[3] << ".wal" << endl;
+            return 1;
+        }
+        replayScript(bank, commands).print(cout);
+        return 0;
+    }
+    if (command == "--generate" && argc > 3) {
+        auto start = chrono::steady_clock::now();
+        uint64_t rows = generateDataset(argv[2], atoi(argv[3]), 1);
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+        cout << "Wrote " << rows << " rows (" << (long long)(rows / elapsed.count()) << " rows/sec)" << endl;
+        return rows > 0 ? 0 : 1;
+    }
+    if (command == "--import" || command == "--export") {
+        Bank bank;
+        bank.openStorage("agrani_bank");
+        auto start = chrono::steady_clock::now();
+        uint64_t rows = 0;
+        if (command == "--export") {
+            rows = bank.exportDataset(argv[2]);
+        } else if (bank.accountCount() > 0) {
+            cout << "Import needs an empty bank; remove the agrani_bank.snap, .wal and .hist files first." << endl;
+            return 1;
+        } else {
+            DatasetReader dataset(argv[2]);
+            if (!dataset.isValid()) {
+                cout << argv[2] << " is not a valid dataset file." << endl;
+                return 1;
+            }
+            rows = bank.importDataset(dataset);
+        }
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+        cout << (command == "--export" ? "Exported " : "Imported ") << rows << " rows ("
+             << (long long)(rows / elapsed.count()) << " rows/sec)" << endl;
+        return rows > 0 ? 0 : 1;
+    }
+
     BankManagementSystem system;
     system.run();
 